@@ -187,6 +187,9 @@ const io_stream_t telnet_stream = {
     .get_rx_buffer_available = TCPStreamRxFree,
     .reset_read_buffer = TCPStreamRxFlush,
     .cancel_read_buffer = TCPStreamRxCancel,
+#if TELNET_ZERO_COPY_RX
+    .read_span = TCPStreamReadSpan,
+#endif
     .suspend_read = serialSuspendInput,
     .enqueue_realtime_command = protocol_enqueue_realtime_command
 };
@@ -0,0 +1,22 @@
+(Determinism check job, run twice by make check)
+G21 G17 G90 G94
+G0 X10 Y10 Z5
+G1 Z-1 F300
+G1 X40 F1200
+G2 X60 Y30 I10 J10 F900
+G1 Y50 F2000
+G3 X30 Y50 I-15 J0
+G4 P0.2
+G91
+G1 X0.5 Y0.2 F3000
+G1 X0.5 Y0.3
+G1 X0.4 Y0.4
+G1 X0.3 Y0.5
+G1 X0.2 Y0.5
+G1 X-0.2 Y0.5
+G1 X-0.3 Y0.5 F1500
+G1 X-0.4 Y0.4
+G90
+G0 Z5
+G0 X0 Y0
+M2
@@ -26,6 +26,7 @@
 #include "eeprom.h"
 #include "grbl_eeprom_extensions.h"
 #include "platform.h"
+#include "simulator.h"
 
 #include "grbl/hal.h"
 
@@ -45,12 +46,25 @@ static axes_signals_t motors_0 = {AXES_BITMASK}, motors_1 = {AXES_BITMASK};
 void Limits1_IRQHandler (void);
 #endif
 
+// Returns simulated time in milliseconds.
+static uint32_t getElapsedTicks (void)
+{
+    return (uint32_t)(sim.masterclock / (F_CPU / 1000));
+}
+
+// Returns the simulated clock, wraps around after 2^32 cycles.
+static uint32_t getCycleCount (void)
+{
+    return (uint32_t)sim.masterclock;
+}
+
 static void driver_delay_ms (uint32_t ms, void (*callback)(void))
 {
     if((delay.ms = ms) > 0) {
         systick_timer.enable = 1;
         if(!(delay.callback = callback))
-            while(delay.ms);
+            while(delay.ms)
+                sim_yield();
     } else if(callback)
         callback();
 }
@@ -76,6 +90,8 @@ static void stepperEnable (axes_signals_t enable)
     mcu_gpio_set(&gpio[STEPPER_ENABLE_PORT], enable.value ^ settings.steppers.enable_invert.mask, AXES_BITMASK);
 }
 
+#ifndef ENABLE_STEP_STREAM
+
 // Starts stepper driver ISR timer and forces a stepper driver interrupt callback
 static void stepperWakeUp (void)
 {
@@ -99,6 +115,8 @@ static void stepperGoIdle (bool clear_signals)
     }
 }
 
+#endif
+
 // Sets up stepper driver interrupt timeout, limiting the slowest speed
 static void stepperCyclesPerTick (uint32_t cycles_per_tick)
 {
@@ -137,6 +155,146 @@ static void stepperPulseStartDelayed (stepper_t *stepper)
     }
 }
 
+#ifdef ENABLE_STEP_STREAM
+
+/* Step stream version, reference for drivers outputting step bits by DMA. Two buffers of frames are played
+   alternately, a buffer is refilled by the core when it has been played out, as would be done from a DMA transfer
+   complete interrupt. The stepper timer simulates the DMA requests, to keep the simulation fast it only fires at
+   the start of frames changing the outputs, halfway through them to end step pulses and at the end of buffers. */
+
+#define STREAM_FRAME_CYCLES (F_CPU / 250000)    // 4 us frames, 2 us step pulses
+#define STREAM_BUFFER_FRAMES 64
+
+static struct {
+    volatile bool filling;
+    volatile bool wake_up;                      // Motion was started while the previous was still playing
+    bool pulse_end;                             // Next timer interrupt ends the step pulse
+    uint_fast8_t current;                       // Buffer being played
+    uint_fast16_t index;                        // Next frame to play
+    uint_fast16_t length[2];                    // Number of frames filled in each buffer
+    axes_signals_t dir_outbits;
+    step_frame_t buffer[2][STREAM_BUFFER_FRAMES];
+} dma;
+
+static uint_fast16_t stepperStreamFill (uint_fast8_t buffer)
+{
+    dma.filling = true;
+    dma.length[buffer] = hal.stepper.stream.fill(dma.buffer[buffer], STREAM_BUFFER_FRAMES);
+    dma.filling = false;
+
+    return dma.length[buffer];
+}
+
+// Fills both buffers, returns false if there is nothing to play
+static bool stepperStreamStart (void)
+{
+    dma.current = 0;
+    dma.index = 0;
+    dma.length[1] = 0;
+
+    if(stepperStreamFill(0) == STREAM_BUFFER_FRAMES)
+        stepperStreamFill(1);
+
+    return dma.length[0] != 0;
+}
+
+static void stepperStreamStop (void)
+{
+    timer[STEPPER_TIMER].value = 0;
+    timer[STEPPER_TIMER].load = 0;
+    timer[STEPPER_TIMER].enable = 0;
+
+    dma.length[0] = dma.length[1] = 0;
+    dma.index = 0;
+    dma.pulse_end = dma.wake_up = false;
+
+    set_step_outputs((axes_signals_t){0});
+}
+
+// Starts playing frames, if the frames of the previous motion are still playing new frames are played after them
+static void stepperWakeUp (void)
+{
+    if(timer[STEPPER_TIMER].enable)
+        dma.wake_up = true;
+    else if(stepperStreamStart()) {
+        dma.pulse_end = false;
+        timer[STEPPER_TIMER].load = STREAM_FRAME_CYCLES;
+        timer[STEPPER_TIMER].value = 0;
+        timer[STEPPER_TIMER].enable = 1;
+    }
+}
+
+// Stops playing frames, unless called by the core from fill(): the frames filled are then played out first
+static void stepperGoIdle (bool clear_signals)
+{
+    if(clear_signals || !dma.filling) {
+
+        stepperStreamStop();
+
+        if(clear_signals)
+            set_dir_outputs(dma.dir_outbits = (axes_signals_t){0});
+    }
+}
+
+// Outputs the next frame or ends the step pulse started by the previous, then skips to the next frame changing
+// the outputs or to the end of the buffer. When a buffer is played out it is refilled, unless motion ends in the
+// other buffer, and playing continues from the other buffer.
+static void stepperStreamFrame (void)
+{
+    uint32_t cycles;
+    step_frame_t *frame;
+
+    if(dma.pulse_end) {
+        dma.pulse_end = false;
+        set_step_outputs((axes_signals_t){0});
+        cycles = STREAM_FRAME_CYCLES / 2;
+    } else {
+
+        if(dma.index == STREAM_BUFFER_FRAMES) {
+            if(dma.length[dma.current ^ 1] == STREAM_BUFFER_FRAMES)
+                stepperStreamFill(dma.current);
+            else
+                dma.length[dma.current] = 0;
+            dma.current ^= 1;
+            dma.index = 0;
+        }
+
+        if(dma.index == dma.length[dma.current]) { // All frames played, stop or continue with the next motion.
+            if(!(dma.wake_up && stepperStreamStart())) {
+                stepperStreamStop();
+                return;
+            }
+            dma.wake_up = false;
+        }
+
+        frame = &dma.buffer[dma.current][dma.index++];
+
+        if(frame->dir_outbits.value != dma.dir_outbits.value)
+            set_dir_outputs(dma.dir_outbits = frame->dir_outbits);
+
+        if((dma.pulse_end = !!frame->step_outbits.value)) {
+            set_step_outputs(frame->step_outbits);
+            cycles = STREAM_FRAME_CYCLES / 2;
+        } else
+            cycles = STREAM_FRAME_CYCLES;
+    }
+
+    if(!dma.pulse_end) {
+        while(dma.index < dma.length[dma.current]) {
+            frame = &dma.buffer[dma.current][dma.index];
+            if(frame->step_outbits.value || frame->dir_outbits.value != dma.dir_outbits.value)
+                break;
+            dma.index++;
+            cycles += STREAM_FRAME_CYCLES;
+        }
+    }
+
+    timer[STEPPER_TIMER].load = cycles;
+    timer[STEPPER_TIMER].value = 0;
+}
+
+#endif
+
 static axes_signals_t limitsGetState()
 {
     axes_signals_t signals = {0};
@@ -359,14 +517,16 @@ bool driver_setup (settings_t *settings)
     hal.spindle.set_state((spindle_state_t){0}, 0.0f);
     hal.coolant.set_state((coolant_state_t){0});
 
+    sim.on_driver_setup();
+
     return settings->version == 18;
 }
 
 // used to inject a sleep in grbl main loop, 
-// ensures hardware simulator gets some cycles in "parallel"
+// hands over to the hardware simulator, see sim_loop()
 void sim_process_realtime (uint_fast16_t state)
 {
-    platform_sleep(0);
+    sim_yield();
 }
 
 bool driver_init ()
@@ -386,6 +546,9 @@ bool driver_init ()
     hal.rx_buffer_size = RX_BUFFER_SIZE;
     hal.f_step_timer = F_CPU;
     hal.delay_ms = driver_delay_ms;
+    hal.get_elapsed_ticks = getElapsedTicks;
+    hal.get_cycle_count = getCycleCount;
+    hal.f_cycle_count = F_CPU;
     hal.settings_changed = settings_changed;
 
     grbl.on_execute_realtime = sim_process_realtime;
@@ -398,6 +561,9 @@ bool driver_init ()
 #ifdef SQUARING_ENABLED
     hal.stepper.disable_motors = StepperDisableMotors;
 #endif
+#ifdef ENABLE_STEP_STREAM
+    hal.stepper.stream.frame_cycles = STREAM_FRAME_CYCLES;
+#endif
 
     hal.limits.enable = limitsEnable;
     hal.limits.get_state = limitsGetState;
@@ -422,6 +588,7 @@ bool driver_init ()
     hal.show_message = showMessage;
 */
     hal.stream.read = serialGetC;
+    hal.stream.read_span = serialReadSpan;
     hal.stream.get_rx_buffer_available = serialRxFree;
     hal.stream.reset_read_buffer = serialRxFlush;
     hal.stream.cancel_read_buffer = serialRxCancel;
@@ -468,7 +635,11 @@ bool driver_init ()
 // Main stepper driver
 void Stepper_IRQHandler (void)
 {
+#ifdef ENABLE_STEP_STREAM
+    stepperStreamFrame();
+#else
     hal.stepper.interrupt_callback();
+#endif
 }
 
 void Control_IRQHandler (void)
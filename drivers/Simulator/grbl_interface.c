@@ -23,6 +23,9 @@
 */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
 
 #include "mcu.h"
 #include "driver.h"
@@ -37,15 +40,278 @@ double next_print_time;
 static void print_steps(bool force);
 static void printBlock(void);
 
+// Batch job statistics, accumulated from the segments executed by the stepper ISR
+typedef struct {
+    bool eof;
+    bool done;
+    bool ready;                 // welcome message received, startup output is complete
+    bool eol;                   // last character sent was an end of line
+    bool frame;                 // line sent is a binary protocol frame, not answered with ok
+    uint32_t lines;             // number of lines sent to grbl
+    uint32_t acks;              // number of ok or error responses received
+    uint32_t errors;
+    uint32_t underruns;         // segment buffer ran dry while the planner had blocks left
+    uint32_t stops;             // motion came to a stop while there was still unprocessed input
+    uint32_t segments;
+    uint64_t start_tick;
+    uint64_t end_tick;
+    uint64_t steps[N_AXIS];
+    double accel_time;
+    double cruise_time;
+    double decel_time;
+    double distance;            // mm, integrated from segment rates
+    float peak_rate;
+    float prev_rate;
+    segment_t *segment;
+    char response[100];
+    bool passthru;
+    uint_fast8_t response_len;
+} job_stats_t;
+
+static job_stats_t job = {0};
+static stepper_pulse_start_ptr pulse_start;
+static stepper_go_idle_ptr go_idle;
+#ifdef ENABLE_STEP_STREAM
+static stepper_stream_fill_ptr stream_fill;
+#endif
+
 // Functions for peeking inside planner state:
 plan_block_t *get_block_buffer();
 plan_block_t *get_block_buffer_head();
 plan_block_t *get_block_buffer_tail();
 
+// Returns the first masterclock value where sim.sim_time reaches time
+static uint64_t time_to_tick (double time)
+{
+    uint64_t tick = (uint64_t)(time * F_CPU);
+
+    while(tick && (float)(tick - 1) / (float)F_CPU >= time)
+        tick--;
+
+    while((float)tick / (float)F_CPU < time)
+        tick++;
+
+    return tick;
+}
+
+// Collects execution time and profile data per segment and counts steps per axis
+static void job_pulse_start (stepper_t *stepper)
+{
+    uint_fast8_t idx = N_AXIS;
+
+    if(stepper->exec_segment && stepper->exec_segment != job.segment) {
+
+        segment_t *segment = job.segment = stepper->exec_segment;
+        double time = (double)segment->n_step * (double)segment->cycles_per_tick / (double)F_CPU;
+
+        if(segment->current_rate > job.prev_rate)
+            job.accel_time += time;
+        else if(segment->current_rate < job.prev_rate)
+            job.decel_time += time;
+        else
+            job.cruise_time += time;
+
+        job.segments++;
+        job.distance += (double)segment->current_rate * time / 60.0;
+        job.peak_rate = max(job.peak_rate, segment->current_rate);
+        job.prev_rate = segment->current_rate;
+    }
+
+    if(stepper->step_outbits.value) do {
+        if(stepper->step_outbits.mask & bit(--idx))
+            job.steps[idx]++;
+    } while(idx);
+
+    pulse_start(stepper);
+}
+
+#ifdef ENABLE_STEP_STREAM
+
+// Counts steps per axis in streamed frames, segment profile data is not available.
+static uint_fast16_t job_stream_fill (step_frame_t *frame, uint_fast16_t count)
+{
+    uint_fast8_t idx;
+    uint_fast16_t filled = stream_fill(frame, count), frames = filled;
+
+    while(frames--) {
+        if(frame->step_outbits.value) {
+            idx = N_AXIS;
+            do {
+                if(frame->step_outbits.mask & bit(--idx))
+                    job.steps[idx]++;
+            } while(idx);
+        }
+        frame++;
+    }
+
+    return filled;
+}
+
+#endif
+
+static void job_go_idle (bool clear_signals)
+{
+    if(sys.state == STATE_CYCLE) {
+        if(plan_get_current_block() != NULL)
+            job.underruns++;
+        else if(!job.eof || job.acks < job.lines)
+            job.stops++;
+    }
+
+    job.segment = NULL;
+    job.prev_rate = 0.0f;
+
+    go_idle(clear_signals);
+}
+
+static void job_driver_setup (void)
+{
+    pulse_start = hal.stepper.pulse_start;
+    hal.stepper.pulse_start = job_pulse_start;
+
+    go_idle = hal.stepper.go_idle;
+    hal.stepper.go_idle = job_go_idle;
+
+#ifdef ENABLE_STEP_STREAM
+    stream_fill = hal.stepper.stream.fill;
+    hal.stepper.stream.fill = job_stream_fill;
+#endif
+}
+
+// Feeds the job file to grbl, carriage returns are dropped so that each line gets exactly one response.
+// Binary protocol frames are not counted as lines as they are acknowledged separately.
+// Nothing is sent before the welcome message has been received, so that responses to the job are
+// not mixed up with output from startup, e.g. errors reported on a settings restore.
+uint8_t job_getchar (void)
+{
+    int c = EOF;
+
+    if(!job.ready)
+        return 0;
+
+    while(!job.eof && (c = fgetc(args.job_file)) == '\r');
+
+    if(c == EOF) {
+        if(!job.eof) {
+            job.eof = true;
+            if(!job.eol) { // terminate last line
+                if(!job.frame)
+                    job.lines++;
+                return '\n';
+            }
+        }
+        return 0;
+    }
+
+    if(!job.lines && !job.eol)
+        job.start_tick = sim.masterclock;
+
+    if(c == ASCII_STX && (job.eol || !job.lines))
+        job.frame = true;
+
+    if((job.eol = c == '\n')) {
+        if(!job.frame)
+            job.lines++;
+        job.frame = false;
+    }
+
+    return (uint8_t)c;
+}
+
+// Counts responses, only lines other than "ok" and flow control acknowledgements are passed on to the output file
+void job_putchar (uint8_t c)
+{
+    uint_fast8_t idx;
+
+    if(c == '\n' || c == '\r') {
+        if(job.passthru) {
+            job.passthru = false;
+            sim_serial_out('\n');
+        } else if(job.response_len) {
+            // Responses are only counted while there are lines sent that have not been answered
+            bool pending = job.acks < job.lines;
+            job.response[job.response_len] = '\0';
+            if(!strncmp(job.response, "GrblHAL ", 8))
+                job.ready = true;
+            if(!strcmp(job.response, "ok") && pending)
+                job.acks++;
+            else if(!strncmp(job.response, "[OK:", 4) && pending) { // flow control acknowledgement of a range of lines
+                char *last;
+                uint32_t first = strtoul(&job.response[4], &last, 10);
+                job.acks = min(job.acks + strtoul(last + 1, NULL, 10) - first + 1, job.lines);
+            } else {
+                if(pending && (!strncmp(job.response, "error", 5) || !strncmp(job.response, "[ERR:", 5))) {
+                    job.acks++;
+                    job.errors++;
+                }
+                for(idx = 0; idx < job.response_len; idx++)
+                    sim_serial_out(job.response[idx]);
+                sim_serial_out('\n');
+            }
+        }
+        job.response_len = 0;
+    } else if(job.passthru)
+        sim_serial_out(c);
+    else if(job.response_len < sizeof(job.response) - 1)
+        job.response[job.response_len++] = c;
+    else { // Too long for a response, pass it on
+        for(idx = 0; idx < job.response_len; idx++)
+            sim_serial_out(job.response[idx]);
+        sim_serial_out(c);
+        job.response_len = 0;
+        job.passthru = true;
+    }
+}
+
+static void job_summary (void)
+{
+    uint_fast8_t idx;
+    double motion_time = job.accel_time + job.cruise_time + job.decel_time;
+#ifdef ENABLE_STEP_STREAM
+    bool profile = false; // Segment profile data is not available from streamed frames
+#else
+    bool profile = true;
+#endif
+
+    printf("Job summary\n");
+    printf("  Lines:                %u (%u errors)\n", job.lines, job.errors);
+    printf("  Machine time:         %.3f s\n", (double)(job.end_tick - job.start_tick) / (double)F_CPU);
+    if(profile) {
+        printf("  Motion time:          %.3f s\n", motion_time);
+        printf("    Accelerating:       %.3f s\n", job.accel_time);
+        printf("    Cruising:           %.3f s\n", job.cruise_time);
+        printf("    Decelerating:       %.3f s\n", job.decel_time);
+        printf("  Segments:             %u\n", job.segments);
+    } else {
+        printf("  Motion time:          n/a\n");
+        printf("    Accelerating:       n/a\n");
+        printf("    Cruising:           n/a\n");
+        printf("    Decelerating:       n/a\n");
+        printf("  Segments:             n/a\n");
+    }
+    printf("  Segment underruns:    %u\n", job.underruns);
+    printf("  Stops, input pending: %u\n", job.stops);
+    if(profile) {
+        printf("  Distance:             %.3f mm\n", job.distance);
+        printf("  Peak feed:            %.1f mm/min\n", job.peak_rate);
+        printf("  Average feed:         %.1f mm/min\n", motion_time > 0.0 ? job.distance * 60.0 / motion_time : 0.0);
+    } else {
+        printf("  Distance:             n/a\n");
+        printf("  Peak feed:            n/a\n");
+        printf("  Average feed:         n/a\n");
+    }
+    for(idx = 0; idx < N_AXIS; idx++)
+        printf("  Steps %c:              %" PRIu64 "\n", "XYZABC"[idx], job.steps[idx]);
+}
+
 void grbl_app_init (void)
 {
+    if(args.job_file)
+        sim.on_driver_setup = job_driver_setup;
+
     //setup local tacking vars
     next_print_time = args.step_time;
+    sim.wake_tick = next_print_time == 0.0 ? 0 : time_to_tick(next_print_time);
 }
 
 void grbl_per_tick (void)
@@ -61,7 +327,17 @@ void grbl_per_tick (void)
 
 void grbl_per_byte (void)
 {
-    if(sim.socket_fd) {
+    if(args.job_file) {
+        // Done when all lines are acknowledged and motion has completed
+        if(!job.done && job.eof && job.acks >= job.lines && (sys.state == STATE_IDLE || (sys.state & (STATE_ALARM|STATE_ESTOP))) &&
+            plan_get_current_block() == NULL) {
+            job.done = true;
+            job.end_tick = sim.masterclock;
+            sim.exit = exit_REQ;
+        }
+        if(args.block_out_file)
+            printBlock();
+    } else if(sim.socket_fd) {
         switch (platform_poll_stdin()) {
 
             case 'e':
@@ -142,6 +418,9 @@ void grbl_app_exit (void)
 {
     //force final position print
     print_steps(1);
+
+    if(args.job_file)
+        job_summary();
 }
 
 //show current position in steps
@@ -173,6 +452,9 @@ static void print_steps (bool force)
             return;
         // print header
         fprintf(args.step_out_file, "# block number %d\n", block_number++);
+        // the first position of the block may already be due, do not let the simulator skip past it
+        if(sim.wake_tick <= sim.masterclock)
+            sim.wake_tick = sim.masterclock + 1;
     }
     //print at correct interval while executing block
     else if ((current_block && sim.sim_time>=next_print_time) || force ) {
@@ -181,6 +463,7 @@ static void print_steps (bool force)
         //make sure the simulation time doesn't get ahead of next_print_time
         while (next_print_time <= sim.sim_time)
             next_print_time += args.step_time;
+        sim.wake_tick = time_to_tick(next_print_time);
     }
 }
 
@@ -205,7 +488,7 @@ static void printBlock (void)
                 block_position[i] += b->steps[i];
             fprintf(args.block_out_file,"%d, ", block_position[i]);
         }
-        fprintf(args.block_out_file,"%f\n", b->entry_speed_sqr);
+        fprintf(args.block_out_file,"%f\n", plan_get_block_entry_speed_sqr(b));
         fflush(args.block_out_file); //TODO: needed?
         last_block = b;
     }
@@ -24,3 +24,5 @@ void grbl_app_init(void);  //call to setup ISRs and local tracking vars
 void grbl_per_tick(void);  //call per tick to print steps
 void grbl_per_byte(void);  //call per incoming byte to print block info
 void grbl_app_exit(void);  //call to shutdown cleanly
+uint8_t job_getchar(void); //stream input from batch job file
+void job_putchar(uint8_t); //count responses from grbl when running a batch job
@@ -59,6 +59,7 @@ int usage(const char* badarg)
       "    -s <step file>     : file to report each step executed.  default = stderr\n"
       "    -e <EEPROM file>   : file containing grblHAL settings.  default = EEPROM.DAT\n"
       "    -p <port>          : port to open raw telnet communication.\n"
+      "    -j <G-code file>   : run file headless as fast as possible and print a job summary.\n"
       "    -c<comment_char>   : character to print before each line from grbl.  default = '#'\n"
       "    -n                 : no comments before grbl response lines.\n"
       "    -h                 : this help.\n"
@@ -72,6 +73,8 @@ int usage(const char* badarg)
 //wrapper for thread interface
 PLAT_THREAD_FUNC(grbl_main_thread, exit)
 {
+    sim.grbl_frame = __builtin_frame_address(0);
+
     grbl_enter();
 
     return NULL;
@@ -219,6 +222,16 @@ int main(int argc, char *argv[])
                     args.port = atoi(*argv);
                     break;
 
+                case 'j':  // Batch job file
+                    argv++; argc--;
+                    args.job_file = fopen(*argv,"r");
+                    if (!args.job_file) {
+                        perror("fopen");
+                        printf("Error opening : %s\n",*argv);
+                        return(usage(0));
+                    }
+                    break;
+
                 case 'h':
                     return usage(NULL);
 
@@ -265,6 +278,13 @@ int main(int argc, char *argv[])
     sim.on_tick = grbl_per_tick;
     sim.on_byte = grbl_per_byte;
 
+    if(args.job_file) {
+        tick_rate = 0.0f; // no realtime pacing
+        args.port = 0;
+        if(args.block_out_file == stdout)
+            args.block_out_file = NULL; // only report blocks if a block file is specified
+    }
+
     init_simulator(tick_rate);
 
     if(args.port) {
@@ -310,6 +330,9 @@ int main(int argc, char *argv[])
         sim.getchar = sim_socket_in;
         sim.putchar = sim_socket_out;
 
+    } else if(args.job_file) {
+        sim.getchar = job_getchar;
+        sim.putchar = job_putchar;
     } else {
         sim.getchar = platform_poll_stdin;
         sim.putchar = sim_serial_out;
@@ -335,9 +358,12 @@ int main(int argc, char *argv[])
     platform_kill_thread(th); //need force kill since original main has no return.
 
     // close the files we opened
-    fclose(args.block_out_file);
+    if(args.block_out_file)
+        fclose(args.block_out_file);
     fclose(args.step_out_file);
     fclose(args.serial_out_file);
+    if(args.job_file)
+        fclose(args.job_file);
 
     if(args.port) {
         if(sim.socket_fd)
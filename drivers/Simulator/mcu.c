@@ -74,13 +74,104 @@ void mcu_disable_interrupts (void)
     irq_enable = false;
 }
 
-void mcu_master_clock (void)
+// Returns number of clocks until a timer will expire
+static inline uint64_t timer_clocks_left (mcu_timer_t *timer)
+{
+    uint64_t steps;
+
+    if(timer->value == 0) {
+        if(timer->load == 0)
+            return UINT64_MAX;
+        steps = (uint64_t)timer->load;
+    } else
+        steps = (uint64_t)timer->value - 1;
+
+    if(timer->prescaler)
+        return steps * timer->prescaler + (timer->prescale ? timer->prescale : 1);
+
+    return steps + 1;
+}
+
+// Counts a timer down without expiring it, clocks must be less than timer_clocks_left()
+static inline void timer_advance (mcu_timer_t *timer, uint32_t clocks)
+{
+    uint32_t steps = clocks;
+
+    if(timer->prescaler) {
+        if(timer->prescale == 0) {
+            timer->prescale = timer->prescaler;
+            steps = 1;
+            clocks--;
+        } else
+            steps = 0;
+        if(clocks >= timer->prescale) {
+            clocks -= timer->prescale;
+            steps += 1 + clocks / timer->prescaler;
+            timer->prescale = timer->prescaler - clocks % timer->prescaler;
+        } else
+            timer->prescale -= clocks;
+    }
+
+    if(steps && timer->value == 0) {
+        timer->value = timer->load;
+        steps--;
+    }
+
+    if(timer->value)
+        timer->value -= steps;
+}
+
+// Returns the number of clocks that can be skipped before an interrupt may be raised
+uint32_t mcu_idle_clocks (void)
 {
     uint_fast8_t i;
+    uint64_t clocks = UINT32_MAX;
 
     if(!booted)
+        return UINT32_MAX;
+
+    for(i = 0; i < MCU_N_GPIO; i++) {
+        if(gpio[i].irq_state.value & gpio[i].irq_mask.value)
+            return 0;
+    }
+
+    for(i = 0; i < MCU_N_TIMERS; i++) {
+        if(timer[i].enable)
+            clocks = min(clocks, timer_clocks_left(&timer[i]));
+    }
+
+    if(systick_timer.enable)
+        clocks = min(clocks, timer_clocks_left(&systick_timer));
+
+    return (uint32_t)(clocks - 1);
+}
+
+// Fast forwards the peripherals, clocks must not exceed the value returned by mcu_idle_clocks()
+void mcu_skip_clocks (uint32_t clocks)
+{
+    uint_fast8_t i;
+
+    if(!booted || clocks == 0)
         return;
 
+    for(i = 0; i < MCU_N_TIMERS; i++) {
+        if(timer[i].enable)
+            timer_advance(&timer[i], clocks);
+    }
+
+    if(systick_timer.enable)
+        timer_advance(&systick_timer, clocks);
+}
+
+// Returns true if an interrupt handler was called
+bool mcu_master_clock (void)
+{
+    uint_fast8_t i;
+    bool irq = false;
+
+    if(!booted)
+        return false;
+
     for(i = 0; i < MCU_N_TIMERS; i++) {
 
         if(timer[i].enable) {
@@ -100,6 +191,7 @@ void mcu_master_clock (void)
                 timer[i].value = timer[i].load;
             else if(--timer[i].value == 0) {
                 if(timer[i].irq_enable && irq_enable) {
+                    irq = true;
                     switch(i)
                     {
                         case 0:
@@ -118,19 +210,25 @@ void mcu_master_clock (void)
     }
 
     for(i = 0; i < MCU_N_GPIO; i++) {
-        if(gpio[i].irq_state.value & gpio[i].irq_mask.value)
+        if(gpio[i].irq_state.value & gpio[i].irq_mask.value) {
+            irq = true;
             isr[GPIO0_IRQ + i]();
+        }
     }
 
     if(systick_timer.enable) {
         if(systick_timer.value == 0)
             systick_timer.value = systick_timer.load;
         else if(--systick_timer.value == 0) {
-            if(systick_timer.irq_enable && irq_enable)
+            if(systick_timer.irq_enable && irq_enable) {
+                irq = true;
                 isr[Systick_IRQ]();
+            }
             systick_timer.value = systick_timer.load;
         }
     }
+
+    return irq;
 }
 
 void mcu_gpio_set (gpio_port_t *port, uint8_t pins, uint8_t mask)
@@ -173,25 +271,33 @@ void mcu_gpio_in (gpio_port_t *port, uint8_t pins, uint8_t mask)
 }
 
 // TODO: move to mcu_master_clock() above
-void simulate_serial (void)
+// Returns true if a character was transferred or an interrupt handler was called
+bool simulate_serial (void)
 {
+    bool busy;
+
     if(!booted)
-        return;
+        return false;
 
-    if(uart.tx_flag) {
+    if((busy = uart.tx_flag)) {
         sim.putchar(uart.tx_data);
         uart.tx_flag = 0;
     }
 
-    if((uart.tx_irq = uart.tx_irq_enable))
+    if((uart.tx_irq = uart.tx_irq_enable)) {
+        busy = true;
         isr[UART_IRQ]();
+    }
 
     if(uart.rx_irq_enable && !uart.rx_irq && hal.stream.get_rx_buffer_available() > 100) {
         uint8_t char_in = sim.getchar();
         if (char_in) {
+            busy = true;
             uart.rx_data = char_in;
             uart.rx_irq = 1;
             isr[UART_IRQ]();
         }
     }
+
+    return busy;
 }
@@ -109,12 +109,14 @@ typedef void (*interrupt_handler)(void);
 void mcu_reset (void);
 void mcu_enable_interrupts (void);
 void mcu_disable_interrupts (void);
-void mcu_master_clock (void);
+bool mcu_master_clock (void);
+uint32_t mcu_idle_clocks (void);
+void mcu_skip_clocks (uint32_t clocks);
 void mcu_register_irq_handler (interrupt_handler handler, irq_num_t irq_num);
 void mcu_gpio_set (gpio_port_t *port, uint8_t pins, uint8_t mask);
 uint8_t mcu_gpio_get (gpio_port_t *port, uint8_t mask);
 void mcu_gpio_in (gpio_port_t *port, uint8_t pins, uint8_t mask);
 void mcu_gpio_toggle_in (gpio_port_t *port, uint8_t pin);
-void simulate_serial (void);
+bool simulate_serial (void);
 
 #endif
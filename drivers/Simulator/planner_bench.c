@@ -0,0 +1,271 @@
+/*
+  planner_bench.c - planner throughput benchmark
+
+  Part of GrblHAL
+
+  Copyright (c) 2020 Terje Io
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// The planner source is included here so that the benchmark can reach the static planner state and
+// time planner_recalculate() on its own. Build with -DBLOCK_BUFFER_SIZE=<n> to select the buffer size.
+
+#include "grbl/planner.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "grbl/grbllib.h"
+#include "grbl/motion_control.h"
+#include "grbl/protocol.h"
+
+#ifndef BENCH_RECALC_PASSES
+#define BENCH_RECALC_PASSES 2000
+#endif
+
+typedef struct {
+    const char *name;
+    void (*run)(uint32_t count);
+    uint32_t count;
+} workload_t;
+
+static uint32_t blocks_executed;
+static float position[N_AXIS];
+static plan_line_data_t pl_data;
+
+static double time_ns (void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static void null_write (const char *s)
+{
+}
+
+// Settings are kept in RAM only, defaults are restored on startup
+
+static uint8_t nvs_data[GRBL_NVS_SIZE];
+
+static uint8_t nvs_get_byte (uint32_t addr)
+{
+    return nvs_data[addr];
+}
+
+static void nvs_put_byte (uint32_t addr, uint8_t new_value)
+{
+    nvs_data[addr] = new_value;
+}
+
+static nvs_transfer_result_t nvs_memcpy_to (uint32_t destination, uint8_t *source, uint32_t size, bool with_checksum)
+{
+    memcpy(&nvs_data[destination], source, size);
+
+    return NVS_TransferResult_OK;
+}
+
+static nvs_transfer_result_t nvs_memcpy_from (uint8_t *destination, uint32_t source, uint32_t size, bool with_checksum)
+{
+    memcpy(destination, &nvs_data[source], size);
+
+    return NVS_TransferResult_OK;
+}
+
+// Called by mc_line() while waiting for buffer space, stands in for the stepper by consuming the oldest block
+static void bench_execute_realtime (uint_fast16_t state)
+{
+    while(plan_check_full_buffer()) {
+        plan_discard_current_block();
+        blocks_executed++;
+    }
+}
+
+static void bench_line (float *target)
+{
+    mc_line(target, &pl_data);
+    memcpy(position, target, sizeof(position));
+}
+
+// Dense 3D finishing pass: short segments along X over a wavy surface, stepping over in Y
+static void workload_surfacing (uint32_t count)
+{
+    float target[N_AXIS] = {0};
+    uint32_t i;
+
+    pl_data.feed_rate = 3000.0f;
+
+    for(i = 0; i < count; i++) {
+        target[X_AXIS] = (float)(i % 1000) * 0.02f;
+        target[Y_AXIS] = (float)(i / 1000) * 0.1f;
+        target[Z_AXIS] = -1.0f + 0.5f * sinf(target[X_AXIS] * 0.7f) * cosf(target[Y_AXIS] * 0.3f);
+        bench_line(target);
+    }
+}
+
+// Long helical arcs, full circles split by mc_arc() according to the arc tolerance setting
+static void workload_arcs (uint32_t count)
+{
+    float target[N_AXIS], offset[N_AXIS] = {0};
+    plane_t plane = { .axis_0 = X_AXIS, .axis_1 = Y_AXIS, .axis_linear = Z_AXIS };
+
+    pl_data.feed_rate = 2000.0f;
+
+    while(count--) {
+        memcpy(target, position, sizeof(target));
+        target[Z_AXIS] -= 0.5f;
+        offset[X_AXIS] = 25.0f;
+        offset[Y_AXIS] = 0.0f;
+        mc_arc(target, &pl_data, position, offset, 25.0f, plane, count & 1);
+        memcpy(position, target, sizeof(position));
+    }
+}
+
+// Cubic B-splines, as generated by G5
+static void workload_splines (uint32_t count)
+{
+    float target[N_AXIS], offset1[N_AXIS] = {0}, offset2[N_AXIS] = {0};
+
+    pl_data.feed_rate = 2000.0f;
+
+    while(count--) {
+        memcpy(target, position, sizeof(target));
+        target[X_AXIS] += 10.0f;
+        target[Y_AXIS] += count & 1 ? 5.0f : -5.0f;
+        offset1[X_AXIS] = 3.0f;
+        offset1[Y_AXIS] = 8.0f;
+        offset2[X_AXIS] = -3.0f;
+        offset2[Y_AXIS] = -8.0f;
+        mc_cubic_b_spline(target, &pl_data, position, offset1, offset2);
+        memcpy(position, target, sizeof(position));
+    }
+}
+
+// Laser raster: short G1 moves along X in laser mode with the power changing for each pixel
+static void workload_raster (uint32_t count)
+{
+    float target[N_AXIS] = {0};
+    uint32_t i;
+
+    settings.mode = Mode_Laser;
+    pl_data.feed_rate = 6000.0f;
+    pl_data.condition.spindle.on = On;
+
+    for(i = 0; i < count; i++) {
+        uint32_t row = i / 500, pixel = i % 500;
+        target[X_AXIS] = (float)(row & 1 ? 500 - pixel : pixel) * 0.1f;
+        target[Y_AXIS] = (float)row * 0.1f;
+        pl_data.spindle.rpm = (float)((i * 37) % 1000);
+        bench_line(target);
+    }
+
+    pl_data.condition.spindle.on = Off;
+    settings.mode = Mode_Standard;
+}
+
+static const workload_t workloads[] = {
+    { "surfacing", workload_surfacing, 200000 },
+    { "mc_arc", workload_arcs, 200 },
+    { "mc_cubic_b_spline", workload_splines, 20000 },
+    { "laser raster", workload_raster, 200000 }
+};
+
+// Times a full-depth planner_recalculate() over the blocks left in the buffer
+static double recalculate_full_ns (uint_fast16_t *depth)
+{
+    uint32_t pass;
+    double start;
+
+    *depth = BLOCK_BUFFER_SIZE - 1 - plan_get_block_buffer_available();
+
+    start = time_ns();
+
+    for(pass = 0; pass < BENCH_RECALC_PASSES; pass++) {
+        block_buffer_planned = block_buffer_tail; // Force reverse pass over the whole buffer
+        planner_recalculate(true);
+    }
+
+    return (time_ns() - start) / (double)BENCH_RECALC_PASSES;
+}
+
+static void run_workload (const workload_t *workload)
+{
+    uint_fast16_t depth;
+    double elapsed, recalc_ns;
+    uint32_t blocks;
+
+    plan_reset();
+    memset(position, 0, sizeof(position));
+    memset(&pl_data, 0, sizeof(plan_line_data_t));
+    plan_sync_position();
+    blocks_executed = 0;
+
+    elapsed = time_ns();
+    workload->run(workload->count);
+    elapsed = time_ns() - elapsed;
+
+    blocks = blocks_executed + BLOCK_BUFFER_SIZE - 1 - plan_get_block_buffer_available();
+    recalc_ns = recalculate_full_ns(&depth);
+
+    printf("%-18s %10u %12.0f %10.3f %10u %12.3f\n", workload->name, blocks, (double)blocks * 1e9 / elapsed,
+            elapsed / (double)blocks / 1000.0, (uint32_t)depth, recalc_ns / 1000.0);
+}
+
+int main (int argc, char *argv[])
+{
+    uint_fast8_t idx;
+
+    // Clear all and set some core function pointers
+    memset(&grbl, 0, sizeof(grbl_t));
+    grbl.on_execute_realtime = bench_execute_realtime;
+    grbl.protocol_enqueue_gcode = protocol_enqueue_gcode;
+
+    // Clear all and set some HAL function pointers
+    memset(&hal, 0, sizeof(grbl_hal_t));
+    hal.version = HAL_VERSION;
+    hal.driver_reset = dummy_handler;
+    hal.irq_enable = dummy_handler;
+    hal.irq_disable = dummy_handler;
+    hal.nvs.size = GRBL_NVS_SIZE;
+
+    if(!driver_init())
+       return -1;
+
+    hal.stream.write = null_write;
+    hal.stream.write_all = null_write;
+
+    hal.nvs.type = NVS_EEPROM;
+    hal.nvs.get_byte = nvs_get_byte;
+    hal.nvs.put_byte = nvs_put_byte;
+    hal.nvs.memcpy_to_nvs = nvs_memcpy_to;
+    hal.nvs.memcpy_from_nvs = nvs_memcpy_from;
+
+    report_init_fns();
+    settings_restore(settings_all);
+    settings_init();
+
+    printf("BLOCK_BUFFER_SIZE = %d\n", BLOCK_BUFFER_SIZE);
+    printf("%-18s %10s %12s %10s %10s %12s\n", "workload", "blocks", "blocks/s", "us/block", "depth", "recalc us");
+
+    for(idx = 0; idx < sizeof(workloads) / sizeof(workload_t); idx++)
+        run_workload(&workloads[idx]);
+
+    printf("\n");
+
+    return 0;
+}
@@ -18,6 +18,10 @@ plat_thread_t* platform_start_thread(plat_threadfunc_t func);
 void platform_stop_thread(plat_thread_t* thread);
 void platform_kill_thread(plat_thread_t* thread);
 
+void platform_sem_init(plat_sem_t* sem);  //counting semaphore, initially zero.
+void platform_sem_post(plat_sem_t* sem);
+void platform_sem_wait(plat_sem_t* sem);  //blocks until the count is nonzero, then decrements it.
+
 uint32_t  platform_ns();  //monotonically increasing nanoseconds since program start.
 void platform_sleep(long microsec); //sleep for suggested time in microsec.
 
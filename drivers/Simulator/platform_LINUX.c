@@ -22,6 +22,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <errno.h>
+#include <sched.h>
 #include <termios.h>
 #include <time.h>
 #include <sys/time.h>
@@ -60,6 +62,11 @@ void platform_sleep(long  microsec)
 {
     struct timespec ts={0};
 
+    if(microsec == 0) { // just yield, nanosleep() takes at least the timer slack
+        sched_yield();
+        return;
+    }
+
     while (microsec >= MS_PER_SEC){
         ts.tv_sec++;
         microsec -= MS_PER_SEC;
@@ -130,6 +137,21 @@ void platform_kill_thread(plat_thread_t* th)
     pthread_cancel(th->tid); 
 }
 
+void platform_sem_init(plat_sem_t* sem)
+{
+    sem_init(sem, 0, 0);
+}
+
+void platform_sem_post(plat_sem_t* sem)
+{
+    sem_post(sem);
+}
+
+void platform_sem_wait(plat_sem_t* sem)
+{
+    while(sem_wait(sem) && errno == EINTR);
+}
+
 //return char if one available.
 uint8_t platform_poll_stdin()
 {
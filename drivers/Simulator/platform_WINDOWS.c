@@ -95,6 +95,21 @@ void platform_kill_thread(plat_thread_t* th)
     TerminateThread(th->tid, 0);
 }
 
+void platform_sem_init(plat_sem_t* sem)
+{
+    *sem = CreateSemaphore(NULL, 0, 1, NULL);
+}
+
+void platform_sem_post(plat_sem_t* sem)
+{
+    ReleaseSemaphore(*sem, 1, NULL);
+}
+
+void platform_sem_wait(plat_sem_t* sem)
+{
+    WaitForSingleObject(*sem, INFINITE);
+}
+
 //return char if one available.
 uint8_t platform_poll_stdin()
 {
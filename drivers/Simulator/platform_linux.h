@@ -3,6 +3,7 @@
 #else
 
 #include <pthread.h>
+#include <semaphore.h>
 
 
 typedef struct {
@@ -11,6 +12,7 @@ typedef struct {
 } plat_thread_t;
 
 typedef void*(*plat_threadfunc_t)(void*);
+typedef sem_t plat_sem_t;
 #define PLAT_THREAD_FUNC(name,arg) void* name(void* arg)
 
 #define PLATFORM_EXTRA_CR '\r'
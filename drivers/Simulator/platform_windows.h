@@ -11,6 +11,7 @@ typedef struct {
 } plat_thread_t;
 
 typedef DWORD WINAPI(*plat_threadfunc_t)(LPVOID);
+typedef HANDLE plat_sem_t;
 #define PLAT_THREAD_FUNC(name,arg) DWORD WINAPI name(LPVOID arg)
 
 #define PLATFORM_EXTRA_CR 0
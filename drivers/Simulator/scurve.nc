@@ -0,0 +1,16 @@
+(S-curve check job, run by make scurve-check)
+(X axis only moves from and to standstill, checked against the analytic jerk limited profile)
+$100=250
+$110=6000
+$120=100
+$170=1000
+G21 G90 G94
+G1 X50 F3000
+G4 P0.1
+G1 X40
+G4 P0.1
+G1 X41
+G4 P0.1
+G1 X61 F6000
+G4 P0.1
+M2
@@ -0,0 +1,269 @@
+/*
+  scurve_check.c - checks step output against the analytic jerk limited velocity profile
+
+  Part of GrblHAL
+
+  Copyright (c) 2020 Terje Io
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Usage: scurve_check <job file> <step file>
+//
+// The job moves the X axis only, each move from and to standstill. Steps per mm ($100), acceleration ($120) and
+// jerk ($170) are read from the settings lines of the job, the feed rate of each move from its F word or the
+// previous one. Each block in the step file is compared to the analytic profile: jerk limited ramps starting and
+// ending at zero acceleration, a cruise at the feed rate if the move is long enough, else a peak speed where the
+// ramps meet. The start time of the move is fitted to the step output, the step position at every sample must
+// then be within SCURVE_TOLERANCE steps of the profile.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#ifndef SCURVE_TOLERANCE
+#define SCURVE_TOLERANCE 2.0
+#endif
+
+#define MAX_MOVES 32
+#define MAX_SAMPLES 200000
+
+typedef struct {
+    double accel;       // mm/s^2
+    double jerk;        // mm/s^3
+    double peak_speed;  // mm/s
+    double ramp_accel;  // peak acceleration of the ramps, mm/s^2
+    double t_jerk;      // duration of the jerk phases, s
+    double t_accel;     // duration of the constant acceleration phase, s
+    double t_ramp;      // duration of a ramp, s
+    double t_cruise;    // s
+    double mm;
+} profile_t;
+
+typedef struct {
+    double time;
+    long steps;
+} sample_t;
+
+static sample_t samples[MAX_SAMPLES];
+
+// Distance of a ramp between standstill and speed, zero acceleration at both ends
+static double ramp_distance (double speed, double accel, double jerk)
+{
+    return 0.5 * speed * (speed * jerk >= accel * accel ? speed / accel + accel / jerk : 2.0 * sqrt(speed / jerk));
+}
+
+static void profile_init (profile_t *p, double mm, double feed, double accel, double jerk)
+{
+    p->mm = mm;
+    p->accel = accel;
+    p->jerk = jerk;
+    p->peak_speed = feed;
+
+    if(2.0 * ramp_distance(feed, accel, jerk) > mm) {
+        double lo = 0.0, hi = feed;
+        int i;
+        for(i = 0; i < 100; i++) {
+            p->peak_speed = 0.5 * (lo + hi);
+            if(2.0 * ramp_distance(p->peak_speed, accel, jerk) > mm)
+                hi = p->peak_speed;
+            else
+                lo = p->peak_speed;
+        }
+    }
+
+    if(p->peak_speed * jerk >= accel * accel) {
+        p->ramp_accel = accel;
+        p->t_jerk = accel / jerk;
+        p->t_accel = p->peak_speed / accel - p->t_jerk;
+    } else {
+        p->t_jerk = sqrt(p->peak_speed / jerk);
+        p->ramp_accel = jerk * p->t_jerk;
+        p->t_accel = 0.0;
+    }
+
+    p->t_ramp = 2.0 * p->t_jerk + p->t_accel;
+    p->t_cruise = (mm - 2.0 * ramp_distance(p->peak_speed, accel, jerk)) / p->peak_speed;
+}
+
+// Distance travelled t seconds into the acceleration ramp
+static double ramp_position (profile_t *p, double t)
+{
+    double tj = p->t_jerk, a = p->ramp_accel, u;
+
+    if(t <= 0.0)
+        return 0.0;
+
+    if(t < tj)
+        return p->jerk * t * t * t / 6.0;
+
+    if(t < tj + p->t_accel) {
+        u = t - tj;
+        return p->jerk * tj * tj * tj / 6.0 + u * (0.5 * a * tj + 0.5 * a * u);
+    }
+
+    if(t < p->t_ramp) {
+        u = p->t_ramp - t;
+        return ramp_distance(p->peak_speed, p->accel, p->jerk) - p->peak_speed * u + p->jerk * u * u * u / 6.0;
+    }
+
+    return ramp_distance(p->peak_speed, p->accel, p->jerk) + p->peak_speed * (t - p->t_ramp);
+}
+
+// Distance travelled t seconds into the move
+static double profile_position (profile_t *p, double t)
+{
+    double t_end = 2.0 * p->t_ramp + p->t_cruise;
+
+    if(t <= 0.0)
+        return 0.0;
+
+    if(t >= t_end)
+        return p->mm;
+
+    if(t < p->t_ramp + p->t_cruise)
+        return ramp_position(p, t);
+
+    return p->mm - ramp_position(p, t_end - t);
+}
+
+// Time at which the move has travelled mm
+static double profile_time (profile_t *p, double mm)
+{
+    double lo = 0.0, hi = 2.0 * p->t_ramp + p->t_cruise, t = 0.0;
+    int i;
+
+    for(i = 0; i < 100; i++) {
+        t = 0.5 * (lo + hi);
+        if(profile_position(p, t) > mm)
+            hi = t;
+        else
+            lo = t;
+    }
+
+    return t;
+}
+
+static int compare_double (const void *a, const void *b)
+{
+    double d = *(const double *)a - *(const double *)b;
+
+    return d < 0.0 ? -1 : (d > 0.0 ? 1 : 0);
+}
+
+// Checks the samples of one move, returns the largest deviation from the profile in steps
+static double check_move (int move, sample_t *s, int n, double steps_per_mm, double feed, double accel, double jerk)
+{
+    static double offsets[MAX_SAMPLES];
+    long start = s[0].steps, distance = labs(s[n - 1].steps - start);
+    double t0, worst = 0.0;
+    int i, n_offsets = 0;
+    profile_t p;
+
+    profile_init(&p, (double)distance / steps_per_mm, feed, accel, jerk);
+
+    // Fit the start time of the move to the samples taken while moving.
+    for(i = 0; i < n; i++) {
+        long steps = labs(s[i].steps - start);
+        if(steps > 0 && steps < distance)
+            offsets[n_offsets++] = s[i].time - profile_time(&p, (double)steps / steps_per_mm);
+    }
+
+    if(n_offsets == 0)
+        return 0.0;
+
+    qsort(offsets, n_offsets, sizeof(double), compare_double);
+    t0 = offsets[n_offsets / 2];
+
+    for(i = 0; i < n; i++) {
+        double error = fabs(profile_position(&p, s[i].time - t0) * steps_per_mm - (double)labs(s[i].steps - start));
+        if(error > worst)
+            worst = error;
+    }
+
+    printf("Move %d: %ld steps, peak speed %.3f mm/s, ramps %.4f s, cruise %.4f s, max deviation %.2f steps\n",
+            move, distance, p.peak_speed, p.t_ramp, p.t_cruise, worst);
+
+    return worst;
+}
+
+int main (int argc, char *argv[])
+{
+    char line[256];
+    double steps_per_mm = 0.0, accel = 0.0, jerk = 0.0, feed = 0.0, feeds[MAX_MOVES], worst = 0.0;
+    int n_moves = 0, n = 0, move = -1;
+    FILE *job, *steps;
+
+    if(argc != 3 || (job = fopen(argv[1], "r")) == NULL || (steps = fopen(argv[2], "r")) == NULL) {
+        fprintf(stderr, "usage: %s <job file> <step file>\n", argv[0]);
+        return 2;
+    }
+
+    while(fgets(line, sizeof(line), job)) {
+        char *f;
+        if(!strncmp(line, "$100=", 5))
+            steps_per_mm = atof(line + 5);
+        else if(!strncmp(line, "$120=", 5))
+            accel = atof(line + 5);
+        else if(!strncmp(line, "$170=", 5))
+            jerk = atof(line + 5);
+        else if(!strncmp(line, "G1", 2) && n_moves < MAX_MOVES) {
+            if((f = strchr(line, 'F')))
+                feed = atof(f + 1);
+            feeds[n_moves++] = feed / 60.0;
+        }
+    }
+    fclose(job);
+
+    if(steps_per_mm <= 0.0 || accel <= 0.0 || jerk <= 0.0 || n_moves == 0) {
+        fprintf(stderr, "%s: $100, $120, $170 and G1 moves must be set in the job\n", argv[1]);
+        return 2;
+    }
+
+    while(true) {
+        bool eof = fgets(line, sizeof(line), steps) == NULL;
+        if(eof || !strncmp(line, "# block number", 14)) {
+            if(move >= 0 && n > 1) {
+                double error = check_move(move, samples, n, steps_per_mm, feeds[move], accel, jerk);
+                if(error > worst)
+                    worst = error;
+            }
+            if(eof)
+                break;
+            if(++move >= n_moves) {
+                fprintf(stderr, "%s: more blocks than moves in the job\n", argv[2]);
+                return 1;
+            }
+            n = 0;
+        } else if(move >= 0 && n < MAX_SAMPLES && sscanf(line, "%lf %ld,", &samples[n].time, &samples[n].steps) == 2)
+            n++;
+    }
+    fclose(steps);
+
+    if(move + 1 != n_moves) {
+        fprintf(stderr, "%s: %d blocks for %d moves in the job\n", argv[2], move + 1, n_moves);
+        return 1;
+    }
+
+    if(worst > SCURVE_TOLERANCE) {
+        printf("FAIL: deviation from the analytic profile exceeds %.1f steps\n", SCURVE_TOLERANCE);
+        return 1;
+    }
+
+    printf("OK\n");
+
+    return 0;
+}
@@ -31,6 +31,7 @@
 
 static stream_tx_buffer_t txbuffer = {0};
 static stream_rx_buffer_t rxbuffer = {0}, rxbackup;
+static uint32_t rx_polls = 0;
 
 static void uart_interrupt_handler (void);
 
@@ -49,6 +50,8 @@ int16_t serialGetC (void)
     int16_t data;
     uint_fast16_t bptr = rxbuffer.tail;
 
+    rx_polls++;
+
     if(bptr == rxbuffer.head)
         return -1; // no data available else EOF
 
@@ -58,6 +61,18 @@ int16_t serialGetC (void)
     return data;
 }
 
+// Releases consumed characters and returns the contiguous span of received data following them
+uint_fast16_t serialReadSpan (char **data, uint_fast16_t consumed)
+{
+    uint_fast16_t head = rxbuffer.head, tail = (rxbuffer.tail + consumed) & (RX_BUFFER_SIZE - 1);
+
+    rx_polls++;
+    rxbuffer.tail = tail;
+    *data = &rxbuffer.data[tail];
+
+    return head >= tail ? head - tail : RX_BUFFER_SIZE - tail;
+}
+
 inline uint16_t serialRxCount (void)
 {
     uint_fast16_t head = rxbuffer.head, tail = rxbuffer.tail;
@@ -70,6 +85,12 @@ uint16_t serialRxFree (void)
     return (RX_BUFFER_SIZE - 1) - serialRxCount();
 }
 
+// Returns the number of times grbl has polled for input, used by the simulator to tell if it is waiting for input
+uint32_t serialRxPolls (void)
+{
+    return rx_polls;
+}
+
 void serialRxFlush (void)
 {
     rxbuffer.tail = rxbuffer.head;
@@ -93,6 +114,7 @@ bool serialPutC (const char c)
     next_head = (txbuffer.head + 1) & (TX_BUFFER_SIZE - 1);     // Get and update head pointer
 
     while(txbuffer.tail == next_head) {                         // Buffer full, block until space is available...
+        sim_yield();
         if(!hal.stream_blocking_callback())
             return false;
     }
@@ -121,9 +143,10 @@ static int16_t serialGetNull (void)
 
 bool serialSuspendInput (bool suspend)
 {
-    if(suspend)
+    if(suspend) {
         hal.stream.read = serialGetNull;
-    else if(rxbuffer.backup)
+        hal.stream.read_span = NULL;
+    } else if(rxbuffer.backup)
         memcpy(&rxbuffer, &rxbackup, sizeof(stream_rx_buffer_t));
 
     return rxbuffer.tail != rxbuffer.head;
@@ -176,6 +199,7 @@ static void uart_interrupt_handler (void)
                 rxbuffer.backup = true;
                 rxbuffer.tail = rxbuffer.head;
                 hal.stream.read = serialGetC; // restore normal input
+                hal.stream.read_span = serialReadSpan;
 
             } else if(!hal.stream.enqueue_realtime_command((char)data)) {
                 rxbuffer.data[rxbuffer.head] = (char)data;  // Add data to buffer
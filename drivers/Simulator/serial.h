@@ -29,9 +29,12 @@
 
 void serialInit (void);
 int16_t serialGetC (void);
+uint_fast16_t serialReadSpan (char **data, uint_fast16_t consumed);
 void serialWriteS (const char *data);
 bool serialSuspendInput (bool suspend);
 uint16_t serialRxFree (void);
+uint32_t serialRxPolls (void);
+uint16_t serialTxCount (void);
 void serialRxFlush (void);
 void serialRxCancel (void);
 
@@ -26,14 +26,16 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include "simulator.h"
 #include "eeprom.h"
 #include "mcu.h"
 #include "driver.h"
+#include "serial.h"
 
-#include "grbl/grbl.h"
+#include "grbl/hal.h"
 
 void sim_nop (void)
 {
@@ -43,7 +45,8 @@ sim_vars_t sim = {
     .on_init = sim_nop,
     .on_tick = sim_nop,
     .on_byte = sim_nop,
-    .on_shutdown = sim_nop
+    .on_shutdown = sim_nop,
+    .on_driver_setup = sim_nop
 };
 
 // Setup 
@@ -52,6 +55,9 @@ void init_simulator (float time_multiplier)
     sim.speedup = time_multiplier;
     sim.baud_ticks = F_CPU / 115200;
 
+    platform_sem_init(&sim.done);
+    platform_sem_init(&sim.halt);
+
     sim.on_init();
 }
 
@@ -61,16 +67,21 @@ void shutdown_simulator (void)
     sim.on_shutdown();
 }
 
-void simulate_hardware (bool do_serial)
+// Returns true if an interrupt was raised or a character was transferred
+bool simulate_hardware (bool do_serial)
 {
+    bool busy;
+
     //do one tick
     sim.masterclock++;
     sim.sim_time = (float)sim.masterclock / (float)F_CPU;
 
-    mcu_master_clock();
+    busy = mcu_master_clock();
 
     if (do_serial)
-        simulate_serial();
+        busy |= simulate_serial();
+
+    return busy;
 /*
     mcu_gpio_in(&gpio[LIMITS_PORT0], sys_position[X_AXIS] >= 250 ? 1 : 0, 1);
     mcu_gpio_in(&gpio[LIMITS_PORT1], sys_position[X_AXIS] >= 280 ? 1 : 0, 1);
@@ -80,42 +91,173 @@ void simulate_hardware (bool do_serial)
   //  can ignore pinout int vect - hw start/hold not supported
 }
 
-// Runs the hardware simulator at the desired rate until sim.exit is set
-void sim_loop (void)
+// Returns the highest masterclock value, capped at limit, that can be reached without skipping
+// an interrupt or a tick the app has requested via sim.wake_tick. Nothing is skipped while an exit request
+// is pending since the app may take it on any tick.
+// Building with SIM_PER_TICK defined disables skipping, the reference for the output of `make check`.
+static uint64_t sim_idle_until (uint64_t limit)
 {
-    uint64_t simulated_ticks=0;
-    uint32_t ns_prev = platform_ns();
-    uint64_t next_byte_tick = F_CPU;   //wait 1 sec before reading IO.
+#ifdef SIM_PER_TICK
+    return sim.masterclock;
+#endif
 
-    while (sim.exit != exit_OK  ) { //don't quit until idle
+    if(sim.exit == exit_REQ)
+        return sim.masterclock;
+
+    uint64_t until = sim.masterclock + mcu_idle_clocks();
+
+    if(until > limit)
+        until = limit;
+
+    if(sim.wake_tick > sim.masterclock && until >= sim.wake_tick)
+        until = sim.wake_tick - 1;
+
+    return until > sim.masterclock ? until : sim.masterclock;
+}
+
+// Jumps the master clock straight to the given value, the ticks in between must be idle
+static void sim_fast_forward (uint64_t until)
+{
+    if(until > sim.masterclock) {
+        mcu_skip_clocks((uint32_t)(until - sim.masterclock));
+        sim.masterclock = until;
+        sim.sim_time = (float)sim.masterclock / (float)F_CPU;
+    }
+}
+
+// State changed by the grbl thread only, used to tell if it did any work since the hardware last advanced
+typedef struct {
+    uint16_t rx_free;
+    uint16_t tx_count;
+    uint_fast8_t planner_free;
+    plan_block_t *current_block;
+    uint_fast16_t state;
+    uint_fast16_t exec_state;
+    uint_fast16_t exec_alarm;
+    uintptr_t wait_site;
+} foreground_state_t;
+
+static uint64_t next_byte_tick = F_CPU;   //wait 1 sec before reading IO.
+static uint32_t rx_polls = 0;
+static foreground_state_t fg_prev = {0};
+static bool in_hardware = false;
+
+static void get_foreground_state (foreground_state_t *fg)
+{
+    memset(fg, 0, sizeof(foreground_state_t)); // clear padding, states are compared with memcmp()
+
+    fg->rx_free = serialRxFree();
+    fg->tx_count = serialTxCount();
+    fg->planner_free = plan_get_block_buffer_available();
+    fg->current_block = plan_get_current_block();
+    fg->state = sys.state;
+    fg->exec_state = sys_rt_exec_state;
+    fg->exec_alarm = sys_rt_exec_alarm;
+}
+
+// Returns a value identifying where the grbl thread waits, a hash of the return addresses up its call chain.
+// Relies on frame pointers, see COMPILE in the Makefile.
+static uintptr_t get_wait_site (void)
+{
+    uintptr_t site = 0;
+    void **frame = __builtin_frame_address(0);
+
+    while(frame && (void *)frame < sim.grbl_frame) {
+        site = site * 31 + (uintptr_t)frame[1];
+        if((void **)frame[0] <= frame)
+            break;
+        frame = (void **)frame[0];
+    }
 
-        if (sim.speedup) {
-            //calculate how many ticks to do.
-            uint32_t ns_now = platform_ns();
-            uint32_t ns_elapsed = (ns_now - ns_prev) * sim.speedup; //todo: try multipling nsnow
-            simulated_ticks += F_CPU / 1e9f * ns_elapsed;
-            ns_prev = ns_now;
+    return site;
+}
+
+// Runs the hardware simulation up to, but not including, the given tick.
+static void sim_run (uint64_t simulated_ticks)
+{
+    in_hardware = true;
+
+    while (sim.masterclock < simulated_ticks) {
+        // skip ticks where neither a timer expires nor a character is due
+        sim_fast_forward(sim_idle_until(next_byte_tick < simulated_ticks ? next_byte_tick : simulated_ticks - 1));
+
+        // only read serial port as fast as the baud rate allows
+        bool read_serial = (sim.masterclock >= next_byte_tick);
+
+        // do low level hardware
+        simulate_hardware(read_serial);
+
+        // do app-specific per-tick processing
+        sim.on_tick();
+
+        if (read_serial) {
+            next_byte_tick += sim.baud_ticks;
+            // do app-specific per-byte processing
+            sim.on_byte();
         }
-        else
-            simulated_ticks++;  //as fast as possible
+    }
+
+    in_hardware = false;
+}
 
-        while (sim.masterclock < simulated_ticks) {
-            // only read serial port as fast as the baud rate allows
-            bool read_serial = (sim.masterclock >= next_byte_tick);
+// Advances the hardware simulation when simulating as fast as possible, else yields to let the hardware thread run.
+// When simulating as fast as possible the grbl thread and the hardware run in lockstep, so a run is repeatable:
+// the hardware is advanced by the grbl thread itself each time it waits. If it waits at the same place as in the
+// previous step, did no work since and either has no pending input or did not poll for it, i.e. it has prepped the
+// segment buffer and waits for input, for room in the planner buffer or for motion to complete, the idle ticks up to
+// the next interrupt, character or tick requested by the app are skipped. Else the hardware advances one tick.
+// Either way the output is the same as when advancing one tick at a time, see SIM_PER_TICK.
+// Calls from interrupt handlers return immediately, the hardware cannot advance while an interrupt is serviced.
+void sim_yield (void)
+{
+    if(sim.speedup)
+        platform_sleep(0);
+    else if(!in_hardware) {
 
-            // do low level hardware
-            simulate_hardware(read_serial);
+        foreground_state_t fg;
 
-            // do app-specific per-tick processing
-            sim.on_tick();
+        get_foreground_state(&fg);
+        fg.wait_site = get_wait_site();
+        sim_run((fg.rx_free == RX_BUFFER_SIZE - 1 || serialRxPolls() == rx_polls) && !memcmp(&fg, &fg_prev, sizeof(foreground_state_t))
+                 ? sim_idle_until(next_byte_tick) + 1
+                 : sim.masterclock + 1);
 
-            if (read_serial) {
-                next_byte_tick += sim.baud_ticks;
-                // do app-specific per-byte processing
-                sim.on_byte();
-            }
+        if(sim.exit == exit_OK) {
+            // hand over to sim_loop() for shutdown, the grbl thread is left blocked so the final reports see a stable state
+            platform_sem_post(&sim.done);
+            while(true)
+                platform_sem_wait(&sim.halt);
         }
 
+        get_foreground_state(&fg_prev);
+        fg_prev.wait_site = fg.wait_site;
+        rx_polls = serialRxPolls();
+    }
+}
+
+// Runs the hardware simulator at the desired rate until sim.exit is set.
+// When simulating as fast as possible the hardware is advanced from sim_yield() in the grbl thread instead,
+// this thread then just blocks until the simulation is complete.
+void sim_loop (void)
+{
+    if(!sim.speedup) {
+        platform_sem_wait(&sim.done);
+        return;
+    }
+
+    uint64_t simulated_ticks = 0;
+    uint32_t ns_prev = platform_ns();
+
+    while (sim.exit != exit_OK  ) { //don't quit until idle
+
+        //calculate how many ticks to do.
+        uint32_t ns_now = platform_ns();
+        uint32_t ns_elapsed = (ns_now - ns_prev) * sim.speedup; //todo: try multipling nsnow
+        simulated_ticks += F_CPU / 1e9f * ns_elapsed;
+        ns_prev = ns_now;
+
+        sim_run(simulated_ticks);
+
         platform_sleep(25); // yield
     }
 }
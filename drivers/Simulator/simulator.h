@@ -25,6 +25,7 @@
 #define simulator_h
 
 #include <stdio.h>
+#include <stdbool.h>
 
 #include "platform.h"
 
@@ -33,9 +34,13 @@ typedef void (*sim_hook_fp)(void); // Signature of functions to be inserted in s
 //simulation globals
 typedef struct sim_vars {
     uint64_t masterclock;
+    uint64_t wake_tick; // masterclock value at which on_tick() has to be called next, 0 = none. Idle ticks before it may be skipped.
     double sim_time;  // current time of the simulation.
     uint8_t started;  // don't start timers until first char recieved.
+    void *grbl_frame; // stack frame of the grbl thread entry, the outermost frame searched by the lockstep
     enum {exit_NO, exit_REQ, exit_OK} exit;
+    plat_sem_t done;  // posted by the grbl thread when the simulation is complete, sim_loop() waits for it.
+    plat_sem_t halt;  // never posted, the grbl thread blocks on it once the simulation is complete.
     float speedup;
     int32_t baud_ticks;
     int socket_fd;
@@ -45,6 +50,7 @@ typedef struct sim_vars {
     sim_hook_fp on_tick;
     sim_hook_fp on_byte;
     sim_hook_fp on_shutdown;
+    sim_hook_fp on_driver_setup;
 } sim_vars_t;
 
 extern sim_vars_t sim;
@@ -54,6 +60,7 @@ typedef struct arg_vars {
     FILE *block_out_file;
     FILE *step_out_file;
     FILE *serial_out_file;
+    FILE *job_file;         // G-code file to run headless, NULL if not in batch job mode
     char eeprom_file[128];
     double step_time;       // Minimum time step for printing stepper values. Given by user via command line
     uint8_t comment_char;   // Char to prefix comments; default  '#' 
@@ -74,9 +81,12 @@ void shutdown_simulator (void);
 // Simulates the hardware until sim.exit is set.
 void sim_loop (void);
 
+// Called by the grbl thread whenever it waits for the hardware.
+void sim_yield (void);
+
 // Call the stepper interrupt until one block is finished
-// (defined in serial.c)
-void simulate_serial (void);
+// (defined in mcu.c)
+bool simulate_serial (void);
 
 //print serial output to stdout or file
 void sim_serial_out (uint8_t data);
@@ -26,6 +26,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <math.h>
+#include <time.h>
 
 #include "platform.h"
 #include "grbl/hal.h"
@@ -40,6 +42,7 @@ typedef struct arg_vars {
     FILE *output_file;
     uint8_t echo;
     uint8_t silent;   
+    uint32_t parser_passes;
 } arg_vars_t;
 
 arg_vars_t args;
@@ -57,6 +60,7 @@ int usage (const char* badarg)
      "    -o <output file> : use output file instead of stdout\n"
      "    -e        : echo input to output\n"
      "    -s        : silent, no output only return code \n"
+     "    -p <passes> : benchmark the g-code word value parser over the input\n"
      "\n  Parses gcode from stdin or input line, prints grbl's expected response"
      "\n  Returns 0 on successs, or line number of error",
      progname);
@@ -108,6 +112,121 @@ void serial_write (const char *data)
     }
 }
 
+static double time_ns (void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+// Times read_float() followed by the previous truncf()/roundf() integer part and mantissa derivation
+// against read_word_value() for all words in the input, and checks that the results agree.
+static int parser_benchmark (FILE *input, uint32_t passes)
+{
+    char line[LINE_BUFFER_SIZE], *words = NULL;
+    uint32_t n_words = 0, n_chars = 0, size = 0, pass, mismatches = 0, ties = 0;
+    int c;
+
+    // Load words, filtered like the protocol does: no whitespace or comments, uppercase.
+    do {
+        uint_fast16_t len = 0, comment = 0;
+
+        while((c = fgetc(input)) != EOF && c != '\n') {
+            if(c == '(')
+                comment = 1;
+            else if(c == ')')
+                comment = 0;
+            else if(c == ';')
+                comment = 2;
+            else if(!comment && c > ' ' && len < LINE_BUFFER_SIZE - 1)
+                line[len++] = CAPS(c);
+        }
+
+        if(len) {
+            if(n_chars + len + 1 > size && !(words = realloc(words, size = (size + len + 1) * 2)))
+                return -1;
+            memcpy(words + n_chars, line, len);
+            n_chars += len;
+            words[n_chars++] = '\0';
+        }
+    } while(c != EOF);
+
+    double t_float = 0.0, t_word = 0.0, start;
+    volatile uint32_t sink = 0;
+
+    for(pass = 0; pass < passes; pass++) {
+
+        uint32_t offset;
+        uint_fast8_t counter;
+        float value;
+        uint32_t int_value;
+        uint_fast16_t mantissa;
+
+        start = time_ns();
+        for(offset = 0; offset < n_chars; offset += strlen(words + offset) + 1) {
+            counter = 0;
+            while(words[offset + counter]) {
+                counter++;
+                if(!read_float(words + offset, &counter, &value))
+                    break;
+                int_value = (uint32_t)truncf(value);
+                mantissa = (uint_fast16_t)roundf(100.0f * (value - int_value));
+                sink += int_value + mantissa;
+            }
+        }
+        t_float += time_ns() - start;
+
+        start = time_ns();
+        for(offset = 0; offset < n_chars; offset += strlen(words + offset) + 1) {
+            counter = 0;
+            while(words[offset + counter]) {
+                counter++;
+                if(!read_word_value(words + offset, &counter, &value, &int_value, &mantissa))
+                    break;
+                sink += int_value + mantissa;
+            }
+        }
+        t_word += time_ns() - start;
+    }
+
+    // Validate, only non-negative values are compared since the old derivation is undefined for negative values.
+    uint32_t offset;
+
+    for(offset = 0; offset < n_chars; offset += strlen(words + offset) + 1) {
+
+        uint_fast8_t counter = 0, counter_w;
+        float value, value_w;
+        uint32_t int_value;
+        uint_fast16_t mantissa;
+
+        while(words[offset + counter]) {
+            counter_w = ++counter;
+            if(!read_float(words + offset, &counter, &value) || !read_word_value(words + offset, &counter_w, &value_w, &int_value, &mantissa))
+                break;
+            n_words++;
+            if(value != value_w || counter != counter_w ||
+                (value >= 0.0f && (int_value != (uint32_t)truncf(value) || mantissa != (uint_fast16_t)roundf(100.0f * (value - int_value))))) {
+                // Decimals at a rounding tie, e.g. 8.615, may be rounded down by the float derivation.
+                if(value == value_w && counter == counter_w && fabsf(100.0f * (value - int_value) - ((float)mantissa - 0.5f)) < 0.01f)
+                    ties++;
+                else if(mismatches++ < 10)
+                    printf("Mismatch: %s\n", words + offset);
+            }
+        }
+    }
+
+    free(words);
+
+    printf("%u words, %u passes\n", n_words, passes);
+    printf("read_float + truncf/roundf: %8.2f ns/word\n", t_float / ((double)n_words * passes));
+    printf("read_word_value:            %8.2f ns/word\n", t_word / ((double)n_words * passes));
+    printf("%u mismatches, %u rounding ties resolved exactly\n", mismatches, ties);
+
+    return mismatches ? 1 : 0;
+}
+
 int main(int argc, char *argv[])
 {
     int positional_args=0;
@@ -117,6 +236,7 @@ int main(int argc, char *argv[])
     args.output_file = stdout;
     args.echo = 0;
     args.silent = 0;
+    args.parser_passes = 0;
 
     progname = argv[0];
 
@@ -133,6 +253,13 @@ int main(int argc, char *argv[])
                     args.silent = 1;
                     break;
 
+                case 'p': //parser benchmark
+                    argv++; argc--;
+                    args.parser_passes = argc > 0 ? atoi(*argv) : 0;
+                    if(args.parser_passes == 0)
+                        return usage(0);
+                    break;
+
                 case 'o': //output file
                     argv++; argc--;
                     args.output_file = fopen(*argv,"w");
@@ -167,6 +294,9 @@ int main(int argc, char *argv[])
         }
     }
 
+    if(args.parser_passes)
+        return parser_benchmark(args.input_file, args.parser_passes);
+
     // Clear all and set some core function pointers
     memset(&grbl, 0, sizeof(grbl_t));
     grbl.on_execute_realtime = protocol_execute_noop;
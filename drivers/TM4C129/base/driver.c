@@ -107,6 +107,9 @@ static void enetStreamWriteS (const char *data)
         .get_rx_buffer_available = TCPStreamRxFree,
         .reset_read_buffer = TCPStreamRxFlush,
         .cancel_read_buffer = TCPStreamRxCancel,
+    #if TELNET_ZERO_COPY_RX
+        .read_span = TCPStreamReadSpan,
+    #endif
         .enqueue_realtime_command = protocol_enqueue_realtime_command,
     #if M6_ENABLE
         .suspend_read = NULL // for now...
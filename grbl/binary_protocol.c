@@ -0,0 +1,232 @@
+/*
+  binary_protocol.c - framed binary motion protocol, used alongside text g-code
+
+  Part of GrblHAL
+
+  Copyright (c) 2020 Terje Io
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "grbl.h"
+
+#ifdef ENABLE_BINARY_PROTOCOL
+
+#include <string.h>
+
+#include "hal.h"
+#include "binary_protocol.h"
+
+#define FRAME_HEADER_SIZE 2 // SEQ and TYPE
+#define FRAME_CRC_SIZE 2
+#define FRAME_MAX_SIZE (FRAME_HEADER_SIZE + 2 + 4 + N_AXIS * 4 + FRAME_CRC_SIZE)
+
+typedef struct {
+    uint8_t expected_seq;
+    uint8_t acked_seq;
+    uint_fast8_t pending;   // Number of frames executed since last acknowledgement
+    bool resync;            // Discard frames until the expected sequence number is received
+} ack_state_t;
+
+static ack_state_t ack = {0};
+
+// CRC-16/CCITT-FALSE, nibble table
+static const uint16_t crc_tbl[16] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+    0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+};
+
+static uint16_t crc16 (const uint8_t *data, uint_fast16_t length)
+{
+    uint16_t crc = 0xFFFF;
+
+    while(length--) {
+        crc = (crc << 4) ^ crc_tbl[(crc >> 12) ^ (*data >> 4)];
+        crc = (crc << 4) ^ crc_tbl[(crc >> 12) ^ (*data++ & 0x0F)];
+    }
+
+    return crc;
+}
+
+static inline int_fast8_t base64_value (char c)
+{
+    if(c >= 'A' && c <= 'Z')
+        return c - 'A';
+    if(c >= 'a' && c <= 'z')
+        return c - 'a' + 26;
+    if(c >= '0' && c <= '9')
+        return c - '0' + 52;
+
+    return c == '+' ? 62 : (c == '/' ? 63 : -1);
+}
+
+// Decodes base64 encoded data, returns the number of bytes decoded or 0 on error.
+static uint_fast16_t base64_decode (char *data, uint_fast16_t length, uint8_t *frame)
+{
+    int_fast8_t value;
+    uint_fast16_t bits = 0, size = 0;
+    uint32_t acc = 0;
+
+    while(length && data[length - 1] == '=')
+        length--;
+
+    while(length--) {
+
+        if((value = base64_value(*data++)) < 0 || size == FRAME_MAX_SIZE)
+            return 0;
+
+        acc = (acc << 6) | value;
+        if((bits += 6) >= 8) {
+            bits -= 8;
+            frame[size++] = (uint8_t)(acc >> bits);
+        }
+    }
+
+    return size;
+}
+
+static inline int32_t get_int32 (const uint8_t *data)
+{
+    return (int32_t)((uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24));
+}
+
+void binary_protocol_flush_acks (void)
+{
+    if(ack.pending) {
+
+        char buf[12];
+
+        ack.pending = 0;
+
+        strcpy(buf, "[ACK:");
+        strcat(buf, uitoa(ack.acked_seq));
+        strcat(buf, "]" ASCII_EOL);
+
+        hal.stream.write(buf);
+    }
+}
+
+static void send_nak (uint8_t seq, status_code_t status)
+{
+    char buf[18];
+
+    binary_protocol_flush_acks();
+
+    strcpy(buf, "[NAK:");
+    strcat(buf, uitoa(seq));
+    strcat(buf, ",");
+    strcat(buf, uitoa((uint32_t)status));
+    strcat(buf, "]" ASCII_EOL);
+
+    hal.stream.write(buf);
+}
+
+static status_code_t execute_motion (uint8_t *data, uint_fast16_t length)
+{
+    uint_fast8_t flags, axes, idx;
+    uint_fast16_t expected;
+    float target[N_AXIS], feed_rate = 0.0f;
+
+    if(length < 2 || ((axes = data[1]) & ~AXES_BITMASK))
+        return Status_InvalidStatement;
+
+    flags = data[0];
+    expected = flags & 0x02 ? 2 + 4 : 2;
+
+    for(idx = 0; idx < N_AXIS; idx++) {
+        if(axes & bit(idx))
+            expected += 4;
+    }
+
+    if(length != expected)
+        return Status_InvalidStatement;
+
+    if(sys.state & (STATE_ALARM|STATE_ESTOP|STATE_JOG))
+        return Status_SystemGClock;
+
+    data += 2;
+
+    if(flags & 0x02) {
+        feed_rate = (float)(uint32_t)get_int32(data) / 1000.0f;
+        data += 4;
+    }
+
+    for(idx = 0; idx < N_AXIS; idx++) {
+        if(axes & bit(idx)) {
+            target[idx] = (float)get_int32(data) / 10000.0f;
+            data += 4;
+        }
+    }
+
+    return gc_execute_motion(target, (axes_signals_t){ .value = axes }, feed_rate, flags & 0x01);
+}
+
+void binary_protocol_execute (char *data, uint_fast16_t length)
+{
+    uint8_t frame[FRAME_MAX_SIZE];
+    status_code_t status = Status_OK;
+
+    if((length = base64_decode(data, length, frame)) < FRAME_HEADER_SIZE + FRAME_CRC_SIZE ||
+         crc16(frame, length - FRAME_CRC_SIZE) != (frame[length - 2] | (frame[length - 1] << 8))) {
+        if(!ack.resync) {
+            ack.resync = true;
+            send_nak(ack.expected_seq, Status_FrameCRCError);
+        }
+        return;
+    }
+
+    if(frame[0] != ack.expected_seq) {
+        if(!ack.resync) {
+            ack.resync = true;
+            send_nak(ack.expected_seq, Status_FrameSequenceError);
+        }
+        return;
+    }
+
+    ack.resync = false;
+    ack.expected_seq++;
+
+    switch((binary_frame_type_t)frame[1]) {
+
+        case BinaryFrame_Sync:
+            break;
+
+        case BinaryFrame_Motion:
+            status = execute_motion(&frame[FRAME_HEADER_SIZE], length - FRAME_HEADER_SIZE - FRAME_CRC_SIZE);
+            break;
+
+        default:
+            status = Status_InvalidStatement;
+            break;
+    }
+
+    if(status == Status_OK) {
+        ack.acked_seq = frame[0];
+        if(++ack.pending >= BINARY_ACK_BATCH || frame[1] == BinaryFrame_Sync)
+            binary_protocol_flush_acks();
+    } else
+        send_nak(frame[0], status);
+}
+
+bool binary_protocol_resync (void)
+{
+    return ack.resync;
+}
+
+void binary_protocol_reset (void)
+{
+    memset(&ack, 0, sizeof(ack_state_t));
+}
+
+#endif
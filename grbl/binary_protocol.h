@@ -0,0 +1,85 @@
+/*
+  binary_protocol.h - framed binary motion protocol, used alongside text g-code
+
+  Part of GrblHAL
+
+  Copyright (c) 2020 Terje Io
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  A frame is sent as a line starting with STX (0x02) followed by the frame data in base64 encoding
+  (RFC 4648 alphabet, padding optional) and terminated by an end of line. The encoding keeps frame data clear
+  of realtime command and control characters so that frames can be sent over any stream unaltered.
+
+  Frame data, multi byte values are little endian:
+
+    SEQ | TYPE | PAYLOAD | CRC (2 bytes)
+
+  SEQ is a sequence number incremented modulo 256 for each frame, starting from 0 after a reset.
+  CRC is the CRC-16/CCITT-FALSE (polynomial 0x1021, initial value 0xFFFF) of SEQ, TYPE and PAYLOAD.
+
+  Frame types:
+
+    0x00 Sync:   no payload. Sends any pending acknowledgement immediately.
+    0x01 Motion: FLAGS | AXES | [FEED] | VALUE * number of bits set in AXES
+                 FLAGS bit 0 set for a G0 rapid motion, else G1. Bit 1 set when FEED is present.
+                 AXES is the axis mask, bit 0 is the X axis.
+                 FEED is the feed rate in units of 0.001 mm/min as an unsigned 32 bit integer.
+                 VALUE is the absolute axis position in the current work coordinate system in units of 0.0001 mm
+                 as a signed 32 bit integer, in axis order.
+
+  Responses are text lines:
+
+    [ACK:<seq>]         All frames up to and including <seq> have been executed.
+    [NAK:<seq>,<code>]  The frame <seq> has not been executed, <code> is the status code.
+                        For Status_FrameCRCError (80) and Status_FrameSequenceError (81) <seq> is the expected
+                        sequence number and frames are discarded until a frame with this number is received,
+                        the host has to resend from it. Text lines received meanwhile are not executed and
+                        answered with error:81.
+                        Other codes are reported for frames that failed to execute, like error:<code> for text
+                        lines. These frames are not resent.
+
+  Acknowledgements are sent for every BINARY_ACK_BATCH frames, before the response to a text line and
+  when the input stream runs empty. Frames are not answered with ok.
+*/
+
+#ifndef _BINARY_PROTOCOL_H_
+#define _BINARY_PROTOCOL_H_
+
+#ifndef BINARY_ACK_BATCH
+#define BINARY_ACK_BATCH 8
+#endif
+
+typedef enum {
+    BinaryFrame_Sync = 0,
+    BinaryFrame_Motion = 1
+} binary_frame_type_t;
+
+#define binary_protocol_enabled() (!!(BINARY_PROTOCOL_STREAMS & (1 << hal.stream.type)))
+
+// Decodes, validates and executes a frame, data is the encoded frame following STX.
+void binary_protocol_execute (char *data, uint_fast16_t length);
+
+// Sends any pending acknowledgement.
+void binary_protocol_flush_acks (void);
+
+// Returns true while input is discarded after a CRC or sequence error.
+bool binary_protocol_resync (void);
+
+// Resets the sequence number.
+void binary_protocol_reset (void);
+
+#endif
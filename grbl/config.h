@@ -165,11 +165,11 @@
 // machines, perhaps to 0.1mm/min, but your success may vary based on multiple factors.
 // #define MINIMUM_FEED_RATE 1.0f // (mm/min)
 
-// Number of arc generation iterations by small angle approximation before exact arc trajectory
-// correction with expensive sin() and cos() calculations. This parameter maybe decreased if there
-// are issues with the accuracy of the arc generations, or increased if arc execution is getting
-// bogged down by too many trig calculations.
-//#define N_ARC_CORRECTION 12 // Integer (1-255)
+// Number of arc segment end points generated per batch. Each batch starts from an exact radius vector,
+// computed with sin() and cos(), and its points are generated from a precomputed rotation table. This
+// parameter may be increased to reduce the number of trig calculations, or decreased to reduce stack usage.
+// NOTE: Replaces N_ARC_CORRECTION, a value set for it is used as the batch size if ARC_BATCH_SIZE is not set.
+//#define ARC_BATCH_SIZE 8 // Integer (1-32)
 
 // The arc G2/3 g-code standard is problematic by definition. Radius-based arcs have horrible numerical
 // errors when arc at semi-circles(pi) or full-circles(2*pi). Offset-based arcs are much more accurate
@@ -201,6 +201,11 @@
 // new incoming motions as they are executed.
 // #define BLOCK_BUFFER_SIZE 16 // Uncomment to override default in planner.h.
 
+// Stores the planner block fields used when recalculating the plan in separate arrays indexed by buffer
+// position instead of in the blocks. The reverse and forward passes then read contiguous memory, which
+// keeps planning fast with very deep planner buffers (several hundred blocks) on MCUs with data cache.
+// #define BLOCK_BUFFER_SOA // Default disabled. Uncomment to enable.
+
 // Governs the size of the intermediary step segment buffer between the step execution algorithm
 // and the planner blocks. Each segment is set of steps executed at a constant velocity over a
 // fixed time defined by ACCELERATION_TICKS_PER_SECOND. They are computed such that the planner
@@ -209,6 +214,14 @@
 // before having to come back and refill this buffer, currently at ~50msec of step moves.
 // #define SEGMENT_BUFFER_SIZE 6 // Uncomment to override default in stepper.h.
 
+// Sizes step segments from the current step rate to cover a time window set by $8 (ms, default 10) instead of
+// the fixed ACCELERATION_TICKS_PER_SECOND time, extended to at least one step and limited to the number of steps
+// the stepper driver can execute in a segment. The segment buffer is allocated for SEGMENT_POOL_SIZE segments
+// (stepper.h) and $7 sets how many are used (default 32), replacing SEGMENT_BUFFER_SIZE. A deeper buffer adds
+// step lead time for foreground processes busy with e.g. network or SD card I/O at the cost of memory and of
+// slower response to feed holds and overrides. Changes to $7 and $8 take effect after a soft reset.
+// #define ENABLE_ADAPTIVE_SEGMENTS // Default disabled. Uncomment to enable.
+
 // Configures the position after a probing cycle during Grbl's check mode. Disabled sets
 // the position to the probe target, when enabled sets the position to the start position.
 // #define SET_CHECK_MODE_PROBE_TO_START // Default disabled. Uncomment to enable.
@@ -280,6 +293,81 @@
 
 //#define ENABLE_BACKLASH_COMPENSATION
 
+// Enables jerk limited (S-curve) acceleration and deceleration ramps, adds per axis jerk settings ($170 - $17x)
+// in mm/sec^3. The acceleration is ramped up and down at the jerk limit instead of being switched on and off, each
+// ramp starts and ends at zero acceleration and its peak acceleration stays within the acceleration settings.
+// The planner computes the entry and exit speeds from the distance these ramps need, the step segment buffer uses
+// the same distances for the velocity profile so the planned speeds are met exactly. When the planner recomputes a
+// ramp in progress the current acceleration is carried into the new ramp if it is in the same direction. Feed hold
+// decelerations, override decelerations and linear acceleration ramps restarted by the planner are executed
+// linearly. A jerk setting of 0 disables S-curve ramps for motions involving the axis.
+//#define ENABLE_S_CURVE_ACCELERATION
+
+// Enables G64 P<tolerance> path blending. In G64 mode the corner between two consecutive G1 motions is replaced
+// by an arc that deviates at most P from the programmed corner, the arc is approximated by line segments within
+// the arc tolerance setting ($12). Each arc uses at most half of the length of the motions it connects.
+// Blending requires the next motion to be known before a motion can be queued, so the last motion is held back
+// until the next motion is received, a synchronizing command is executed or the planner is about to run dry.
+// Motions are not blended when G93 inverse time or G95 feed per revolution mode is active or when the feed rate
+// or spindle state changes between them. G64 without a P word and G61 selects the default exact path mode.
+//#define ENABLE_PATH_BLENDING
+
+// Moves the Bresenham line tracer and AMASS out of the stepper driver interrupt. Segments are expanded in the
+// foreground to a ring buffer of STEP_EVENT_BUFFER_SIZE step events, each holding the step and direction bits to
+// output and the number of timer cycles since the previous event. The interrupt then only replays the events
+// and updates the machine position, ticks not stepping any axis are not executed at all. The foreground has to
+// call st_prep_buffer() often enough to keep the ring from running empty. If it does the interrupt falls back to
+// running the line tracer itself for each event until the foreground catches up.
+// NOTE: Not compatible with drivers controlling the step timer themselves, e.g. for spindle synchronized motion.
+//#define ENABLE_STEP_EVENTS
+
+// Enables the step stream interface in hal.stepper.stream, requires ENABLE_STEP_EVENTS. Drivers with DMA capable
+// timers or shift register outputs may then play motion out as fixed period frames of step and direction bits
+// filled by the core from the step events, taking one interrupt per buffer instead of one per step. The highest
+// step rate is limited by the frame rate, steps closer than one frame apart are delayed to the next frame.
+// Drivers not implementing the interface keep using the step event interrupt.
+//#define ENABLE_STEP_STREAM
+
+// Enables a framed binary protocol alongside text g-code on the stream types selected by BINARY_PROTOCOL_STREAMS
+// in stream.h. A frame carries a straight G0 or G1 motion with fixed width axis values in work coordinates,
+// a sequence number and a CRC and is acknowledged in batches. Frames are sent base64 encoded on lines starting
+// with STX, text lines are still accepted between frames. See binary_protocol.h for the frame format.
+//#define ENABLE_BINARY_PROTOCOL
+
+// Enables credit based flow control on the stream types selected by CREDIT_FLOW_CONTROL_STREAMS in stream.h.
+// When enabled by the host with the $W command ok responses are coalesced into acknowledgements for ranges of
+// lines carrying the number of free planner blocks and input buffer bytes, errors are reported by line number.
+// See flow_control.h for details.
+//#define ENABLE_CREDIT_FLOW_CONTROL
+
+// Enables pushed realtime status reports. A stream subscribes with $A=<interval>[,<deadband>]: a report is then
+// sent every <interval> milliseconds, on a state change and when the machine position has moved more than
+// <deadband> mm on any axis since the last report. $A=0 cancels the subscription, a soft reset does too.
+// Pushed reports are delta encoded: the first report is complete, following reports contain the state and
+// only the fields that changed since the previous pushed report. A field no longer present, e.g. Pn: when
+// all inputs are released, is sent with an empty value. Polled reports ('?') are not affected.
+// A periodic interval requires the driver to provide hal.get_elapsed_ticks().
+//#define ENABLE_AUTO_REPORT
+
+// Enables copying of output from the controlling stream to up to STREAM_MUX_OBSERVERS read-only observer streams,
+// each with its own transmit ring buffer. Output to an observer that cannot keep up is dropped rather than
+// blocking the controlling stream. With the networking plugin a Telnet or WebSocket connection made while the
+// other is in control is attached as an observer. See stream_mux.h for details.
+//#define ENABLE_STREAM_MUX
+
+// Enables execution time statistics for the stepper interrupt handler, st_prep_buffer(), plan_buffer_line(),
+// gc_execute_block() and protocol_execute_realtime() along with segment buffer fill level statistics, reported
+// with the $L system command and cleared with $LR. Times are measured with hal.get_cycle_count() when provided
+// by the driver, else with hal.get_elapsed_ticks() at millisecond resolution. Adds a few microseconds to each
+// stepper interrupt, see latency.h for details.
+//#define ENABLE_LATENCY_STATS
+
+// Enables detection of the planner running empty or the segment buffer draining during a cycle, e.g. when the
+// sender or input stream cannot keep up or the main loop is held up. Each event is recorded with its duration
+// and line number, the realtime report carries the number of events and the last one in a |Sv: field and
+// the $V system command outputs the totals and an event log. See starvation.h for details.
+//#define ENABLE_STARVATION_STATS
+
 // End compile time only default configuration
 
 // When the HAL driver supports spindle sync then this option sets the number of pulses per revolution
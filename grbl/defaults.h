@@ -36,6 +36,7 @@
 
 // Note: DEFAULT_ACCELERATION is only referenced in this file
 #define DEFAULT_ACCELERATION (10.0f * 60.0f * 60.0f) // 10*60*60 mm/min^2 = 10 mm/sec^2
+#define DEFAULT_JERK (1000.0f * 60.0f * 60.0f * 60.0f) // 1000*60*60*60 mm/min^3 = 1000 mm/sec^3
 
 #ifdef DEFAULT_REPORT_MACHINE_POSITION
 #undef DEFAULT_REPORT_MACHINE_POSITION
@@ -135,12 +136,21 @@
 #ifndef DEFAULT_X_ACCELERATION
 #define DEFAULT_X_ACCELERATION DEFAULT_ACCELERATION
 #endif
+#ifndef DEFAULT_X_JERK
+#define DEFAULT_X_JERK DEFAULT_JERK
+#endif
 #ifndef DEFAULT_Y_ACCELERATION
 #define DEFAULT_Y_ACCELERATION DEFAULT_ACCELERATION
 #endif
+#ifndef DEFAULT_Y_JERK
+#define DEFAULT_Y_JERK DEFAULT_JERK
+#endif
 #ifndef DEFAULT_Z_ACCELERATION
 #define DEFAULT_Z_ACCELERATION DEFAULT_ACCELERATION
 #endif
+#ifndef DEFAULT_Z_JERK
+#define DEFAULT_Z_JERK DEFAULT_JERK
+#endif
 #ifndef DEFAULT_X_MAX_TRAVEL
 #define DEFAULT_X_MAX_TRAVEL 200.0f
 #endif
@@ -201,6 +211,12 @@
 #ifndef DEFAULT_STEPPER_IDLE_LOCK_TIME
 #define DEFAULT_STEPPER_IDLE_LOCK_TIME 25
 #endif
+#ifndef DEFAULT_STEPPER_SEGMENTS
+#define DEFAULT_STEPPER_SEGMENTS 32
+#endif
+#ifndef DEFAULT_STEPPER_SEGMENT_TIME
+#define DEFAULT_STEPPER_SEGMENT_TIME 10.0f // ms
+#endif
 #ifndef DEFAULT_JUNCTION_DEVIATION
 #define DEFAULT_JUNCTION_DEVIATION 0.01f
 #endif
@@ -257,6 +273,9 @@
 #ifndef DEFAULT_A_ACCELERATION
 #define DEFAULT_A_ACCELERATION DEFAULT_ACCELERATION
 #endif
+#ifndef DEFAULT_A_JERK
+#define DEFAULT_A_JERK DEFAULT_JERK
+#endif
 #ifndef DEFAULT_A_MAX_TRAVEL
 #define DEFAULT_A_MAX_TRAVEL 200.0f
 #endif
@@ -270,6 +289,9 @@
 #ifndef DEFAULT_B_ACCELERATION
 #define DEFAULT_B_ACCELERATION DEFAULT_ACCELERATION
 #endif
+#ifndef DEFAULT_B_JERK
+#define DEFAULT_B_JERK DEFAULT_JERK
+#endif
 #ifndef DEFAULT_B_MAX_TRAVEL
 #define DEFAULT_B_MAX_TRAVEL 200.0f
 #endif
@@ -283,6 +305,9 @@
 #ifndef DEFAULT_C_ACCELERATION
 #define DEFAULT_C_ACCELERATION DEFAULT_ACCELERATION
 #endif
+#ifndef DEFAULT_C_JERK
+#define DEFAULT_C_JERK DEFAULT_JERK
+#endif
 #ifndef DEFAULT_C_MAX_TRAVEL
 #define DEFAULT_C_MAX_TRAVEL 200.0f
 #endif
@@ -576,6 +601,10 @@
   #endif
 #endif
 
+#if defined(ENABLE_STEP_STREAM) && !defined(ENABLE_STEP_EVENTS)
+  #error "ENABLE_STEP_STREAM requires ENABLE_STEP_EVENTS."
+#endif
+
 // ---------------------------------------------------------------------------------------
 
 #endif
@@ -0,0 +1,141 @@
+/*
+  flow_control.c - credit based flow control with coalesced acknowledgements for high latency streams
+
+  Part of GrblHAL
+
+  Copyright (c) 2020 Terje Io
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "grbl.h"
+
+#ifdef ENABLE_CREDIT_FLOW_CONTROL
+
+#include <string.h>
+
+#include "hal.h"
+#include "planner.h"
+#include "flow_control.h"
+
+typedef struct {
+    bool enabled;
+    bool skip;                          // Do not count the line enabling flow control
+    uint_fast8_t batch;
+    uint_fast8_t pending;               // Number of lines executed since last acknowledgement
+    uint32_t line;                      // Number of the last line executed
+    uint_fast16_t blocks_advertised;    // Free planner blocks when credits were last sent
+} flow_control_t;
+
+static flow_control_t fc = {0};
+
+static char *append_credits (char *buf)
+{
+    fc.blocks_advertised = plan_get_block_buffer_available();
+
+    strcat(buf, "Bf:");
+    strcat(buf, uitoa((uint32_t)fc.blocks_advertised));
+    strcat(buf, ",");
+    strcat(buf, uitoa((uint32_t)hal.stream.get_rx_buffer_available()));
+
+    return buf;
+}
+
+static void flush_acks (void)
+{
+    if(fc.pending) {
+
+        char buf[48];
+
+        strcpy(buf, "[OK:");
+        strcat(buf, uitoa(fc.line - fc.pending + 1));
+        strcat(buf, "-");
+        strcat(buf, uitoa(fc.line));
+        strcat(append_credits(strcat(buf, "|")), "]" ASCII_EOL);
+
+        fc.pending = 0;
+
+        hal.stream.write(buf);
+    }
+}
+
+bool flow_control_report (status_code_t status)
+{
+    if(!fc.enabled || fc.skip || !flow_control_stream()) {
+        fc.skip = false;
+        return false;
+    }
+
+    fc.line++;
+
+    if(status == Status_OK) {
+        if(++fc.pending >= fc.batch || plan_check_full_buffer())
+            flush_acks();
+    } else {
+
+        char buf[28];
+
+        flush_acks();
+
+        strcpy(buf, "[ERR:");
+        strcat(buf, uitoa(fc.line));
+        strcat(buf, ",");
+        strcat(buf, uitoa((uint32_t)status));
+        strcat(buf, "]" ASCII_EOL);
+
+        hal.stream.write(buf);
+    }
+
+    return true;
+}
+
+void flow_control_poll (void)
+{
+    if(fc.enabled && flow_control_stream()) {
+        if(fc.pending)
+            flush_acks();
+        else if(plan_get_block_buffer_available() >= fc.blocks_advertised + fc.batch) {
+
+            char buf[24];
+
+            *buf = '[';
+            buf[1] = '\0';
+            strcat(append_credits(buf), "]" ASCII_EOL);
+
+            hal.stream.write(buf);
+        }
+    }
+}
+
+status_code_t flow_control_enable (uint_fast8_t batch)
+{
+    if(!flow_control_stream())
+        return Status_InvalidStatement;
+
+    flush_acks();
+
+    fc.enabled = fc.skip = batch != 0;
+    fc.batch = batch;
+    fc.line = 0;
+    fc.blocks_advertised = plan_get_block_buffer_available();
+
+    return Status_OK;
+}
+
+void flow_control_reset (void)
+{
+    memset(&fc, 0, sizeof(flow_control_t));
+}
+
+#endif
@@ -0,0 +1,62 @@
+/*
+  flow_control.h - credit based flow control with coalesced acknowledgements for high latency streams
+
+  Part of GrblHAL
+
+  Copyright (c) 2020 Terje Io
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  Flow control is enabled per connection by the host with the $W system command:
+
+    $W          enable with FLOW_CONTROL_ACK_BATCH lines per acknowledgement.
+    $W=<n>      enable with n lines per acknowledgement (1 - 255), 0 disables.
+
+  The command itself is answered with ok, lines received after it are numbered from 1 and answered with:
+
+    [OK:<first>-<last>|Bf:<blocks>,<rx>]  Lines <first> to <last> have been executed, <blocks> is the number of
+                                          free planner blocks and <rx> the number of free bytes in the input buffer.
+    [ERR:<line>,<code>]                   Line <line> failed with status <code>, sent after any pending range.
+
+  Ranges are sent when n lines are pending, when the planner buffer is full and when the input stream runs empty.
+  While the input stream is empty [Bf:<blocks>,<rx>] is sent whenever at least n more planner blocks have been
+  freed since the credits were last advertised.
+
+  Flow control is disabled on a soft reset and when a new Telnet or WebSocket connection is accepted.
+*/
+
+#ifndef _FLOW_CONTROL_H_
+#define _FLOW_CONTROL_H_
+
+#ifndef FLOW_CONTROL_ACK_BATCH
+#define FLOW_CONTROL_ACK_BATCH 8
+#endif
+
+#define flow_control_stream() (!!(CREDIT_FLOW_CONTROL_STREAMS & (1 << hal.stream.type)))
+
+// Enables flow control with batch lines per acknowledgement, disables it if batch is 0.
+status_code_t flow_control_enable (uint_fast8_t batch);
+
+// Reports the status of an executed line, returns false if the status is to be reported with an ok or error:<code> response.
+bool flow_control_report (status_code_t status);
+
+// Sends any pending acknowledgement and advertises freed planner blocks, called when the input stream is empty.
+void flow_control_poll (void);
+
+// Disables flow control.
+void flow_control_reset (void);
+
+#endif
@@ -28,6 +28,9 @@
 #include "hal.h"
 #include "motion_control.h"
 #include "protocol.h"
+#ifdef ENABLE_LATENCY_STATS
+#include "latency.h"
+#endif
 
 // NOTE: Max line number is defined by the g-code standard to be 99999. It seems to be an
 // arbitrary value, and some GUIs may require more. So we increased it based on a max safe
@@ -308,7 +311,24 @@ static status_code_t init_sync_motion (plan_line_data_t *pl_data, float pitch)
 // characters have been removed. In this function, all units and positions are converted and
 // exported to grbl's internal functions in terms of (mm, mm/min) and absolute machine
 // coordinates, respectively.
+#ifdef ENABLE_LATENCY_STATS
+
+static status_code_t execute_block (char *block, char *message);
+
+status_code_t gc_execute_block (char *block, char *message)
+{
+    uint32_t timestamp = latency_enter();
+    status_code_t status = execute_block(block, message);
+
+    latency_exit(Latency_ExecuteBlock, timestamp);
+
+    return status;
+}
+
+static status_code_t execute_block (char *block, char *message)
+#else
 status_code_t gc_execute_block(char *block, char *message)
+#endif
 {
     static parser_block_t gc_block;
 
@@ -376,19 +396,15 @@ status_code_t gc_execute_block(char *block, char *message)
         if((letter < 'A') || (letter > 'Z'))
             FAIL(Status_ExpectedCommandLetter); // [Expected word letter]
 
-        if (!read_float(block, &char_counter, &value))
-            FAIL(Status_BadNumberFormat); // [Expected word value]
-
-        // Convert values to smaller uint8 significand and mantissa values for parsing this word.
+        // Read value along with its integer part and mantissa for parsing this word.
         // NOTE: Mantissa is multiplied by 100 to catch non-integer command values. This is more
         // accurate than the NIST gcode requirement of x10 when used for commands, but not quite
         // accurate enough for value words that require integers to within 0.0001. This should be
-        // a good enough comprimise and catch most all non-integer errors. To make it compliant,
-        // we would simply need to change the mantissa to int16, but this add compiled flash space.
-        // Maybe update this later.
-        int_value = (uint32_t)truncf(value);
-        mantissa = (uint_fast16_t)roundf(100.0f * (value - int_value)); // Compute mantissa for Gxx.x commands.
-        // NOTE: Rounding must be used to catch small floating point errors.
+        // a good enough comprimise and catch most all non-integer errors.
+        // NOTE: Integer part and mantissa are derived from the digits read, not from the float value,
+        // so they are exact and no rounding is needed to catch floating point errors.
+        if (!read_word_value(block, &char_counter, &value, &int_value, &mantissa))
+            FAIL(Status_BadNumberFormat); // [Expected word value]
 
         // Check if the g-code word is supported or errors due to modal group violations or has
         // been repeated in the g-code block. If ok, update the command or record its value.
@@ -561,9 +577,16 @@ status_code_t gc_execute_block(char *block, char *message)
                         word_bit.group = ModalGroup_G13;
                         if (mantissa != 0) // [G61.1 not supported]
                             FAIL(Status_GcodeUnsupportedCommand);
-                        // gc_block.modal.control = CONTROL_MODE_EXACT_PATH; // G61
+                        gc_block.modal.control = ControlMode_ExactPath; // G61
                         break;
 
+#ifdef ENABLE_PATH_BLENDING
+                    case 64:
+                        word_bit.group = ModalGroup_G13;
+                        gc_block.modal.control = ControlMode_Continuous; // G64
+                        break;
+#endif
+
                     case 96: case 97:
                         if(settings.mode == Mode_Lathe && hal.driver_cap.variable_spindle) {
                             word_bit.group = ModalGroup_G14;
@@ -1349,7 +1372,19 @@ status_code_t gc_execute_block(char *block, char *message)
             FAIL(Status_SettingReadFail);
     }
 
-    // [16. Set path control mode ]: N/A. Only G61. G61.1 and G64 NOT SUPPORTED.
+    // [16. Set path control mode ]: G61.1 NOT SUPPORTED. G64 only if path blending is enabled.
+#ifdef ENABLE_PATH_BLENDING
+    if (bit_istrue(command_words, bit(ModalGroup_G13)) && gc_block.modal.control == ControlMode_Continuous) {
+        if (bit_istrue(value_words, bit(Word_P))) {
+            if (gc_block.values.p < 0.0f)
+                FAIL(Status_NegativeValue);
+            if (gc_block.modal.units_imperial)
+                gc_block.values.p *= MM_PER_INCH;
+            bit_false(value_words, bit(Word_P));
+        } else
+            gc_block.values.p = 0.0f; // No tolerance given, exact path with junction deviation only.
+    }
+#endif
     // [17. Set distance mode ]: N/A. Only G91.1. G90.1 NOT SUPPORTED.
     // [18. Set retract mode ]: N/A.
 
@@ -2347,8 +2382,12 @@ status_code_t gc_execute_block(char *block, char *message)
         system_flag_wco_change();
     }
 
-    // [16. Set path control mode ]: G61.1/G64 NOT SUPPORTED
-    // gc_state.modal.control = gc_block.modal.control; // NOTE: Always default.
+    // [16. Set path control mode ]: G61.1 NOT SUPPORTED
+    gc_state.modal.control = gc_block.modal.control;
+#ifdef ENABLE_PATH_BLENDING
+    if (bit_istrue(command_words, bit(ModalGroup_G13)))
+        gc_state.path_tolerance = gc_state.modal.control == ControlMode_Continuous ? gc_block.values.p : 0.0f;
+#endif
 
     // [17. Set distance mode ]:
     gc_state.modal.distance_incremental = gc_block.modal.distance_incremental;
@@ -2437,6 +2476,10 @@ status_code_t gc_execute_block(char *block, char *message)
                 //??    gc_state.distance_per_rev = plan_data.feed_rate;
                     // check initial feed rate - fail if zero?
                 }
+#ifdef ENABLE_PATH_BLENDING
+                else if(gc_state.modal.control == ControlMode_Continuous && gc_state.modal.feed_mode == FeedMode_UnitsPerMin)
+                    plan_data.path_tolerance = gc_state.path_tolerance;
+#endif
                 mc_line(gc_block.values.xyz, &plan_data);
                 break;
 
@@ -2626,3 +2669,57 @@ status_code_t gc_execute_block(char *block, char *message)
 
     return Status_OK;
 }
+
+#ifdef ENABLE_BINARY_PROTOCOL
+
+// Executes a straight G0 or G1 motion without parsing a block, used by the binary protocol.
+// Target values are in millimeters in the current work coordinate system, axes not in the axes mask keep their position.
+// The feed rate is updated if > 0.0f. Motions requiring the block parser, e.g. when scaling or diameter mode is
+// active or when a laser mode motion mode change has to be synchronized, are rejected.
+status_code_t gc_execute_motion (float *target, axes_signals_t axes, float feed_rate, bool rapid)
+{
+    uint_fast8_t idx = N_AXIS;
+    plan_line_data_t plan_data;
+
+    if(gc_state.modal.scaling_active || gc_state.modal.diameter_mode ||
+        gc_state.modal.feed_mode != FeedMode_UnitsPerMin || gc_state.modal.spindle_rpm_mode == SpindleSpeedMode_CSS ||
+         (settings.mode == Mode_Laser && rapid != (gc_state.modal.motion == MotionMode_Seek)))
+        return Status_GcodeUnsupportedCommand;
+
+    if(feed_rate > 0.0f)
+        gc_state.feed_rate = feed_rate;
+    else if(!rapid && gc_state.feed_rate == 0.0f)
+        return Status_GcodeUndefinedFeedRate;
+
+    do {
+        idx--;
+        target[idx] = bit_istrue(axes.value, bit(idx)) ? target[idx] + gc_get_offset(idx) : gc_state.position[idx];
+    } while(idx);
+
+    memset(&plan_data, 0, sizeof(plan_line_data_t));
+
+    gc_state.line_number = 0;
+    gc_state.modal.motion = rapid ? MotionMode_Seek : MotionMode_Linear;
+    gc_state.modal.canned_cycle_active = false;
+
+    plan_data.feed_rate = gc_state.feed_rate;
+    plan_data.condition.rapid_motion = rapid;
+    if(!(rapid && settings.mode == Mode_Laser))
+        memcpy(&plan_data.spindle, &gc_state.spindle, sizeof(spindle_t));
+    plan_data.condition.spindle = gc_state.modal.spindle;
+    plan_data.condition.is_rpm_rate_adjusted = gc_state.is_rpm_rate_adjusted;
+    plan_data.condition.is_laser_ppi_mode = gc_state.is_rpm_rate_adjusted && gc_state.is_laser_ppi_mode;
+    plan_data.condition.coolant = gc_state.modal.coolant;
+#ifdef ENABLE_PATH_BLENDING
+    if(!rapid && gc_state.modal.control == ControlMode_Continuous)
+        plan_data.path_tolerance = gc_state.path_tolerance;
+#endif
+
+    mc_line(target, &plan_data);
+
+    memcpy(gc_state.position, target, sizeof(gc_state.position));
+
+    return Status_OK;
+}
+
+#endif
@@ -91,7 +91,10 @@ typedef enum {
     Status_SDDirNotFound = 63,
     Status_SDFileEmpty = 64,
 
-    Status_BTInitError = 70
+    Status_BTInitError = 70,
+
+    Status_FrameCRCError = 80,
+    Status_FrameSequenceError = 81
 } status_code_t;
 
 
@@ -250,7 +253,10 @@ typedef enum {
 //#define CUTTER_COMP_DISABLE 0 // G40 (Default: Must be zero)
 
 // Modal Group G13: Control mode
-//#define CONTROL_MODE_EXACT_PATH 0 // G61 (Default: Must be zero)
+typedef enum {
+    ControlMode_ExactPath = 0,  // G61 (Default: Must be zero)
+    ControlMode_Continuous = 1  // G64
+} control_mode_t;
 
 // Modal Group G8: Tool length offset
 typedef enum {
@@ -424,7 +430,7 @@ typedef struct {
     // uint8_t cutter_comp;              // {G40} NOTE: Don't track. Only default supported.
     tool_offset_mode_t tool_offset_mode; // {G43,G43.1,G49}
     coord_system_t coord_system;         // {G54,G55,G56,G57,G58,G59,G59.1,G59.2,G59.3}
-    // uint8_t control;                  // {G61} NOTE: Don't track. Only default supported.
+    control_mode_t control;              // {G61,G64}
     program_flow_t program_flow;         // {M0,M1,M2,M30,M60}
     coolant_state_t coolant;             // {M7,M8,M9}
     spindle_state_t spindle;             // {M3,M4,M5}
@@ -515,6 +521,7 @@ typedef struct {
     spindle_t spindle;                  // RPM
     float feed_rate;                    // Millimeters/min
     float distance_per_rev;             // Millimeters/rev
+    float path_tolerance;               // G64 P tolerance in millimeters
     float position[N_AXIS];             // Where the interpreter considers the tool to be at this point in the code
     int32_t line_number;                // Last line number sent
     uint32_t tool_pending;              // Tool to be selected on next M6
@@ -578,6 +585,11 @@ float *gc_get_scaling (void);
 // Get current axis offset.
 float gc_get_offset (uint_fast8_t idx);
 
+#ifdef ENABLE_BINARY_PROTOCOL
+// Execute a G0 or G1 motion to a target in work coordinates without parsing a block
+status_code_t gc_execute_motion (float *target, axes_signals_t axes, float feed_rate, bool rapid);
+#endif
+
 void gc_set_tool_offset (tool_offset_mode_t mode, uint_fast8_t idx, int32_t offset);
 plane_t *gc_get_plane_data (plane_t *plane, plane_select_t select);
 
@@ -30,6 +30,7 @@
 #include "tool_change.h"
 #include "override.h"
 #include "protocol.h"
+#include "motion_control.h"
 #include "limits.h"
 #include "report.h"
 #include "state_machine.h"
@@ -124,6 +125,9 @@ int grbl_enter (void)
     hal.limits.interrupt_callback = limit_interrupt_handler;
     hal.control.interrupt_callback = control_interrupt_handler;
     hal.stepper.interrupt_callback = stepper_driver_interrupt_handler;
+#ifdef ENABLE_STEP_STREAM
+    hal.stepper.stream.fill = stepper_stream_fill;
+#endif
     hal.stream_blocking_callback = stream_tx_blocking;
 
 #ifdef BUFFER_NVSDATA
@@ -241,6 +245,9 @@ int grbl_enter (void)
         limits_set_homing_axes(); // Set axes to be homed from settings.
 #ifdef ENABLE_BACKLASH_COMPENSATION
         mc_backlash_init(); // Init backlash configuration.
+#endif
+#ifdef ENABLE_PATH_BLENDING
+        mc_blend_init(); // Discard motion held back for path blending.
 #endif
         // Sync cleared gcode and planner positions to current system position.
         sync_position();
@@ -79,6 +79,10 @@ typedef void (*driver_reset_ptr)(void);
 typedef void (*stream_write_ptr)(const char *s);
 typedef bool (*enqueue_realtime_command_ptr)(char data);
 
+// Releases the first consumed characters of the span returned by the previous call and returns the number of
+// contiguous characters now available in the input buffer, data is set to point to the first of them.
+typedef uint_fast16_t (*stream_read_span_ptr)(char **data, uint_fast16_t consumed);
+
 typedef struct {
     stream_type_t type;
     uint16_t (*get_rx_buffer_available)(void);
@@ -90,6 +94,8 @@ typedef struct {
     void (*cancel_read_buffer)(void);
     bool (*suspend_read)(bool await);
     enqueue_realtime_command_ptr enqueue_realtime_command; // NOTE: set by grbl at startup.
+    stream_read_span_ptr read_span; // Optional, used instead of read() when set. Code redirecting input by replacing
+                                    // read() must clear or replace this as well.
 } io_stream_t;
 
 typedef struct {
@@ -174,6 +180,21 @@ typedef void (*stepper_pulse_start_ptr)(stepper_t *stepper);
 typedef void (*stepper_output_step_ptr)(axes_signals_t step_outbits, axes_signals_t dir_outbits);
 typedef axes_signals_t (*stepper_get_auto_squared_ptr)(void);
 typedef void (*stepper_interrupt_callback_ptr)(void);
+typedef uint_fast16_t (*stepper_stream_fill_ptr)(step_frame_t *frame, uint_fast16_t count);
+
+/* Optional step stream interface, for drivers that can output step bits from a buffer without a per step interrupt,
+   e.g. by DMA to a GPIO port or to shift registers. Motion is played out as a stream of fixed period frames, the
+   driver fills its buffers by calling fill() from wake_up() and then from its buffer complete interrupt. A step pulse
+   is started at the beginning of a frame and has to end within it, frame_cycles sets the highest step rate.
+   Direction changes are output at least one frame ahead of the first step in the new direction.
+   fill() returns fewer frames than requested when motion is complete, go_idle() is then called from within it and
+   the driver should stop after outputting the frames returned. Machine position and probe input are updated and
+   checked when frames are filled, not when they are output, so buffers should be kept short.
+   NOTE: hal.stepper.pulse_start() is not called for streamed motion. */
+typedef struct {
+    uint32_t frame_cycles;              // Frame period in step timer cycles (hal.f_step_timer), set by driver.
+    stepper_stream_fill_ptr fill;       // Set up by core before driver_init() is called if ENABLE_STEP_STREAM is defined.
+} stepper_stream_t;
 
 typedef struct {
     stepper_wake_up_ptr wake_up;
@@ -186,6 +207,7 @@ typedef struct {
     // Optional entry points:
     stepper_get_auto_squared_ptr get_auto_squared;
     stepper_output_step_ptr output_step;
+    stepper_stream_t stream;
 } stepper_ptrs_t;
 
 // Driver/plugin settings (optional)
@@ -284,6 +306,8 @@ typedef struct {
     bool (*driver_release)(void);
     bool (*get_position)(int32_t (*position)[N_AXIS]);
     uint32_t (*get_elapsed_ticks)(void);
+    uint32_t (*get_cycle_count)(void);  // Free running counter incrementing at f_cycle_count Hz, used for latency statistics
+    uint32_t f_cycle_count;
     void (*pallet_shuttle)(void);
     void (*reboot)(void);
 #ifdef DEBUGOUT
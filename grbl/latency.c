@@ -0,0 +1,201 @@
+/*
+  latency.c - execution time histograms for the stepper interrupt and foreground processing
+
+  Part of GrblHAL
+
+  Copyright (c) 2020 Terje Io
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "grbl.h"
+
+#ifdef ENABLE_LATENCY_STATS
+
+#include <string.h>
+
+#include "hal.h"
+#include "latency.h"
+
+#define LATENCY_BUCKETS 32
+
+typedef struct {
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint32_t bucket[LATENCY_BUCKETS]; // Bucket n holds durations up to 2^n - 1, the last one all longer durations
+} latency_histogram_t;
+
+typedef struct {
+    uint32_t count;
+    uint32_t empty;
+    uint64_t sum;
+    uint_fast8_t min;
+    uint_fast8_t max;
+    uint_fast8_t size;
+} segment_fill_t;
+
+static const char *const probe_name[Latency_Probes] = { "ISR", "PREP", "PLAN", "GC", "RT" };
+
+static latency_histogram_t histogram[Latency_Probes] = {0};
+static segment_fill_t fill = {0};
+
+// Returns the number of significant bits in value.
+static inline uint_fast8_t bit_length (uint32_t value)
+{
+    uint_fast8_t bits = 0;
+
+    if(value & 0xFFFF0000) {
+        bits += 16;
+        value >>= 16;
+    }
+    if(value & 0xFF00) {
+        bits += 8;
+        value >>= 8;
+    }
+    if(value & 0xF0) {
+        bits += 4;
+        value >>= 4;
+    }
+    if(value & 0x0C) {
+        bits += 2;
+        value >>= 2;
+    }
+    if(value & 0x02) {
+        bits++;
+        value >>= 1;
+    }
+
+    return bits + value;
+}
+
+ISR_CODE uint32_t latency_enter (void)
+{
+    return hal.get_cycle_count ? hal.get_cycle_count() : (hal.get_elapsed_ticks ? hal.get_elapsed_ticks() : 0);
+}
+
+ISR_CODE void latency_exit (latency_probe_t probe, uint32_t timestamp)
+{
+    uint_fast8_t idx;
+    uint32_t elapsed = latency_enter() - timestamp;
+    latency_histogram_t *stats = &histogram[probe];
+
+    if(stats->count == 0 || elapsed < stats->min)
+        stats->min = elapsed;
+
+    if(elapsed > stats->max)
+        stats->max = elapsed;
+
+    if((idx = bit_length(elapsed)) >= LATENCY_BUCKETS)
+        idx = LATENCY_BUCKETS - 1;
+
+    stats->bucket[idx]++;
+    stats->count++;
+}
+
+void latency_segment_fill (uint_fast8_t queued, uint_fast8_t size)
+{
+    if(fill.count == 0 || queued < fill.min)
+        fill.min = queued;
+
+    if(queued > fill.max)
+        fill.max = queued;
+
+    if(queued == 0)
+        fill.empty++;
+
+    fill.size = size;
+    fill.sum += queued;
+    fill.count++;
+}
+
+// Returns the upper limit of the bucket holding the percentile, capped by the max value recorded.
+static uint32_t percentile (latency_histogram_t *stats, uint_fast8_t percent)
+{
+    uint_fast8_t idx = 0;
+    uint32_t count = 0, rank = (uint32_t)(((uint64_t)stats->count * percent + 99) / 100);
+
+    while(idx < LATENCY_BUCKETS - 1 && (count += stats->bucket[idx]) < rank)
+        idx++;
+
+    return idx == LATENCY_BUCKETS - 1 ? stats->max : min((uint32_t)((1ULL << idx) - 1), stats->max);
+}
+
+static char *append_us (char *buf, uint32_t elapsed)
+{
+    float f = hal.get_cycle_count ? (float)hal.f_cycle_count : 1000.0f;
+
+    strcat(buf, ",");
+
+    return strcat(buf, ftoa((float)elapsed * 1000000.0f / f, 1));
+}
+
+void latency_report (void)
+{
+    char buf[100];
+    uint_fast8_t idx;
+
+    for(idx = 0; idx < Latency_Probes; idx++) {
+
+        latency_histogram_t stats;
+
+        hal.irq_disable();
+        memcpy(&stats, &histogram[idx], sizeof(latency_histogram_t));
+        hal.irq_enable();
+
+        strcpy(buf, "[LAT:");
+        strcat(buf, probe_name[idx]);
+        strcat(buf, ",");
+        strcat(buf, uitoa(stats.count));
+        if(stats.count) {
+            append_us(buf, stats.min);
+            append_us(buf, percentile(&stats, 50));
+            append_us(buf, percentile(&stats, 90));
+            append_us(buf, percentile(&stats, 99));
+            append_us(buf, stats.max);
+        }
+        strcat(buf, "]" ASCII_EOL);
+
+        hal.stream.write(buf);
+    }
+
+    strcpy(buf, "[SEG:");
+    strcat(buf, uitoa((uint32_t)fill.size));
+    strcat(buf, ",");
+    strcat(buf, uitoa(fill.count));
+    strcat(buf, ",");
+    strcat(buf, uitoa(fill.empty));
+    if(fill.count) {
+        strcat(buf, ",");
+        strcat(buf, uitoa((uint32_t)fill.min));
+        strcat(buf, ",");
+        strcat(buf, ftoa((float)fill.sum / (float)fill.count, 1));
+        strcat(buf, ",");
+        strcat(buf, uitoa((uint32_t)fill.max));
+    }
+    strcat(buf, "]" ASCII_EOL);
+
+    hal.stream.write(buf);
+}
+
+void latency_reset (void)
+{
+    hal.irq_disable();
+    memset(histogram, 0, sizeof(histogram));
+    hal.irq_enable();
+
+    memset(&fill, 0, sizeof(segment_fill_t));
+}
+
+#endif
@@ -0,0 +1,67 @@
+/*
+  latency.h - execution time histograms for the stepper interrupt and foreground processing
+
+  Part of GrblHAL
+
+  Copyright (c) 2020 Terje Io
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  Execution times are measured with hal.get_cycle_count() when provided by the driver, else with
+  hal.get_elapsed_ticks() at millisecond resolution. Times are inclusive, e.g. gc_execute_block() includes
+  any time spent waiting for room in the planner buffer and protocol_execute_realtime() includes st_prep_buffer().
+
+  The statistics are reported with the $L system command, $LR clears them:
+
+    [LAT:<name>,<count>,<min>,<p50>,<p90>,<p99>,<max>]  Execution times in microseconds, one line per probe.
+    [SEG:<size>,<count>,<empty>,<min>,<mean>,<max>]     Segment buffer fill level sampled on each call to
+                                                        st_prep_buffer() while in a cycle, <empty> is the
+                                                        number of samples taken with the buffer empty.
+
+  Durations are counted in power of two buckets so percentiles are rounded up to the bucket limit (capped by <max>).
+  Probe names are ISR (stepper_driver_interrupt_handler, or stepper_stream_fill when the driver uses the step
+  stream interface), PREP (st_prep_buffer), PLAN (plan_buffer_line), GC (gc_execute_block) and
+  RT (protocol_execute_realtime).
+*/
+
+#ifndef _LATENCY_H_
+#define _LATENCY_H_
+
+typedef enum {
+    Latency_StepperInterrupt = 0,
+    Latency_PrepBuffer,
+    Latency_PlanBufferLine,
+    Latency_ExecuteBlock,
+    Latency_ExecuteRealtime,
+    Latency_Probes              // Number of probes, must be last
+} latency_probe_t;
+
+// Returns the current timestamp, to be passed to latency_exit().
+uint32_t latency_enter (void);
+
+// Adds the time elapsed since timestamp to the histogram for probe.
+void latency_exit (latency_probe_t probe, uint32_t timestamp);
+
+// Adds a segment buffer fill level sample, size is the number of segments the buffer can hold.
+void latency_segment_fill (uint_fast8_t queued, uint_fast8_t size);
+
+// Outputs the statistics.
+void latency_report (void);
+
+// Clears the statistics.
+void latency_reset (void);
+
+#endif
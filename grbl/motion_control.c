@@ -39,9 +39,19 @@
 #include "kinematics.h"
 #endif
 
-#ifndef N_ARC_CORRECTION
-#define N_ARC_CORRECTION 12
+// N_ARC_CORRECTION, the number of segments between exact arc corrections, is replaced by ARC_BATCH_SIZE:
+// each batch starts from an exact radius vector. Configurations still setting it keep their value, capped
+// at the largest batch size.
+#if defined(N_ARC_CORRECTION) && !defined(ARC_BATCH_SIZE)
+#define ARC_BATCH_SIZE (N_ARC_CORRECTION > 32 ? 32 : N_ARC_CORRECTION)
 #endif
+#ifndef ARC_BATCH_SIZE
+#define ARC_BATCH_SIZE 8
+#endif
+#if ARC_BATCH_SIZE < 1 || ARC_BATCH_SIZE > 32
+#error "ARC_BATCH_SIZE must be in the range 1 - 32."
+#endif
+#define LINE_BATCH_SIZE ARC_BATCH_SIZE // Batch size for splines and kinematics segments
 #ifndef ARC_ANGULAR_TRAVEL_EPSILON // Float (radians)
 #define ARC_ANGULAR_TRAVEL_EPSILON 5E-7f // Float (radians)
 #endif
@@ -86,6 +96,213 @@ void mc_sync_backlash_position (void)
 
 #endif
 
+#ifdef ENABLE_PATH_BLENDING
+
+#ifndef BLEND_COS_MIN_ANGLE
+#define BLEND_COS_MIN_ANGLE 0.99999f  // Corners with less direction change are not blended.
+#endif
+#ifndef BLEND_COS_MAX_ANGLE
+#define BLEND_COS_MAX_ANGLE -0.9999f  // Corners with more direction change (reversals) are not blended.
+#endif
+#ifndef BLEND_MIN_LENGTH
+#define BLEND_MIN_LENGTH 0.001f       // Shorter remains of blended motions are not queued (mm).
+#endif
+
+// Line motion held back in G64 mode until the next motion is known.
+typedef struct {
+    bool pending;
+    float target[N_AXIS];       // End of held back motion, the corner to be blended.
+    float unit_vec[N_AXIS];     // Direction of held back motion.
+    float length;               // Programmed length of held back motion (mm).
+    float remaining;            // Length left after the previous blend (mm).
+    plan_line_data_t pl_data;
+} blend_t;
+
+static blend_t blend = {0};
+
+// Discards any line motion held back for path blending, called on reset.
+void mc_blend_init (void)
+{
+    blend.pending = false;
+}
+
+// Queues the line motion held back for path blending, if any.
+bool mc_blend_flush (void)
+{
+    if(!blend.pending)
+        return true;
+
+    blend.pending = false;
+
+    return mc_line(blend.target, &blend.pl_data);
+}
+
+// Holds back a copy of the line motion until the next motion is known.
+static bool blend_hold (float *target, plan_line_data_t *pl_data, float *unit_vec, float length, float remaining)
+{
+    memcpy(blend.target, target, sizeof(blend.target));
+    memcpy(blend.unit_vec, unit_vec, sizeof(blend.unit_vec));
+    memcpy(&blend.pl_data, pl_data, sizeof(plan_line_data_t));
+    blend.pl_data.path_tolerance = 0.0f;
+    blend.length = length;
+    blend.remaining = remaining;
+    blend.pending = true;
+
+    return !ABORTED;
+}
+
+// Replaces the corner between the held back motion and the new motion with an arc that deviates at most
+// pl_data->path_tolerance from the corner. The arc is tangent to both motions and is approximated by chords
+// within the arc tolerance. The new motion is then held back in turn, less the part used by the arc.
+// Corners are only blended when the arc radius is larger than the radius used by the planner for the
+// junction speed, else blending would slow the motion down.
+static bool blend_line (float *target, plan_line_data_t *pl_data)
+{
+    uint_fast8_t idx = N_AXIS;
+    float unit_vec[N_AXIS], length = 0.0f, cos_theta = 0.0f;
+
+    do {
+        idx--;
+        unit_vec[idx] = target[idx] - (blend.pending ? blend.target[idx] : gc_state.position[idx]);
+        length += unit_vec[idx] * unit_vec[idx];
+    } while(idx);
+
+    if(length == 0.0f) // Zero length motion, nothing to blend or plan.
+        return !ABORTED;
+
+    length = sqrtf(length);
+
+    idx = N_AXIS;
+    do {
+        idx--;
+        unit_vec[idx] /= length;
+        cos_theta += unit_vec[idx] * blend.unit_vec[idx];
+    } while(idx);
+
+    // Messages and output commands must be executed with the motion they belong to.
+    if(pl_data->message || pl_data->output_commands) {
+        pl_data->path_tolerance = 0.0f;
+        return mc_blend_flush() && mc_line(target, pl_data);
+    }
+
+    // Blend only with a compatible held back motion.
+    if(!blend.pending || pl_data->feed_rate != blend.pl_data.feed_rate ||
+                          pl_data->spindle.rpm != blend.pl_data.spindle.rpm ||
+                           pl_data->condition.value != blend.pl_data.condition.value ||
+                            pl_data->overrides.value != blend.pl_data.overrides.value ||
+                             cos_theta > BLEND_COS_MIN_ANGLE || cos_theta < BLEND_COS_MAX_ANGLE)
+        return mc_blend_flush() && blend_hold(target, pl_data, unit_vec, length, length);
+
+    float theta = acosf(cos_theta), sin_theta_d2 = sqrtf(0.5f * (1.0f + cos_theta));
+
+    // Distance from the corner to the arc end points, the arc midpoint deviates tolerance from the corner.
+    float distance = min(pl_data->path_tolerance / tanf(0.25f * theta), 0.5f * min(blend.length, length));
+    float radius = distance / tanf(0.5f * theta);
+
+    // Compare with radius of the junction deviation circle, see plan_buffer_line().
+    if(radius <= settings.junction_deviation * sin_theta_d2 / (1.0f - sin_theta_d2))
+        return mc_blend_flush() && blend_hold(target, pl_data, unit_vec, length, length);
+
+    float corner[N_AXIS], normal[N_AXIS], center[N_AXIS], position[N_AXIS];
+
+    // Number of chords, as for mc_arc().
+    uint_fast16_t segment, segments = 1;
+    if(2.0f * radius > settings.arc_tolerance)
+        segments = max(1, (uint_fast16_t)floorf(0.5f * theta * radius / sqrtf(settings.arc_tolerance * (2.0f * radius - settings.arc_tolerance))));
+
+    blend.pending = false;
+
+    memcpy(corner, blend.target, sizeof(corner));
+
+    idx = N_AXIS;
+    do {
+        idx--;
+        blend.target[idx] = corner[idx] - distance * blend.unit_vec[idx];
+        normal[idx] = (unit_vec[idx] - cos_theta * blend.unit_vec[idx]) / sinf(theta);
+        center[idx] = blend.target[idx] + radius * normal[idx];
+    } while(idx);
+
+    // Queue held back motion up to the start of the arc.
+    // NOTE: Remains shorter than a step may have a direction far off the path, they are skipped.
+    if(blend.remaining - distance > BLEND_MIN_LENGTH && !mc_line(blend.target, &blend.pl_data))
+        return false;
+
+    memcpy(&blend.pl_data, pl_data, sizeof(plan_line_data_t));
+    blend.pl_data.path_tolerance = 0.0f;
+
+    // Queue the arc chords, the last one ends exactly on the new motion.
+    for(segment = 1; segment <= segments; segment++) {
+
+        float phi = theta * (float)segment / (float)segments, cos_phi = cosf(phi), sin_phi = sinf(phi);
+
+        idx = N_AXIS;
+        do {
+            idx--;
+            position[idx] = segment == segments
+                             ? corner[idx] + distance * unit_vec[idx]
+                             : center[idx] + radius * (sin_phi * blend.unit_vec[idx] - cos_phi * normal[idx]);
+        } while(idx);
+
+        if(!mc_line(position, &blend.pl_data))
+            return false;
+    }
+
+    return blend_hold(target, pl_data, unit_vec, length, length - distance);
+}
+
+#endif // ENABLE_PATH_BLENDING
+
+// Waits for a free block in the planner buffer. Returns false on system abort.
+static bool wait_for_buffer (void)
+{
+    do {
+        if(!protocol_execute_realtime())    // Check for any run-time commands
+            return false;                   // Bail, if system abort.
+        if(plan_check_full_buffer())
+            protocol_auto_cycle_start();    // Auto-cycle start when buffer is full.
+        else
+            break;
+    } while(true);
+
+    return true;
+}
+
+// Called when the planner rejected a motion since its target coincides with the current position.
+static inline void coincident_line (plan_line_data_t *pl_data)
+{
+    // Correctly set spindle state, if there is a coincident position passed.
+    // Forces a buffer sync while in M3 laser mode only.
+    if(settings.mode == Mode_Laser && pl_data->condition.spindle.on && !pl_data->condition.spindle.ccw)
+        hal.spindle.set_state(pl_data->condition.spindle, pl_data->spindle.rpm);
+}
+
+// Queues a sequence of motions in the planner buffer, waiting for free blocks as needed.
+// Returns false on system abort.
+static bool plan_lines (float (*targets)[N_AXIS], uint_fast16_t count, plan_line_data_t *pl_data)
+{
+    uint_fast16_t queued;
+
+    while(count) {
+
+        // If the buffer is full: good! That means we are well ahead of the robot.
+        // Remain in this loop until there is room in the buffer.
+        if(!wait_for_buffer())
+            return false;
+
+        // A short count with room left in the buffer means the next target is coincident.
+        if((queued = plan_buffer_lines(targets, count, pl_data)) < count && !plan_check_full_buffer()) {
+            if(!plan_buffer_line(targets[queued], pl_data))
+                coincident_line(pl_data);
+            queued++;
+        }
+
+        targets += queued;
+        count -= queued;
+    }
+
+    return true;
+}
+
 // Execute linear motion in absolute millimeter coordinates. Feed rate given in millimeters/second
 // unless invert_feed_rate is true. Then the feed_rate means that the motion should be completed in
 // (1 minute)/feed_rate time.
@@ -102,6 +319,15 @@ bool mc_line (float *target, plan_line_data_t *pl_data)
     if (!pl_data->condition.jog_motion && settings.limits.flags.soft_enabled)
         limits_soft_check(target);
 
+#ifdef ENABLE_PATH_BLENDING
+    // Blended motions stay within the programmed corners so the soft limit check above covers them.
+    if (pl_data->path_tolerance > 0.0f && sys.state != STATE_CHECK_MODE)
+        return blend_line(target, pl_data);
+
+    if (!mc_blend_flush())
+        return false;
+#endif
+
     // If in check gcode mode, prevent motion by blocking planner. Soft limits still work.
     if (sys.state != STATE_CHECK_MODE && protocol_execute_realtime()) {
 
@@ -172,36 +398,86 @@ bool mc_line (float *target, plan_line_data_t *pl_data)
 #endif // Backlash comp
 
 #ifdef KINEMATICS_API
-     kinematics.segment_line(target, pl_data, true);
 
-     while(kinematics.segment_line(target, pl_data, false)) {
-#endif
+        // Segments generated by the kinematics are queued in batches with a single plan recalculation each.
+        float segments[LINE_BATCH_SIZE][N_AXIS];
+        uint_fast16_t n_segments = 0;
+
+        kinematics.segment_line(target, pl_data, true);
+
+        while(kinematics.segment_line(target, pl_data, false)) {
+            memcpy(segments[n_segments++], target, sizeof(float) * N_AXIS);
+            if(n_segments == LINE_BATCH_SIZE) {
+                if(!plan_lines(segments, n_segments, pl_data))
+                    return false;
+                n_segments = 0;
+            }
+        }
+
+        if(n_segments && !plan_lines(segments, n_segments, pl_data))
+            return false;
+
+#else
+
         // If the buffer is full: good! That means we are well ahead of the robot.
         // Remain in this loop until there is room in the buffer.
-         do {
-            if(!protocol_execute_realtime())    // Check for any run-time commands
-                return false;                   // Bail, if system abort.
-            if(plan_check_full_buffer())
-                protocol_auto_cycle_start();    // Auto-cycle start when buffer is full.
-            else
-                break;
-        } while(true);
+        if(!wait_for_buffer())
+            return false;
 
         // Plan and queue motion into planner buffer
         // bool plan_status; // Not used in normal operation.
-        if(!plan_buffer_line(target, pl_data) && settings.mode == Mode_Laser && pl_data->condition.spindle.on && !pl_data->condition.spindle.ccw) {
-            // Correctly set spindle state, if there is a coincident position passed.
-            // Forces a buffer sync while in M3 laser mode only.
-            hal.spindle.set_state(pl_data->condition.spindle, pl_data->spindle.rpm);
-        }
-#ifdef KINEMATICS_API
-      }
+        if(!plan_buffer_line(target, pl_data))
+            coincident_line(pl_data);
+
 #endif
     }
 
     return !ABORTED;
 }
 
+// Execute a sequence of linear motions in absolute millimeter coordinates, used by motion generators
+// that produce their segments in batches. Each batch is queued with a single plan recalculation when
+// no per motion processing is required. Returns false on system abort.
+bool mc_lines (float (*targets)[N_AXIS], uint_fast16_t count, plan_line_data_t *pl_data)
+{
+    bool per_line = sys.state == STATE_CHECK_MODE;
+
+#ifdef KINEMATICS_API
+    per_line = true; // Kinematics segmentation and batching is handled by mc_line()
+#endif
+#ifdef ENABLE_BACKLASH_COMPENSATION
+    per_line |= backlash_enabled.mask != 0;
+#endif
+#ifdef ENABLE_PATH_BLENDING
+    per_line |= pl_data->path_tolerance > 0.0f;
+#endif
+
+    if(per_line) {
+
+        uint_fast16_t idx;
+
+        for(idx = 0; idx < count; idx++) {
+            if(!mc_line(targets[idx], pl_data))
+                return false;
+        }
+
+        return !ABORTED;
+    }
+
+    if (!pl_data->condition.jog_motion && settings.limits.flags.soft_enabled) {
+        uint_fast16_t idx;
+        for(idx = 0; idx < count; idx++)
+            limits_soft_check(targets[idx]);
+    }
+
+#ifdef ENABLE_PATH_BLENDING
+    if (!mc_blend_flush())
+        return false;
+#endif
+
+    return protocol_execute_realtime() && plan_lines(targets, count, pl_data) && !ABORTED;
+}
+
 
 // Execute an arc in offset mode format. position == current xyz, target == target xyz,
 // offset == offset from current xyz, axis_X defines circle plane in tool space, axis_linear is
@@ -235,7 +511,9 @@ void mc_arc (float *target, plan_line_data_t *pl_data, float *position, float *o
     // (2x) settings.arc_tolerance. For 99% of users, this is just fine. If a different arc segment fit
     // is desired, i.e. least-squares, midpoint on arc, just change the mm_per_arc_segment calculation.
     // For the intended uses of Grbl, this value shouldn't exceed 2000 for the strictest of cases.
-    uint16_t segments = (uint16_t)floorf(fabsf(0.5f * angular_travel * radius) / sqrtf(settings.arc_tolerance * (2.0f * radius - settings.arc_tolerance)));
+    uint32_t segments = radius > settings.arc_tolerance
+                         ? (uint32_t)floorf(fabsf(0.5f * angular_travel * radius) / sqrtf(settings.arc_tolerance * (2.0f * radius - settings.arc_tolerance)))
+                         : 0;
 
     if (segments) {
 
@@ -247,7 +525,7 @@ void mc_arc (float *target, plan_line_data_t *pl_data, float *position, float *o
             pl_data->condition.inverse_time = Off; // Force as feed absolute mode over arc segments.
         }
 
-        float theta_per_segment = angular_travel/segments;
+        float theta_per_segment = angular_travel / segments;
         float linear_per_segment = (target[plane.axis_linear] - position[plane.axis_linear]) / segments;
 
     /* Vector rotation by transformation matrix: r is the original vector, r_T is the rotated vector,
@@ -256,62 +534,56 @@ void mc_arc (float *target, plan_line_data_t *pl_data, float *position, float *o
                   sin(phi)  cos(phi] * r ;
 
        For arc generation, the center of the circle is the axis of rotation and the radius vector is
-       defined from the circle center to the initial position. Each line segment is formed by successive
-       vector rotations. Single precision values can accumulate error greater than tool precision in rare
-       cases. So, exact arc path correction is implemented. This approach avoids the problem of too many very
-       expensive trig operations [sin(),cos(),tan()] which can take 100-200 usec each to compute.
-
-       Small angle approximation may be used to reduce computation overhead further. A third-order approximation
-       (second order sin() has too much error) holds for most, if not, all CNC applications. Note that this
-       approximation will begin to accumulate a numerical drift error when theta_per_segment is greater than
-       ~0.25 rad(14 deg) AND the approximation is successively used without correction several dozen times. This
-       scenario is extremely unlikely, since segment lengths and theta_per_segment are automatically generated
-       and scaled by the arc tolerance setting. Only a very large arc tolerance setting, unrealistic for CNC
-       applications, would cause this numerical drift error. However, it is best to set N_ARC_CORRECTION from a
-       low of ~4 to a high of ~20 or so to avoid trig operations while keeping arc generation accurate.
-
-       This approximation also allows mc_arc to immediately insert a line segment into the planner
-       without the initial overhead of computing cos() or sin(). By the time the arc needs to be applied
-       a correction, the planner should have caught up to the lag caused by the initial mc_arc overhead.
-       This is important when there are successive arc motions.
+       defined from the circle center to the initial position. Segment end points are generated in batches
+       of up to ARC_BATCH_SIZE points: the radius vector at the start of each batch is computed exactly from
+       the initial radius vector (=-offset), and each point in the batch is that vector rotated by a
+       precomputed k * theta_per_segment rotation. Errors are thus bounded by the table and do not accumulate
+       along the arc, and the inner loop has no dependencies between points so it can be pipelined or
+       vectorised by the compiler. Only one sin() and cos() pair is computed per batch.
     */
 
-        // Computes: cos_T = 1 - theta_per_segment^2/2, sin_T = theta_per_segment - theta_per_segment^3/6) in ~52usec
-        float cos_T = 2.0f - theta_per_segment * theta_per_segment;
-        float sin_T = theta_per_segment * 0.16666667f * (cos_T + 4.0f);
-        cos_T *= 0.5f;
-
-        float sin_Ti;
-        float cos_Ti;
-        float r_axisi;
-        uint32_t i, count = 0;
-
-        for (i = 1; i < segments; i++) { // Increment (segments-1).
-
-            if (count < N_ARC_CORRECTION) {
-                // Apply vector rotation matrix. ~40 usec
-                r_axisi = r_axis0 * sin_T + r_axis1 * cos_T;
-                r_axis0 = r_axis0 * cos_T - r_axis1 * sin_T;
-                r_axis1 = r_axisi;
-                count++;
-            } else {
-                // Arc correction to radius vector. Computed only every N_ARC_CORRECTION increments. ~375 usec
-                // Compute exact location by applying transformation matrix from initial radius vector(=-offset).
-                cos_Ti = cosf(i * theta_per_segment);
-                sin_Ti = sinf(i * theta_per_segment);
-                r_axis0 = -offset[plane.axis_0] * cos_Ti + offset[plane.axis_1] * sin_Ti;
-                r_axis1 = -offset[plane.axis_0] * sin_Ti - offset[plane.axis_1] * cos_Ti;
-                count = 0;
+        float cos_k[ARC_BATCH_SIZE], sin_k[ARC_BATCH_SIZE];
+        float batch[ARC_BATCH_SIZE][N_AXIS];
+        float r0 = r_axis0, r1 = r_axis1, start_linear = position[plane.axis_linear];
+        uint_fast8_t k, n = segments - 1 < ARC_BATCH_SIZE ? (uint_fast8_t)(segments - 1) : ARC_BATCH_SIZE;
+        uint32_t i = 0;
+
+        // Rotation table for 1..n segments, accurate to a few ulps since n is small.
+        if(n) {
+            cos_k[0] = cosf(theta_per_segment);
+            sin_k[0] = sinf(theta_per_segment);
+            for(k = 1; k < n; k++) {
+                cos_k[k] = cos_k[k - 1] * cos_k[0] - sin_k[k - 1] * sin_k[0];
+                sin_k[k] = sin_k[k - 1] * cos_k[0] + cos_k[k - 1] * sin_k[0];
             }
+        }
 
-            // Update arc_target location
-            position[plane.axis_0] = center_axis0 + r_axis0;
-            position[plane.axis_1] = center_axis1 + r_axis1;
-            position[plane.axis_linear] += linear_per_segment;
+        for(k = 0; k < n; k++)
+            memcpy(batch[k], position, sizeof(float) * N_AXIS);
 
-            // Bail mid-circle on system abort. Runtime command check already performed by mc_line.
-            if(!mc_line(position, pl_data))
+        while(i < segments - 1) { // Generate (segments-1) end points.
+
+            if((n = segments - 1 - i) > ARC_BATCH_SIZE)
+                n = ARC_BATCH_SIZE;
+
+            for(k = 0; k < n; k++) {
+                batch[k][plane.axis_0] = center_axis0 + r0 * cos_k[k] - r1 * sin_k[k];
+                batch[k][plane.axis_1] = center_axis1 + r0 * sin_k[k] + r1 * cos_k[k];
+                batch[k][plane.axis_linear] = start_linear + (float)(i + k + 1) * linear_per_segment;
+            }
+
+            // Bail mid-circle on system abort. Runtime command check already performed by mc_lines.
+            if(!mc_lines(batch, n, pl_data))
                 return;
+
+            memcpy(position, batch[n - 1], sizeof(float) * N_AXIS);
+
+            // Exact radius vector at the start of the next batch, computed from the initial radius vector.
+            if((i += n) < segments - 1) {
+                float cos_Ti = cosf(i * theta_per_segment), sin_Ti = sinf(i * theta_per_segment);
+                r0 = r_axis0 * cos_Ti - r_axis1 * sin_Ti;
+                r1 = r_axis0 * sin_Ti + r_axis1 * cos_Ti;
+            }
         }
     }
     // Ensure last segment arrives at target location.
@@ -399,7 +671,8 @@ void mc_cubic_b_spline (float *target, plan_line_data_t *pl_data, float *positio
 
     float first[2] = { position[X_AXIS] + offset1[X_AXIS], position[Y_AXIS] + offset1[Y_AXIS] };
     float second[2] = { target[X_AXIS] + offset2[X_AXIS], target[Y_AXIS] + offset2[Y_AXIS] };
-    float bez_target[N_AXIS];
+    float bez_target[N_AXIS], batch[LINE_BATCH_SIZE][N_AXIS];
+    uint_fast16_t n = 0;
 
     memcpy(bez_target, position, sizeof(float) * N_AXIS);
 
@@ -478,10 +751,14 @@ void mc_cubic_b_spline (float *target, plan_line_data_t *pl_data, float *positio
 
         bez_target[X_AXIS] = new_pos0;
         bez_target[Y_AXIS] = new_pos1;
+        memcpy(batch[n++], bez_target, sizeof(float) * N_AXIS);
 
-        // Bail mid-spline on system abort. Runtime command check already performed by mc_line.
-        if(!mc_line(bez_target, pl_data))
-            return;
+        // Bail mid-spline on system abort. Runtime command check already performed by mc_lines.
+        if(n == LINE_BATCH_SIZE || t >= 1.0f) {
+            if(!mc_lines(batch, n, pl_data))
+                return;
+            n = 0;
+        }
     }
 }
 
@@ -598,7 +875,7 @@ void mc_thread (plan_line_data_t *pl_data, float *position, gc_thread_data *thre
     float entry_taper_length = thread->end_taper_type & Taper_Entry ? thread->end_taper_length : 0.0f;
     float exit_taper_length = thread->end_taper_type & Taper_Exit ? thread->end_taper_length : 0.0f;
     float infeed_factor = tanf(thread->infeed_angle * RADDEG);
-    float target[N_AXIS], start_z = position[Z_AXIS] + thread->depth * infeed_factor;
+    float target[N_AXIS], cut[3][N_AXIS], start_z = position[Z_AXIS] + thread->depth * infeed_factor;
 
     memcpy(target, position, sizeof(float) * N_AXIS);
 
@@ -653,29 +930,32 @@ void mc_thread (plan_line_data_t *pl_data, float *position, gc_thread_data *thre
 
         // Cut thread pass
 
+        // The cut is queued as one batch.
+        uint_fast16_t n = 0;
+
         // 1. Entry taper
         if(thread->end_taper_type & Taper_Entry) {
 
             target[X_AXIS] += thread->depth * thread->cut_direction;
             target[Z_AXIS] -= entry_taper_length;
-            if(!mc_line(target, pl_data))
-                return;
+            memcpy(cut[n++], target, sizeof(float) * N_AXIS);
         }
 
         // 2. Main part
         target[Z_AXIS] += thread_length;
-        if(!mc_line(target, pl_data))
-            return;
+        memcpy(cut[n++], target, sizeof(float) * N_AXIS);
 
         // 3. Exit taper
         if(thread->end_taper_type & Taper_Exit) {
 
             target[X_AXIS] -= thread->depth * thread->cut_direction;
             target[Z_AXIS] -= exit_taper_length;
-            if(!mc_line(target, pl_data))
-                return;
+            memcpy(cut[n++], target, sizeof(float) * N_AXIS);
         }
 
+        if(!mc_lines(cut, n, pl_data))
+            return;
+
         pl_data->condition.rapid_motion = On;           // Set rapid motion condition flag and
         pl_data->condition.spindle.synchronized = Off;  // disable spindle sync for retract & reposition
 
@@ -38,6 +38,10 @@
 // (1 minute)/feed_rate time.
 bool mc_line(float *target, plan_line_data_t *pl_data);
 
+// Execute a sequence of linear motions, targets are in the same format as for mc_line(). Queued with a
+// single plan recalculation per batch when possible.
+bool mc_lines(float (*targets)[N_AXIS], uint_fast16_t count, plan_line_data_t *pl_data);
+
 // Execute an arc in offset mode format. position == current xyz, target == target xyz,
 // offset == offset from current xyz, axis_XXX defines circle plane in tool space, axis_linear is
 // the direction of helical travel, radius == circle radius, is_clockwise_arc boolean. Used
@@ -79,4 +83,9 @@ void mc_backlash_init (void);
 void mc_sync_backlash_position (void);
 #endif
 
+#ifdef ENABLE_PATH_BLENDING
+void mc_blend_init (void);
+bool mc_blend_flush (void);
+#endif
+
 #endif
@@ -142,26 +142,29 @@ char *ftoa (float n, uint8_t decimal_places)
     return bptr;
 }
 
-// Extracts a floating point value from a string. The following code is based loosely on
-// the avr-libc strtod() function by Michael Stumpf and Dmitry Xmelkov and many freely
-// available conversion method examples, but has been highly optimized for Grbl. For known
-// CNC applications, the typical decimal value is expected to be in the range of E0 to E-4.
-// Scientific notation is officially not supported by g-code, and the 'E' character may
-// be a g-code word on some CNC systems. So, 'E' notation will not be recognized.
-// NOTE: Thanks to Radu-Eosif Mihailescu for identifying the issues with using strtod().
-bool read_float (char *line, uint_fast8_t *char_counter, float *float_ptr)
+typedef struct {
+    uint32_t intval;    // Digits read as an integer
+    int_fast8_t exp;    // Decimal exponent to apply to intval
+    bool isnegative;
+} number_t;
+
+static const uint32_t pow10_tbl[MAX_INT_DIGITS + 1] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000 };
+
+// Scans a number into an integer and a decimal exponent, only integer operations are used.
+// Returns a pointer to the character following the number or NULL if no digits were read.
+static inline char *scan_number (char *ptr, number_t *number)
 {
-    char *ptr = line + *char_counter;
-    int_fast8_t exp = 0;
     uint_fast8_t ndigit = 0, c;
-    uint32_t intval = 0;
-    bool isnegative, isdecimal = false;
+    bool isdecimal = false;
+
+    number->intval = 0;
+    number->exp = 0;
 
     // Grab first character and increment pointer. No spaces assumed in line.
     c = *ptr++;
 
     // Capture initial positive/minus character
-    if ((isnegative = (c == '-')) || c == '+')
+    if ((number->isnegative = (c == '-')) || c == '+')
         c = *ptr++;
 
     // Extract number into fast integer. Track decimal in terms of exponent value.
@@ -171,10 +174,10 @@ bool read_float (char *line, uint_fast8_t *char_counter, float *float_ptr)
             ndigit++;
             if (ndigit <= MAX_INT_DIGITS) {
                 if (isdecimal)
-                    exp--;
-                intval = (((intval << 2) + intval) << 1) + c; // intval*10 + c
+                    number->exp--;
+                number->intval = (((number->intval << 2) + number->intval) << 1) + c; // intval*10 + c
             } else if (!isdecimal)
-                exp++;  // Drop overflow digits
+                number->exp++;  // Drop overflow digits
         } else if (c == (uint_fast8_t)('.' - '0') && !isdecimal)
             isdecimal = true;
          else
@@ -183,12 +186,15 @@ bool read_float (char *line, uint_fast8_t *char_counter, float *float_ptr)
         c = *ptr++;
     }
 
-    // Return if no digits have been read.
-    if (!ndigit)
-        return false;
+    // Return NULL if no digits have been read.
+    return ndigit ? ptr - 1 : NULL;
+}
 
-    // Convert integer into floating point.
-    float fval = (float)intval;
+// Converts a scanned number to floating point.
+static inline float number_to_float (number_t *number)
+{
+    int_fast8_t exp = number->exp;
+    float fval = (float)number->intval;
 
     // Apply decimal. Should perform no more than two floating point multiplications for the
     // expected range of E0 to E-4.
@@ -204,9 +210,60 @@ bool read_float (char *line, uint_fast8_t *char_counter, float *float_ptr)
         } while (--exp > 0);
     }
 
-    // Assign floating point value with correct sign.
-    *float_ptr = isnegative ? - fval : fval;
-    *char_counter = ptr - line - 1; // Set char_counter to next statement
+    return number->isnegative ? - fval : fval;
+}
+
+// Extracts a floating point value from a string. The following code is based loosely on
+// the avr-libc strtod() function by Michael Stumpf and Dmitry Xmelkov and many freely
+// available conversion method examples, but has been highly optimized for Grbl. For known
+// CNC applications, the typical decimal value is expected to be in the range of E0 to E-4.
+// Scientific notation is officially not supported by g-code, and the 'E' character may
+// be a g-code word on some CNC systems. So, 'E' notation will not be recognized.
+// NOTE: Thanks to Radu-Eosif Mihailescu for identifying the issues with using strtod().
+bool read_float (char *line, uint_fast8_t *char_counter, float *float_ptr)
+{
+    number_t number;
+    char *ptr;
+
+    if((ptr = scan_number(line + *char_counter, &number)) == NULL)
+        return false;
+
+    *float_ptr = number_to_float(&number);
+    *char_counter = ptr - line; // Set char_counter to next statement
+
+    return true;
+}
+
+// Same as read_float(), but also returns the integer part of the value and its first two decimals
+// scaled by 100 and rounded, e.g. 38 and 20 for G38.2. These are computed from the digits read
+// without any floating point operations so are exact. For negative values the integer part is
+// returned negated (two's complement) and the decimals are those of the absolute value.
+bool read_word_value (char *line, uint_fast8_t *char_counter, float *float_ptr, uint32_t *int_ptr, uint_fast16_t *mantissa_ptr)
+{
+    number_t number;
+    uint32_t int_value;
+    uint_fast16_t mantissa = 0;
+    char *ptr;
+
+    if((ptr = scan_number(line + *char_counter, &number)) == NULL)
+        return false;
+
+    if(number.exp >= 0) {
+        int_fast8_t exp = number.exp;
+        int_value = number.intval;
+        while(exp--)
+            int_value = int_value > UINT32_MAX / 10 ? UINT32_MAX : int_value * 10;
+    } else {
+        uint32_t div = pow10_tbl[-number.exp], fraction;
+        int_value = number.intval / div;
+        fraction = number.intval - int_value * div;
+        mantissa = (uint_fast16_t)(div > 100 ? (fraction + div / 200) / (div / 100) : fraction * (100 / div));
+    }
+
+    *float_ptr = number_to_float(&number);
+    *int_ptr = number.isnegative ? - int_value : int_value;
+    *mantissa_ptr = mantissa;
+    *char_counter = ptr - line; // Set char_counter to next statement
 
     return true;
 }
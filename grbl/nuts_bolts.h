@@ -151,6 +151,10 @@ bool isintf (float value);
 // a pointer to the result variable. Returns true when it succeeds
 bool read_float(char *line, uint_fast8_t *char_counter, float *float_ptr);
 
+// Same as read_float(), int_ptr and mantissa_ptr are pointers to variables receiving the integer part
+// and the first two decimals x 100 of the value, computed exactly from the digits read.
+bool read_word_value(char *line, uint_fast8_t *char_counter, float *float_ptr, uint32_t *int_ptr, uint_fast16_t *mantissa_ptr);
+
 // Non-blocking delay function used for general operation and suspend features.
 void delay_sec(float seconds, delaymode_t mode);
 
@@ -32,6 +32,9 @@
 #ifdef KINEMATICS_API
 #include "kinematics.h"
 #endif
+#ifdef ENABLE_LATENCY_STATS
+#include "latency.h"
+#endif
 
 #ifndef MINIMUM_JUNCTION_SPEED
 #define MINIMUM_JUNCTION_SPEED 0.0f
@@ -48,6 +51,23 @@ static plan_block_t *block_buffer_planned;              // Pointer to the optima
 
 static planner_t pl;
 
+#ifdef BLOCK_BUFFER_SOA
+
+// Block fields used by planner_recalculate(), indexed by block buffer position.
+// The executing block has its entry speed copied to the block itself for the stepper.
+static struct {
+    float entry_speed_sqr[BLOCK_BUFFER_SIZE];
+    float max_entry_speed_sqr[BLOCK_BUFFER_SIZE];
+    float max_reachable_entry_speed_sqr[BLOCK_BUFFER_SIZE];
+    float delta_speed_sqr[BLOCK_BUFFER_SIZE];   // 2 * acceleration * millimeters
+} plan;
+
+#define block_index(block) ((uint_fast16_t)((block) - block_buffer))
+#define prev_index(idx) ((idx) == 0 ? BLOCK_BUFFER_SIZE - 1 : (idx) - 1)
+#define next_index(idx) ((idx) == BLOCK_BUFFER_SIZE - 1 ? 0 : (idx) + 1)
+
+#endif
+
 
 /*                            PLANNER SPEED DEFINITION
                                      +--------+   <- current->nominal_speed
@@ -114,7 +134,168 @@ static planner_t pl;
   look-ahead blocks numbering up to a hundred or more.
 
 */
-static void planner_recalculate ()
+#ifdef ENABLE_S_CURVE_ACCELERATION
+
+// Returns the distance travelled by a ramp between two speeds starting and ending at zero acceleration. The
+// acceleration is ramped up at the jerk limit to at most the acceleration limit, held there and ramped back down.
+// The ramp is symmetric so the average speed is the mean of the two speeds.
+float plan_s_curve_distance (float speed_a, float speed_b, float acceleration, float jerk)
+{
+    float delta_speed = fabsf(speed_b - speed_a), duration;
+
+    if (jerk <= 0.0f)
+        return fabsf(speed_b * speed_b - speed_a * speed_a) / (2.0f * acceleration);
+
+    if (delta_speed * jerk >= acceleration * acceleration)
+        duration = delta_speed / acceleration + acceleration / jerk;
+    else
+        duration = 2.0f * sqrtf(delta_speed / jerk);
+
+    return 0.5f * (speed_a + speed_b) * duration;
+}
+
+// Returns the square of the highest speed a ramp can reach from, or decelerate to, the speed given by speed_sqr
+// over the length of the block. The inverse of plan_s_curve_distance().
+static float plan_s_curve_reachable_speed_sqr (plan_block_t *block, float speed_sqr)
+{
+    float acceleration = block->acceleration, jerk = block->jerk;
+
+    if (jerk <= 0.0f)
+        return speed_sqr + 2.0f * acceleration * block->millimeters;
+
+    // Speed change at which the acceleration limit is reached.
+    float speed = sqrtf(speed_sqr), accel_delta_speed = acceleration * acceleration / jerk;
+
+    if (block->millimeters >= (2.0f * speed + accel_delta_speed) * acceleration / jerk) {
+        // Acceleration limited, solve mm = (v^2 - speed^2) / 2a + (speed + v) * a / 2j for the speed change v - speed.
+        // The quadratic is rationalized to avoid cancellation when the change is small compared to the speed.
+        float accel_mm = acceleration * block->millimeters;
+        speed += 4.0f * (accel_mm - speed * accel_delta_speed) /
+                  (sqrtf((2.0f * speed - accel_delta_speed) * (2.0f * speed - accel_delta_speed) + 8.0f * accel_mm) +
+                    2.0f * speed + accel_delta_speed);
+        return speed * speed;
+    }
+
+    // Jerk limited, solve mm = (2 * speed + dv) * sqrt(dv / j) for x = sqrt(dv), a cubic with a single positive root.
+    // Newton's method converges from above without overshooting.
+    uint_fast8_t iterations = 6;
+    float q = block->millimeters * sqrtf(jerk), x = cbrtf(q);
+
+    if (speed > 0.0f && q < 2.0f * speed * x)
+        x = q / (2.0f * speed);
+
+    do {
+        x -= (x * (x * x + 2.0f * speed) - q) / (3.0f * x * x + 2.0f * speed);
+    } while(--iterations);
+
+    speed += x * x;
+
+    return speed * speed;
+}
+
+  #define reachable_speed_sqr(block, speed_sqr) plan_s_curve_reachable_speed_sqr(block, speed_sqr)
+#else
+  #define reachable_speed_sqr(block, speed_sqr) ((speed_sqr) + 2.0f * (block)->acceleration * (block)->millimeters)
+#endif
+
+#ifdef BLOCK_BUFFER_SOA
+
+// Same as below, but with the block fields fetched from the arrays and the buffer walked by index.
+static void planner_recalculate (bool full)
+{
+    uint_fast16_t block = prev_index(block_index(block_buffer_head));
+    uint_fast16_t tail = block_index(block_buffer_tail), planned = block_index(block_buffer_planned), start = planned;
+
+    // Bail. Can't do anything with one only one plan-able block.
+    if (block == planned)
+        return;
+
+    // Reverse Pass
+    float entry_speed_sqr;
+    uint_fast16_t next, current = block;
+
+    // Calculate maximum entry speed for last block in buffer, where the exit speed is always zero.
+  #ifdef ENABLE_S_CURVE_ACCELERATION
+    plan.max_reachable_entry_speed_sqr[current] = min(plan.max_entry_speed_sqr[current], reachable_speed_sqr(&block_buffer[current], 0.0f));
+  #else
+    plan.max_reachable_entry_speed_sqr[current] = min(plan.max_entry_speed_sqr[current], plan.delta_speed_sqr[current]);
+  #endif
+    plan.entry_speed_sqr[current] = plan.max_reachable_entry_speed_sqr[current];
+
+    block = prev_index(block);
+    if (block == planned) { // Only two plannable blocks in buffer. Reverse pass complete.
+        // Check if the first block is the tail. If so, notify stepper to update its current parameters.
+        if (block == tail)
+            st_update_plan_block_parameters();
+    } else while (block != planned) { // Three or more plan-able blocks
+
+        next = current;
+        current = block;
+        block = prev_index(block);
+
+        // Compute maximum entry speed decelerating over the current block from its exit speed.
+      #ifdef ENABLE_S_CURVE_ACCELERATION
+        entry_speed_sqr = reachable_speed_sqr(&block_buffer[current], plan.max_reachable_entry_speed_sqr[next]);
+      #else
+        entry_speed_sqr = plan.max_reachable_entry_speed_sqr[next] + plan.delta_speed_sqr[current];
+      #endif
+        if (entry_speed_sqr > plan.max_entry_speed_sqr[current])
+            entry_speed_sqr = plan.max_entry_speed_sqr[current];
+
+        // Unchanged, the current block entry speed is already optimal. Forward plan from here.
+        if (!full && entry_speed_sqr == plan.max_reachable_entry_speed_sqr[current]) {
+            start = current;
+            break;
+        }
+
+        // Check if next block is the tail block(=planned block). If so, update current stepper parameters.
+        if (block == tail)
+            st_update_plan_block_parameters();
+
+        plan.max_reachable_entry_speed_sqr[current] = plan.entry_speed_sqr[current] = entry_speed_sqr;
+    }
+
+    // The stepper updates entry speed and remaining distance of the executing block, fetch them.
+    if (start == tail) {
+        plan.entry_speed_sqr[tail] = block_buffer_tail->entry_speed_sqr;
+        plan.delta_speed_sqr[tail] = 2.0f * block_buffer_tail->acceleration * block_buffer_tail->millimeters;
+    }
+
+    // Forward Pass
+    uint_fast16_t head = block_index(block_buffer_head);
+
+    next = start;
+    block = next_index(start);
+
+    while (block != head) {
+
+        current = next;
+        next = block;
+
+        if (plan.entry_speed_sqr[current] < plan.entry_speed_sqr[next]) {
+          #ifdef ENABLE_S_CURVE_ACCELERATION
+            entry_speed_sqr = reachable_speed_sqr(&block_buffer[current], plan.entry_speed_sqr[current]);
+          #else
+            entry_speed_sqr = plan.entry_speed_sqr[current] + plan.delta_speed_sqr[current];
+          #endif
+            if (entry_speed_sqr < plan.entry_speed_sqr[next]) {
+                plan.entry_speed_sqr[next] = entry_speed_sqr;
+                planned = block;
+            }
+        }
+
+        if (plan.entry_speed_sqr[next] == plan.max_entry_speed_sqr[next])
+            planned = block;
+
+        block = next_index(block);
+    }
+
+    block_buffer_planned = &block_buffer[planned];
+}
+
+#else
+
+static void planner_recalculate (bool full)
 {
     // Initialize block pointer to the last block in the planner buffer.
     plan_block_t *block = block_buffer_head->prev;
@@ -124,14 +305,18 @@ static void planner_recalculate ()
         return;
 
     // Reverse Pass: Coarsely maximize all possible deceleration curves back-planning from the last
-    // block in buffer. Cease planning when the last optimal planned or tail pointer is reached.
+    // block in buffer. Cease planning when the last optimal planned or tail pointer is reached, or when
+    // a block's maximum reachable entry speed is unchanged by the new block since then no block in
+    // front of it can change either.
     // NOTE: Forward pass will later refine and correct the reverse pass to create an optimal plan.
     float entry_speed_sqr;
     plan_block_t *next;
     plan_block_t *current = block;
+    plan_block_t *planned = block_buffer_planned;
 
     // Calculate maximum entry speed for last block in buffer, where the exit speed is always zero.
-    current->entry_speed_sqr = min(current->max_entry_speed_sqr, 2.0f * current->acceleration * current->millimeters);
+    current->max_reachable_entry_speed_sqr = min(current->max_entry_speed_sqr, reachable_speed_sqr(current, 0.0f));
+    current->entry_speed_sqr = current->max_reachable_entry_speed_sqr;
 
     block = block->prev;
     if (block == block_buffer_planned) { // Only two plannable blocks in buffer. Reverse pass complete.
@@ -144,21 +329,28 @@ static void planner_recalculate ()
         current = block;
         block = block->prev;
 
+        // Compute maximum entry speed decelerating over the current block from its exit speed.
+        entry_speed_sqr = reachable_speed_sqr(current, next->max_reachable_entry_speed_sqr);
+        if (entry_speed_sqr > current->max_entry_speed_sqr)
+            entry_speed_sqr = current->max_entry_speed_sqr;
+
+        // Unchanged, the current block entry speed is already optimal. Forward plan from here.
+        if (!full && entry_speed_sqr == current->max_reachable_entry_speed_sqr) {
+            planned = current;
+            break;
+        }
+
         // Check if next block is the tail block(=planned block). If so, update current stepper parameters.
         if (block == block_buffer_tail)
             st_update_plan_block_parameters();
 
-        // Compute maximum entry speed decelerating over the current block from its exit speed.
-        if (current->entry_speed_sqr != current->max_entry_speed_sqr) {
-            entry_speed_sqr = next->entry_speed_sqr + 2.0f * current->acceleration * current->millimeters;
-            current->entry_speed_sqr = entry_speed_sqr < current->max_entry_speed_sqr ? entry_speed_sqr : current->max_entry_speed_sqr;
-        }
+        current->max_reachable_entry_speed_sqr = current->entry_speed_sqr = entry_speed_sqr;
     }
 
     // Forward Pass: Forward plan the acceleration curve from the planned pointer onward.
     // Also scans for optimal plan breakpoints and appropriately updates the planned pointer.
-    next = block_buffer_planned; // Begin at buffer planned pointer
-    block = block_buffer_planned->next;
+    next = planned; // Begin at buffer planned pointer or where the reverse pass stopped
+    block = planned->next;
 
     while (block != block_buffer_head) {
 
@@ -169,7 +361,7 @@ static void planner_recalculate ()
         // pointer forward, since everything before this is all optimal. In other words, nothing
         // can improve the plan from the buffer tail to the planned pointer by logic.
         if (current->entry_speed_sqr < next->entry_speed_sqr) {
-            entry_speed_sqr = current->entry_speed_sqr + 2.0f * current->acceleration * current->millimeters;
+            entry_speed_sqr = reachable_speed_sqr(current, current->entry_speed_sqr);
         // If true, current block is full-acceleration and we can move the planned pointer forward.
             if (entry_speed_sqr < next->entry_speed_sqr) {
                 next->entry_speed_sqr = entry_speed_sqr; // Always <= max_entry_speed_sqr. Backward pass sets this.
@@ -188,6 +380,8 @@ static void planner_recalculate ()
     }
 }
 
+#endif
+
 inline static void plan_cleanup (plan_block_t *block)
 {
     if(block->message) {
@@ -226,7 +420,7 @@ void plan_reset ()
     memset(&pl, 0, sizeof(planner_t)); // Clear planner struct
 
     // Set up stepper block ringbuffer as circular doubly linked list
-    uint_fast8_t idx;
+    uint_fast16_t idx;
     for(idx = 0 ; idx <= BLOCK_BUFFER_SIZE - 1 ; idx++) {
         block_buffer[idx].prev = &block_buffer[idx == 0 ? BLOCK_BUFFER_SIZE - 1 : idx - 1];
         block_buffer[idx].next = &block_buffer[idx == BLOCK_BUFFER_SIZE - 1 ? 0 : idx + 1];
@@ -245,6 +439,11 @@ void plan_discard_current_block ()
         if (block_buffer_tail == block_buffer_planned)
             block_buffer_planned = block_buffer_tail->next;
         block_buffer_tail = block_buffer_tail->next;
+#ifdef BLOCK_BUFFER_SOA
+        // Hand the planned entry speed over to the stepper.
+        if (block_buffer_tail != block_buffer_head)
+            block_buffer_tail->entry_speed_sqr = plan.entry_speed_sqr[block_index(block_buffer_tail)];
+#endif
     }
 }
 
@@ -266,7 +465,21 @@ plan_block_t *plan_get_current_block ()
 inline float plan_get_exec_block_exit_speed_sqr ()
 {
     plan_block_t *block = block_buffer_tail->next;
+#ifdef BLOCK_BUFFER_SOA
+    return block == block_buffer_head ? 0.0f : plan.entry_speed_sqr[block_index(block)];
+#else
     return block == block_buffer_head ? 0.0f : block->entry_speed_sqr;
+#endif
+}
+
+
+float plan_get_block_entry_speed_sqr (plan_block_t *block)
+{
+#ifdef BLOCK_BUFFER_SOA
+    return plan.entry_speed_sqr[block_index(block)];
+#else
+    return block->entry_speed_sqr;
+#endif
 }
 
 
@@ -302,9 +515,14 @@ float plan_compute_profile_nominal_speed (plan_block_t *block)
 inline static float plan_compute_profile_parameters (plan_block_t *block, float nominal_speed, float prev_nominal_speed)
 {
   // Compute the junction maximum entry based on the minimum of the junction speed and neighboring nominal speeds.
-    block->max_entry_speed_sqr = nominal_speed > prev_nominal_speed ? (prev_nominal_speed * prev_nominal_speed) : (nominal_speed * nominal_speed);
-    if (block->max_entry_speed_sqr > block->max_junction_speed_sqr)
-        block->max_entry_speed_sqr = block->max_junction_speed_sqr;
+    float max_entry_speed_sqr = nominal_speed > prev_nominal_speed ? (prev_nominal_speed * prev_nominal_speed) : (nominal_speed * nominal_speed);
+    if (max_entry_speed_sqr > block->max_junction_speed_sqr)
+        max_entry_speed_sqr = block->max_junction_speed_sqr;
+#ifdef BLOCK_BUFFER_SOA
+    plan.max_entry_speed_sqr[block_index(block)] = max_entry_speed_sqr;
+#else
+    block->max_entry_speed_sqr = max_entry_speed_sqr;
+#endif
     return nominal_speed;
 }
 
@@ -334,6 +552,23 @@ static inline float limit_acceleration_by_axis_maximum (float *unit_vec)
     return limit_value;
 }
 
+#ifdef ENABLE_S_CURVE_ACCELERATION
+
+static inline float limit_jerk_by_axis_maximum (float *unit_vec)
+{
+    uint_fast8_t idx = N_AXIS;
+    float limit_value = SOME_LARGE_VALUE;
+
+    do {
+        if (unit_vec[--idx] != 0.0f)  // Avoid divide by zero.
+            limit_value = min(limit_value, fabsf(settings.axis[idx].jerk / unit_vec[idx]));
+    } while(idx);
+
+    return limit_value;
+}
+
+#endif
+
 static inline float limit_max_rate_by_axis_maximum (float *unit_vec)
 {
     uint_fast8_t idx = N_AXIS;
@@ -362,8 +597,10 @@ static inline float limit_max_rate_by_axis_maximum (float *unit_vec)
    The system motion condition tells the planner to plan a motion in the always unused block buffer
    head. It avoids changing the planner state and preserves the buffer to ensure subsequent gcode
    motions are still planned correctly, while the stepper module only points to the block buffer head
-   to execute the special system motion. */
-bool plan_buffer_line (float *target, plan_line_data_t *pl_data)
+   to execute the special system motion.
+   Returns false for zero-length motions, no block is added then. Recalculation of the plan is left
+   to the caller. */
+static bool plan_add_block (float *target, plan_line_data_t *pl_data)
 {
     // Prepare and initialize new block. Copy relevant pl_data for block execution.
     plan_block_t *block = block_buffer_head;
@@ -441,6 +678,9 @@ bool plan_buffer_line (float *target, plan_line_data_t *pl_data)
     // if they are also orthogonal/independent. Operates on the absolute value of the unit vector.
     block->millimeters = convert_delta_vector_to_unit_vector(unit_vec);
     block->acceleration = limit_acceleration_by_axis_maximum(unit_vec);
+#ifdef ENABLE_S_CURVE_ACCELERATION
+    block->jerk = limit_jerk_by_axis_maximum(unit_vec);
+#endif
     block->rapid_rate = limit_max_rate_by_axis_maximum(unit_vec);
 
     // Store programmed rate.
@@ -513,6 +753,11 @@ bool plan_buffer_line (float *target, plan_line_data_t *pl_data)
     // Block system motion from updating this data to ensure next g-code motion is computed correctly.
     if (!block->condition.system_motion) {
 
+#ifdef BLOCK_BUFFER_SOA
+        plan.entry_speed_sqr[block_index(block)] = plan.max_reachable_entry_speed_sqr[block_index(block)] = 0.0f;
+        plan.delta_speed_sqr[block_index(block)] = 2.0f * block->acceleration * block->millimeters;
+#endif
+
         pl.previous_nominal_speed = plan_compute_profile_parameters(block, plan_compute_profile_nominal_speed(block), pl.previous_nominal_speed);
 
         if(!block->condition.backlash_motion) {
@@ -523,14 +768,49 @@ bool plan_buffer_line (float *target, plan_line_data_t *pl_data)
         // New block is all set. Update buffer head and next buffer head indices.
         block_buffer_head = next_buffer_head;
         next_buffer_head = block_buffer_head->next;
-
-        // Finish up by recalculating the plan with the new block.
-        planner_recalculate();
     }
 
     return true;
 }
 
+// Add a new linear movement to the buffer, see plan_add_block() above for details.
+bool plan_buffer_line (float *target, plan_line_data_t *pl_data)
+{
+#ifdef ENABLE_LATENCY_STATS
+    uint32_t timestamp = latency_enter();
+#endif
+
+    bool ok = plan_add_block(target, pl_data);
+
+    // Finish up by recalculating the plan with the new block.
+    if(ok && !pl_data->condition.system_motion)
+        planner_recalculate(false);
+
+#ifdef ENABLE_LATENCY_STATS
+    latency_exit(Latency_PlanBufferLine, timestamp);
+#endif
+
+    return ok;
+}
+
+// Add a sequence of linear movements to the buffer and recalculate the plan once for all of them.
+// Blocks are added until the buffer is full or a target coincides with the previous position.
+// Returns the number of targets consumed, the caller should pass a coincident target to plan_buffer_line()
+// when the buffer is not full. Not for system motions.
+uint_fast16_t plan_buffer_lines (float (*targets)[N_AXIS], uint_fast16_t count, plan_line_data_t *pl_data)
+{
+    uint_fast16_t queued = 0;
+
+    while(queued < count && !plan_check_full_buffer() && plan_add_block(targets[queued], pl_data))
+        queued++;
+
+    // With more than one new block the reverse pass cannot stop early, it must reach the first of them.
+    if(queued)
+        planner_recalculate(queued > 1);
+
+    return queued;
+}
+
 
 // Reset the planner position vectors. Called by the system abort/initialization routine.
 void plan_sync_position ()
@@ -540,9 +820,9 @@ void plan_sync_position ()
 
 
 // Returns the number of available blocks are in the planner buffer.
-uint8_t plan_get_block_buffer_available ()
+uint_fast16_t plan_get_block_buffer_available ()
 {
-    return (uint8_t)(block_buffer_head >= block_buffer_tail
+    return (uint_fast16_t)(block_buffer_head >= block_buffer_tail
                       ? ((BLOCK_BUFFER_SIZE - 1) - (block_buffer_head - block_buffer_tail))
                       : ((block_buffer_tail - block_buffer_head) - 1));
 }
@@ -555,7 +835,7 @@ void plan_cycle_reinitialize ()
     // Re-plan from a complete stop. Reset planner entry speeds and buffer planned pointer.
     st_update_plan_block_parameters();
     block_buffer_planned = block_buffer_tail;
-    planner_recalculate();
+    planner_recalculate(true);
 }
 
 // Set feed overrides
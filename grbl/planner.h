@@ -29,6 +29,10 @@
   #define BLOCK_BUFFER_SIZE 36
 #endif
 
+#ifdef S_CURVE_ACCELERATION_FACTOR
+  #error "S_CURVE_ACCELERATION_FACTOR is no longer supported, jerk limited ramps are planned with the full acceleration settings."
+#endif
+
 typedef union {
     uint32_t value;
     struct {
@@ -64,9 +68,17 @@ typedef struct plan_block {
     // Fields used by the motion planner to manage acceleration. Some of these values may be updated
     // by the stepper module during execution of special motion cases for replanning purposes.
     float entry_speed_sqr;      // The current planned entry speed at block junction in (mm/min)^2
+                                // NOTE: With BLOCK_BUFFER_SOA only valid for the block being executed.
+#ifndef BLOCK_BUFFER_SOA
     float max_entry_speed_sqr;  // Maximum allowable entry speed based on the minimum of junction limit and
                                 // neighboring nominal speeds with overrides in (mm/min)^2
+    float max_reachable_entry_speed_sqr; // Maximum entry speed from which a stop at the end of the buffer can be
+                                         // reached, cached by the reverse pass in (mm/min)^2
+#endif
     float acceleration;         // Axis-limit adjusted line acceleration in (mm/min^2). Does not change.
+#ifdef ENABLE_S_CURVE_ACCELERATION
+    float jerk;                 // Axis-limit adjusted line jerk in (mm/min^3). Does not change.
+#endif
     float millimeters;          // The remaining distance for this block to be executed in (mm).
                                 // NOTE: This value may be altered by stepper algorithm during execution.
 
@@ -91,6 +103,9 @@ typedef struct {
     planner_cond_t condition;       // Bitfield variable to indicate planner conditions. See defines above.
     gc_override_flags_t overrides;  // Block bitfield variable for overrides
     int32_t line_number;            // Desired line number to report when executing.
+#ifdef ENABLE_PATH_BLENDING
+    float path_tolerance;           // G64 P blending tolerance (mm), 0.0 for exact path. Used by mc_line() only.
+#endif
 //    void *parameters;               // TODO: pointer to extra parameters, for canned cycles and threading?
     char *message;                  // Message to be displayed when block is executed.
     output_command_t *output_commands;
@@ -115,6 +130,10 @@ void plan_reset(); // Reset all
 // rate is taken to mean "frequency" and would complete the operation in 1/feed_rate minutes.
 bool plan_buffer_line(float *target, plan_line_data_t *pl_data);
 
+// Add a sequence of linear movements to the buffer with a single plan recalculation. Stops when the buffer
+// is full or at a target coincident with the previous one. Returns the number of targets consumed.
+uint_fast16_t plan_buffer_lines(float (*targets)[N_AXIS], uint_fast16_t count, plan_line_data_t *pl_data);
+
 // Called when the current block is no longer needed. Discards the block and makes the memory
 // availible for new blocks.
 void plan_discard_current_block();
@@ -128,9 +147,18 @@ plan_block_t *plan_get_current_block();
 // Called by step segment buffer when computing executing block velocity profile.
 float plan_get_exec_block_exit_speed_sqr();
 
+// Returns the planned entry speed (sqr) of a queued block.
+float plan_get_block_entry_speed_sqr (plan_block_t *block);
+
 // Called by main program during planner calculations and step segment buffer during initialization.
 float plan_compute_profile_nominal_speed(plan_block_t *block);
 
+#ifdef ENABLE_S_CURVE_ACCELERATION
+// Returns the distance (mm) travelled by a jerk limited ramp between two speeds, used by the planner and the
+// step segment buffer for the velocity profile.
+float plan_s_curve_distance (float speed_a, float speed_b, float acceleration, float jerk);
+#endif
+
 // Re-calculates buffered motions profile parameters upon a motion-based override change.
 void plan_update_velocity_profile_parameters();
 
@@ -141,7 +169,7 @@ void plan_sync_position();
 void plan_cycle_reinitialize();
 
 // Returns the number of available blocks in the planner buffer.
-uint8_t plan_get_block_buffer_available();
+uint_fast16_t plan_get_block_buffer_available();
 
 // Returns the status of the block ring buffer. True, if buffer is full.
 bool plan_check_full_buffer();
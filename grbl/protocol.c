@@ -32,6 +32,21 @@
 #include "motion_control.h"
 #include "sleep.h"
 #include "protocol.h"
+#ifdef ENABLE_BINARY_PROTOCOL
+#include "binary_protocol.h"
+#endif
+#ifdef ENABLE_CREDIT_FLOW_CONTROL
+#include "flow_control.h"
+#endif
+#ifdef ENABLE_STREAM_MUX
+#include "stream_mux.h"
+#endif
+#ifdef ENABLE_LATENCY_STATS
+#include "latency.h"
+#endif
+#ifdef ENABLE_STARVATION_STATS
+#include "starvation.h"
+#endif
 
 #ifndef RT_QUEUE_SIZE
 #define RT_QUEUE_SIZE 8 // must be a power of 2
@@ -46,7 +61,8 @@ typedef union {
                 comment_semicolon   :1,
                 line_is_comment     :1,
                 block_delete        :1,
-                unassigned          :3;
+                binary_frame        :1,
+                unassigned          :2;
     };
 } line_flags_t;
 
@@ -65,6 +81,9 @@ typedef struct {
 
 static uint_fast16_t char_counter = 0;
 static char line[LINE_BUFFER_SIZE]; // Line to be executed. Zero-terminated.
+static char eol = '\0';
+static line_flags_t line_flags = {0};
+static bool nocaps = false;
 static char xcommand[LINE_BUFFER_SIZE];
 static bool keep_rt_commands = false;
 static user_message_t user_message = {NULL, 0, 0, false};
@@ -90,6 +109,193 @@ bool protocol_enqueue_gcode (char *gcode)
     return ok;
 }
 
+// Adds a character of incoming stream data to the line being assembled. Performs an initial
+// filtering by removing spaces and comments and capitalizing all letters.
+// Returns true when end of line is reached and the line is ready for execution.
+static inline bool line_add_char (int16_t c)
+{
+    if(c == ASCII_CAN) {
+
+        eol = xcommand[0] = '\0';
+        keep_rt_commands = nocaps = user_message.show = false;
+        char_counter = line_flags.value = 0;
+        gc_state.last_error = Status_OK;
+
+        if (sys.state == STATE_JOG) // Block all other states from invoking motion cancel.
+            system_set_exec_state_flag(EXEC_MOTION_CANCEL);
+
+    } else if ((c == '\n') || (c == '\r')) { // End of line reached
+
+        // Check for possible secondary end of line character, do not process as empty line
+        // if part of crlf (or lfcr pair) as this produces a possibly unwanted double response
+        if(char_counter == 0 && eol && eol != c) {
+            eol = '\0';
+            return false;
+        }
+
+        eol = (char)c;
+
+        return true;
+
+#ifdef ENABLE_BINARY_PROTOCOL
+    } else if(line_flags.binary_frame) {
+        // Frame data is kept as is, it is decoded on execution.
+        if(!(line_flags.overflow = char_counter >= (LINE_BUFFER_SIZE - 1)))
+            line[char_counter++] = c;
+    } else if(c == ASCII_STX && char_counter == 0 && binary_protocol_enabled()) {
+        line_flags.binary_frame = On;
+#endif
+    } else if (c <= (nocaps ? ' ' - 1 : ' ') || line_flags.value) {
+        // Throw away all whitepace, control characters, comment characters and overflow characters.
+        if(c >= ' ' && line_flags.comment_parentheses) {
+            if(user_message.tracker == 5)
+                user_message.message[user_message.idx++] = c == ')' ? '\0' : c;
+            else if(user_message.tracker > 0 && CAPS(c) == msg[user_message.tracker])
+                user_message.tracker++;
+            else
+                user_message.tracker = 0;
+            if (c == ')') {
+                // End of '()' comment. Resume line.
+                line_flags.comment_parentheses = Off;
+                keep_rt_commands = false;
+                user_message.show = user_message.show || user_message.tracker == 5;
+            }
+        }
+    } else {
+        switch(c) {
+
+            case '/':
+                if(char_counter == 0)
+                    line_flags.block_delete = sys.flags.block_delete_enabled;
+                break;
+
+            case '$':
+            case '[':
+                // Do not uppercase system or user commands - will destroy passwords etc...
+                if(char_counter == 0)
+                    nocaps = keep_rt_commands = true;
+                break;
+
+            case '(':
+                if(char_counter == 0)
+                    line_flags.line_is_comment = On;
+                if(!keep_rt_commands) {
+                    // Enable comments flag and ignore all characters until ')' or EOL unless it is a message.
+                    // NOTE: This doesn't follow the NIST definition exactly, but is good enough for now.
+                    // In the future, we could simply remove the items within the comments, but retain the
+                    // comment control characters, so that the g-code parser can error-check it.
+                    if((line_flags.comment_parentheses = !line_flags.comment_semicolon)) {
+                        if(!hal.driver_cap.no_gcode_message_handling) {
+                            if(user_message.message == NULL)
+                                user_message.message = malloc(LINE_BUFFER_SIZE);
+                            if(user_message.message) {
+                                user_message.idx = 0;
+                                user_message.tracker = 1;
+                            }
+                        }
+                        keep_rt_commands = true;
+                    }
+                }
+                break;
+
+            case ';':
+                if(char_counter == 0)
+                    line_flags.line_is_comment = On;
+                // NOTE: ';' comment to EOL is a LinuxCNC definition. Not NIST.
+                if(!keep_rt_commands) {
+                    if((line_flags.comment_semicolon = !line_flags.comment_parentheses))
+                        keep_rt_commands = true;
+                }
+                break;
+        }
+        if (line_flags.value == 0 && !(line_flags.overflow = char_counter >= (LINE_BUFFER_SIZE - 1)))
+            line[char_counter++] = nocaps ? c : CAPS(c);
+    }
+
+    return false;
+}
+
+// Reports the status of execution of a line.
+static inline void line_report_status (status_code_t status)
+{
+#ifdef ENABLE_CREDIT_FLOW_CONTROL
+    if(!flow_control_report(status))
+#endif
+    grbl.report.status_message(status);
+}
+
+// Executes the assembled line and reports the status of execution.
+// Returns false on system abort.
+static bool line_execute (void)
+{
+    if(!protocol_execute_realtime()) // Runtime command check point.
+        return false;
+
+#ifdef ENABLE_BINARY_PROTOCOL
+    if(line_flags.binary_frame || binary_protocol_resync()) {
+        if(line_flags.binary_frame)
+            binary_protocol_execute(line, line_flags.overflow ? 0 : char_counter);
+        else // Discard lines until the frame expected is resent.
+            line_report_status(Status_FrameSequenceError);
+        keep_rt_commands = nocaps = user_message.show = false;
+        char_counter = line_flags.value = 0;
+        return true;
+    }
+
+    binary_protocol_flush_acks(); // Keep responses in order.
+#endif
+
+    line[char_counter] = '\0'; // Set string termination character.
+
+  #ifdef REPORT_ECHO_LINE_RECEIVED
+    report_echo_line_received(line);
+  #endif
+
+    // Direct and execute one line of formatted input, and report status of execution.
+    if (line_flags.overflow) // Report line overflow error.
+        gc_state.last_error = Status_Overflow;
+    else if ((line[0] == '\0' || char_counter == 0) && !user_message.show && !line_flags.line_is_comment) // Empty or comment line. For syncing purposes.
+        gc_state.last_error = Status_OK;
+    else if (line[0] == '$') {// Grbl '$' system command
+      #ifdef ENABLE_PATH_BLENDING
+        mc_blend_flush(); // System commands may depend on the machine position.
+      #endif
+        if((gc_state.last_error = system_execute_line(line)) == Status_LimitsEngaged) {
+            set_state(STATE_ALARM); // Ensure alarm state is active.
+            report_alarm_message(Alarm_LimitsEngaged);
+            grbl.report.feedback_message(Message_CheckLimits);
+        }
+    } else if (line[0] == '[' && grbl.on_user_command)
+        gc_state.last_error = grbl.on_user_command(line);
+    else if (sys.state & (STATE_ALARM|STATE_ESTOP|STATE_JOG)) // Everything else is gcode. Block if in alarm, eStop or jog mode.
+        gc_state.last_error = Status_SystemGClock;
+#if COMPATIBILITY_LEVEL == 0
+    else if(gc_state.last_error == Status_OK || gc_state.last_error == Status_GcodeToolChangePending) { // Parse and execute g-code block.
+#else
+    else { // Parse and execute g-code block.
+
+#endif
+        gc_state.last_error = gc_execute_block(line, user_message.show ? user_message.message : NULL);
+    }
+
+    // Add a short delay for each block processed in Check Mode to
+    // avoid overwhelming the sender with fast reply messages.
+    // This is likely to happen when streaming is done via a protocol where
+    // the speed is not limited to 115200 baud. An example is native USB streaming.
+#if CHECK_MODE_DELAY
+    if(sys.state == STATE_CHECK_MODE)
+        hal.delay_ms(CHECK_MODE_DELAY, NULL);
+#endif
+
+    line_report_status(gc_state.last_error);
+
+    // Reset tracking data for next line.
+    keep_rt_commands = nocaps = user_message.show = false;
+    char_counter = line_flags.value = 0;
+
+    return true;
+}
+
 /*
   GRBL PRIMARY LOOP:
 */
@@ -152,158 +358,68 @@ bool protocol_main_loop(bool cold_start)
     // ---------------------------------------------------------------------------------
 
     int16_t c;
-    char eol = '\0';
-    line_flags_t line_flags = {0};
-    bool nocaps = false;
 
-    xcommand[0] = '\0';
-    user_message.show = keep_rt_commands = false;
+    eol = xcommand[0] = '\0';
+    line_flags.value = 0;
+    user_message.show = keep_rt_commands = nocaps = false;
+#ifdef ENABLE_BINARY_PROTOCOL
+    binary_protocol_reset();
+#endif
+#ifdef ENABLE_CREDIT_FLOW_CONTROL
+    flow_control_reset();
+#endif
+#ifdef ENABLE_AUTO_REPORT
+    report_auto_reset();
+#endif
 
     while(true) {
 
         // Process one line of incoming stream data, as the data becomes available. Performs an
         // initial filtering by removing spaces and comments and capitalizing all letters.
-        while((c = hal.stream.read()) != SERIAL_NO_DATA) {
-
-            if(c == ASCII_CAN) {
-
-                eol = xcommand[0] = '\0';
-                keep_rt_commands = nocaps = user_message.show = false;
-                char_counter = line_flags.value = 0;
-                gc_state.last_error = Status_OK;
-
-                if (sys.state == STATE_JOG) // Block all other states from invoking motion cancel.
-                    system_set_exec_state_flag(EXEC_MOTION_CANCEL);
-
-            } else if ((c == '\n') || (c == '\r')) { // End of line reached
-
-                // Check for possible secondary end of line character, do not process as empty line
-                // if part of crlf (or lfcr pair) as this produces a possibly unwanted double response
-                if(char_counter == 0 && eol && eol != c) {
-                    eol = '\0';
-                    continue;
-                } else
-                    eol = (char)c;
-
-                if(!protocol_execute_realtime()) // Runtime command check point.
-                    return !sys.flags.exit;      // Bail to calling function upon system abort
-
-                line[char_counter] = '\0'; // Set string termination character.
-
-              #ifdef REPORT_ECHO_LINE_RECEIVED
-                report_echo_line_received(line);
-              #endif
-
-                // Direct and execute one line of formatted input, and report status of execution.
-                if (line_flags.overflow) // Report line overflow error.
-                    gc_state.last_error = Status_Overflow;
-                else if ((line[0] == '\0' || char_counter == 0) && !user_message.show && !line_flags.line_is_comment) // Empty or comment line. For syncing purposes.
-                    gc_state.last_error = Status_OK;
-                else if (line[0] == '$') {// Grbl '$' system command
-                    if((gc_state.last_error = system_execute_line(line)) == Status_LimitsEngaged) {
-                        set_state(STATE_ALARM); // Ensure alarm state is active.
-                        report_alarm_message(Alarm_LimitsEngaged);
-                        grbl.report.feedback_message(Message_CheckLimits);
-                    }
-                } else if (line[0] == '[' && grbl.on_user_command)
-                    gc_state.last_error = grbl.on_user_command(line);
-                else if (sys.state & (STATE_ALARM|STATE_ESTOP|STATE_JOG)) // Everything else is gcode. Block if in alarm, eStop or jog mode.
-                    gc_state.last_error = Status_SystemGClock;
-#if COMPATIBILITY_LEVEL == 0
-                else if(gc_state.last_error == Status_OK || gc_state.last_error == Status_GcodeToolChangePending) { // Parse and execute g-code block.
-#else
-                else { // Parse and execute g-code block.
+        if(hal.stream.read_span) {
 
-#endif
-                    gc_state.last_error = gc_execute_block(line, user_message.show ? user_message.message : NULL);
-                }
+            // Stream provides contiguous spans of received data, filter them in a tight loop.
+            // Data up to and including an end of line is released before the line is executed.
+            // NOTE: The line executed may redirect input, the span pointer is checked for each span.
+            char *span;
+            uint_fast16_t length, consumed = 0;
+            bool eol_reached;
 
-                // Add a short delay for each block processed in Check Mode to
-                // avoid overwhelming the sender with fast reply messages.
-                // This is likely to happen when streaming is done via a protocol where
-                // the speed is not limited to 115200 baud. An example is native USB streaming.
-#if CHECK_MODE_DELAY
-                if(sys.state == STATE_CHECK_MODE)
-                    hal.delay_ms(CHECK_MODE_DELAY, NULL);
-#endif
+            while(hal.stream.read_span && (length = hal.stream.read_span(&span, consumed))) {
 
-                grbl.report.status_message(gc_state.last_error);
-
-                // Reset tracking data for next line.
-                keep_rt_commands = nocaps = user_message.show = false;
-                char_counter = line_flags.value = 0;
-
-            } else if (c <= (nocaps ? ' ' - 1 : ' ') || line_flags.value) {
-                // Throw away all whitepace, control characters, comment characters and overflow characters.
-                if(c >= ' ' && line_flags.comment_parentheses) {
-                    if(user_message.tracker == 5)
-                        user_message.message[user_message.idx++] = c == ')' ? '\0' : c;
-                    else if(user_message.tracker > 0 && CAPS(c) == msg[user_message.tracker])
-                        user_message.tracker++;
-                    else
-                        user_message.tracker = 0;
-                    if (c == ')') {
-                        // End of '()' comment. Resume line.
-                        line_flags.comment_parentheses = Off;
-                        keep_rt_commands = false;
-                        user_message.show = user_message.show || user_message.tracker == 5;
-                    }
-                }
-            } else {
-                switch(c) {
+                consumed = 0;
 
-                    case '/':
-                        if(char_counter == 0)
-                            line_flags.block_delete = sys.flags.block_delete_enabled;
-                        break;
+                do {
+                    eol_reached = line_add_char((uint8_t)span[consumed++]);
+                } while(!eol_reached && consumed < length);
 
-                    case '$':
-                    case '[':
-                        // Do not uppercase system or user commands - will destroy passwords etc...
-                        if(char_counter == 0)
-                            nocaps = keep_rt_commands = true;
-                        break;
-
-                    case '(':
-                        if(char_counter == 0)
-                            line_flags.line_is_comment = On;
-                        if(!keep_rt_commands) {
-                            // Enable comments flag and ignore all characters until ')' or EOL unless it is a message.
-                            // NOTE: This doesn't follow the NIST definition exactly, but is good enough for now.
-                            // In the future, we could simply remove the items within the comments, but retain the
-                            // comment control characters, so that the g-code parser can error-check it.
-                            if((line_flags.comment_parentheses = !line_flags.comment_semicolon)) {
-                                if(!hal.driver_cap.no_gcode_message_handling) {
-                                    if(user_message.message == NULL)
-                                        user_message.message = malloc(LINE_BUFFER_SIZE);
-                                    if(user_message.message) {
-                                        user_message.idx = 0;
-                                        user_message.tracker = 1;
-                                    }
-                                }
-                                keep_rt_commands = true;
-                            }
-                        }
-                        break;
-
-                    case ';':
-                        if(char_counter == 0)
-                            line_flags.line_is_comment = On;
-                        // NOTE: ';' comment to EOL is a LinuxCNC definition. Not NIST.
-                        if(!keep_rt_commands) {
-                            if((line_flags.comment_semicolon = !line_flags.comment_parentheses))
-                                keep_rt_commands = true;
-                        }
-                        break;
+                if(eol_reached) {
+                    hal.stream.read_span(&span, consumed);
+                    consumed = 0;
+                    if(!line_execute())
+                        return !sys.flags.exit; // Bail to calling function upon system abort
                 }
-                if (line_flags.value == 0 && !(line_flags.overflow = char_counter >= (LINE_BUFFER_SIZE - 1)))
-                    line[char_counter++] = nocaps ? c : CAPS(c);
             }
+
+        } else while((c = hal.stream.read()) != SERIAL_NO_DATA) {
+            if(line_add_char(c) && !line_execute())
+                return !sys.flags.exit; // Bail to calling function upon system abort
         }
 
+      #ifdef ENABLE_BINARY_PROTOCOL
+        binary_protocol_flush_acks(); // Input stream is empty, acknowledge frames executed.
+      #endif
+      #ifdef ENABLE_CREDIT_FLOW_CONTROL
+        flow_control_poll(); // Input stream is empty, acknowledge lines executed and advertise credits.
+      #endif
+
         // Handle extra command (internal stream)
         if(xcommand[0] != '\0') {
 
+          #ifdef ENABLE_PATH_BLENDING
+            mc_blend_flush();
+          #endif
+
             if (xcommand[0] == '$') // Grbl '$' system command
                 system_execute_line(xcommand);
             else if (sys.state & (STATE_ALARM|STATE_ESTOP|STATE_JOG)) // Everything else is gcode. Block if in alarm, eStop or jog state.
@@ -317,6 +433,11 @@ bool protocol_main_loop(bool cold_start)
         // If there are no more characters in the input stream buffer to be processed and executed,
         // this indicates that g-code streaming has either filled the planner buffer or has
         // completed. In either case, auto-cycle start, if enabled, any queued moves.
+      #ifdef ENABLE_PATH_BLENDING
+        // Queue any motion held back for path blending before the planner runs dry.
+        if(plan_get_block_buffer_available() >= BLOCK_BUFFER_SIZE - 2)
+            mc_blend_flush();
+      #endif
         protocol_auto_cycle_start();
 
         if(!protocol_execute_realtime() && sys.abort) // Runtime command check point.
@@ -336,10 +457,17 @@ bool protocol_main_loop(bool cold_start)
 bool protocol_buffer_synchronize ()
 {
     bool ok = true;
+  #ifdef ENABLE_PATH_BLENDING
+    mc_blend_flush(); // Queue any motion held back for path blending.
+  #endif
     // If system is queued, ensure cycle resumes if the auto start flag is present.
     protocol_auto_cycle_start();
     while ((ok = protocol_execute_realtime()) && (plan_get_current_block() || sys.state == STATE_CYCLE));
 
+  #ifdef ENABLE_STARVATION_STATS
+    starvation_discard(); // The planner was emptied on purpose.
+  #endif
+
     return ok;
 }
 
@@ -371,6 +499,10 @@ void protocol_auto_cycle_start ()
 // Returns false if aborted
 bool protocol_execute_realtime ()
 {
+#ifdef ENABLE_LATENCY_STATS
+    uint32_t timestamp = latency_enter();
+#endif
+
     if(protocol_exec_rt_system()) {
 
         if (sys.suspend)
@@ -382,6 +514,10 @@ bool protocol_execute_realtime ()
       #endif
     }
 
+#ifdef ENABLE_LATENCY_STATS
+    latency_exit(Latency_ExecuteRealtime, timestamp);
+#endif
+
     return !ABORTED;
 }
 
@@ -514,6 +650,13 @@ bool protocol_exec_rt_system ()
             update_state(rt_exec);
     }
 
+#ifdef ENABLE_AUTO_REPORT
+    report_auto_poll();
+#endif
+#ifdef ENABLE_STREAM_MUX
+    stream_mux_poll();
+#endif
+
     grbl.on_execute_realtime(sys.state);
 
     if(!sys.flags.delay_overrides) {
@@ -692,6 +835,9 @@ ISR_CODE bool protocol_enqueue_realtime_command (char c)
 
     switch ((unsigned char)c) {
 
+#ifdef ENABLE_BINARY_PROTOCOL
+        case ASCII_STX: // Binary protocol frame start, passed on to the input stream
+#endif
         case '\n':
         case '\r':
             break;
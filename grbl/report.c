@@ -28,12 +28,16 @@
   methods to accomodate their needs.
 */
 
+#include <math.h>
 #include <stdarg.h>
 #include <string.h>
 
 #include "hal.h"
 #include "report.h"
 #include "nvs_buffer.h"
+#ifdef ENABLE_STARVATION_STATS
+#include "starvation.h"
+#endif
 
 #ifdef ENABLE_SPINDLE_LINEARIZATION
 #include <stdio.h>
@@ -417,6 +421,10 @@ void report_grbl_settings (bool all)
     report_uint_setting(Setting_LimitPinsInvertMask, settings.limits.invert.mask);
     if(hal.probe.configure)
         report_uint_setting(Setting_InvertProbePin, settings.probe.invert_probe_pin);
+#ifdef ENABLE_ADAPTIVE_SEGMENTS
+    report_uint_setting(Setting_StepperSegments, settings.steppers.segments);
+    report_float_setting(Setting_StepperSegmentTime, settings.steppers.segment_time, 1);
+#endif
     if(all)
         report_uint_setting(Setting_StatusReportMask, (uint32_t)settings.status_report.mask);
     else
@@ -560,6 +568,12 @@ void report_grbl_settings (bool all)
                     break;
 #endif
 
+#ifdef ENABLE_S_CURVE_ACCELERATION
+                case AxisSetting_Jerk:
+                    report_float_setting((setting_type_t)(val + idx), settings.axis[idx].jerk / (60.0f * 60.0f * 60.0f), N_DECIMAL_SETTINGVALUE);
+                    break;
+#endif
+
                 default:
                     if(hal.driver_settings.axis_report)
                         hal.driver_settings.axis_report((axis_setting_type_t)set_idx, idx);
@@ -783,6 +797,10 @@ void report_gcode_modes (void)
     hal.stream.write(" G");
     hal.stream.write(uitoa((uint32_t)(94 - gc_state.modal.feed_mode)));
 
+#ifdef ENABLE_PATH_BLENDING
+    hal.stream.write(gc_state.modal.control == ControlMode_Continuous ? " G64" : " G61");
+#endif
+
     if(settings.mode == Mode_Lathe && hal.driver_cap.variable_spindle)
         hal.stream.write(gc_state.modal.spindle_rpm_mode == SpindleSpeedMode_RPM ? " G97" : " G96");
 
@@ -1087,6 +1105,331 @@ void report_echo_line_received (char *line)
 }
 
 
+ // Realtime status report builder. The report is formatted into a preallocated buffer and emitted with a single
+ // stream write, formatted axis values are cached and reused when unchanged.
+
+#ifndef REPORT_BUFFER_SIZE
+#define REPORT_BUFFER_SIZE (2 * (STRLEN_COORDVALUE + 1) * N_AXIS + 160)
+#endif
+
+typedef struct {
+    char *s;                        // Append pointer
+    bool flushed;                   // Set when the buffer was flushed before the report was complete
+    char data[REPORT_BUFFER_SIZE];
+} report_buffer_t;
+
+typedef struct {
+    bool valid;
+    bool inches;
+    bool diameter_mode;
+    float values[N_AXIS];
+    uint_fast8_t length;
+    char text[(STRLEN_COORDVALUE + 1) * N_AXIS];
+} axis_values_cache_t;
+
+static report_buffer_t report_buf;
+static axis_values_cache_t position_cache, wco_cache;
+static const uint32_t fixed_scale[] = { 1, 10, 100, 1000, 10000 };
+
+static void report_flush (void)
+{
+    if(report_buf.s != report_buf.data) {
+        *report_buf.s = '\0';
+        hal.stream.write_all(report_buf.data);
+        report_buf.s = report_buf.data;
+    }
+}
+
+// Ensures space for length characters and a terminating null, flushes the buffer if not.
+static inline void report_reserve (size_t length)
+{
+    if(report_buf.s + length >= &report_buf.data[REPORT_BUFFER_SIZE]) {
+        report_flush();
+        report_buf.flushed = true;
+    }
+}
+
+// Appends a string, also passed to on_realtime_report handlers as the stream write function.
+static void report_append (const char *s)
+{
+    size_t length = strlen(s);
+
+    report_reserve(length);
+
+    if(length >= REPORT_BUFFER_SIZE)
+        hal.stream.write_all(s);
+    else {
+        memcpy(report_buf.s, s, length);
+        report_buf.s += length;
+    }
+}
+
+static void report_append_uint (uint32_t n)
+{
+    char digits[10], *d = &digits[sizeof(digits)];
+
+    report_reserve(sizeof(digits));
+
+    do {
+        *--d = '0' + (n % 10);
+    } while(n /= 10);
+
+    memcpy(report_buf.s, d, &digits[sizeof(digits)] - d);
+    report_buf.s += &digits[sizeof(digits)] - d;
+}
+
+// Appends a float value with decimals (max 4) decimal places, the value is rounded in fixed point.
+static void report_append_fixed (float n, uint_fast8_t decimals)
+{
+    char digits[STRLEN_COORDVALUE + 2], *d = &digits[sizeof(digits)];
+    uint32_t a, b;
+
+    report_reserve(sizeof(digits));
+
+    if(n < 0.0f) {
+        *report_buf.s++ = '-';
+        n = -n;
+    }
+
+    a = (uint32_t)n;
+    if((b = (uint32_t)((n - (float)a) * (float)fixed_scale[decimals] + 0.5f)) >= fixed_scale[decimals]) {
+        b -= fixed_scale[decimals];
+        a++;
+    }
+
+    while(decimals--) {
+        *--d = '0' + (b % 10);
+        b /= 10;
+    }
+
+    *--d = '.';
+
+    do {
+        *--d = '0' + (a % 10);
+    } while(a /= 10);
+
+    memcpy(report_buf.s, d, &digits[sizeof(digits)] - d);
+    report_buf.s += &digits[sizeof(digits)] - d;
+}
+
+// Appends comma separated axis values, the formatted text is reused when values and units are unchanged.
+static void report_append_axis_values (axis_values_cache_t *cache, float *values)
+{
+    bool inches = settings.flags.report_inches, diameter_mode = gc_state.modal.diameter_mode;
+
+    report_reserve(sizeof(cache->text) + N_AXIS);
+
+    if(!(cache->valid && cache->inches == inches && cache->diameter_mode == diameter_mode &&
+          !memcmp(cache->values, values, sizeof(cache->values)))) {
+
+        uint_fast8_t idx;
+        char *start = report_buf.s;
+
+        for(idx = 0; idx < N_AXIS; idx++) {
+            float value = idx == X_AXIS && diameter_mode ? values[idx] * 2.0f : values[idx];
+            if(inches)
+                report_append_fixed(value * INCH_PER_MM, N_DECIMAL_COORDVALUE_INCH);
+            else
+                report_append_fixed(value, N_DECIMAL_COORDVALUE_MM);
+            if(idx < (N_AXIS - 1))
+                *report_buf.s++ = ',';
+        }
+
+        cache->valid = true;
+        cache->inches = inches;
+        cache->diameter_mode = diameter_mode;
+        memcpy(cache->values, values, sizeof(cache->values));
+        memcpy(cache->text, start, cache->length = report_buf.s - start);
+    } else {
+        memcpy(report_buf.s, cache->text, cache->length);
+        report_buf.s += cache->length;
+    }
+}
+
+static inline void report_append_rate (float value)
+{
+    report_append_uint((uint32_t)(settings.flags.report_inches ? value * INCH_PER_MM : value));
+}
+
+#ifdef ENABLE_AUTO_REPORT
+
+#define AUTO_REPORT_FIELDS_SIZE (REPORT_BUFFER_SIZE + 32)
+
+typedef struct {
+    bool enabled;
+    bool pushing;                           // Set while a pushed report is built
+    bool baseline;                          // Set when fields holds the content of previous pushed reports
+    stream_type_t stream;
+    uint_fast16_t state;
+    uint32_t interval;
+    uint32_t ms;
+    float deadband;
+    float position[N_AXIS];
+    char fields[AUTO_REPORT_FIELDS_SIZE];   // Last value of all fields sent, "|<key>:<value>..."
+} auto_report_t;
+
+static auto_report_t auto_report = {0};
+
+// Fields left out of reports when they have no value, sent with an empty value when dropped.
+static const char *const presence_fields = "|Pn|Ln|";
+
+static inline size_t field_length (const char *field)
+{
+    const char *end = strchr(field + 1, '|');
+
+    return end ? (size_t)(end - field) : strlen(field);
+}
+
+static inline size_t key_length (const char *field, size_t length)
+{
+    const char *colon = memchr(field, ':', length);
+
+    return colon ? (size_t)(colon - field) : length;
+}
+
+// Returns a pointer to the field with the key of field in fields, NULL if not found.
+static const char *find_field (const char *fields, const char *field, size_t length)
+{
+    while((fields = strchr(fields, '|'))) {
+        if(!strncmp(fields, field, length) && (fields[length] == ':' || fields[length] == '|' || fields[length] == '\0'))
+            return fields;
+        fields++;
+    }
+
+    return NULL;
+}
+
+// Removes fields unchanged since the previous pushed report from the report in the buffer.
+static void report_delta (void)
+{
+    static char current[AUTO_REPORT_FIELDS_SIZE];
+
+    size_t length, klength;
+    const char *field, *match;
+    char *end = report_buf.s - strlen(">" ASCII_EOL), *out;
+
+    if(report_buf.flushed) {
+        auto_report.baseline = false;
+        return;
+    }
+
+    *end = '\0';
+    if((out = strchr(report_buf.data, '|')) == NULL)
+        out = end;
+
+    strcpy(current, out);
+    end = current + strlen(current);
+
+    // Keep changed and new fields
+    field = current;
+    while(*field) {
+        length = field_length(field);
+        klength = key_length(field, length);
+        if(!(auto_report.baseline && (match = find_field(auto_report.fields, field, klength)) &&
+              field_length(match) == length && !memcmp(match, field, length))) {
+            memcpy(out, field, length);
+            out += length;
+        }
+        field += length;
+    }
+
+    // Send dropped fields with an empty value, carry the value of the others forward
+    if(auto_report.baseline) {
+        field = auto_report.fields;
+        while(*field) {
+            length = field_length(field);
+            klength = key_length(field, length);
+            if(!find_field(current, field, klength)) {
+                if(find_field(presence_fields, field, klength)) {
+                    if(out + klength + 1 < &report_buf.data[REPORT_BUFFER_SIZE - sizeof(">" ASCII_EOL)]) {
+                        memcpy(out, field, klength);
+                        out += klength;
+                        *out++ = ':';
+                    }
+                } else if(end + length < &current[AUTO_REPORT_FIELDS_SIZE]) {
+                    memcpy(end, field, length);
+                    *(end += length) = '\0';
+                }
+            }
+            field += length;
+        }
+    }
+
+    strcpy(auto_report.fields, current);
+    auto_report.baseline = true;
+
+    strcpy(out, ">" ASCII_EOL);
+    report_buf.s = out + strlen(out);
+}
+
+status_code_t report_auto_enable (uint32_t interval, float deadband)
+{
+    if(interval && !hal.get_elapsed_ticks)
+        return Status_InvalidStatement;
+
+    memset(&auto_report, 0, sizeof(auto_report_t));
+
+    if((auto_report.enabled = interval || deadband > 0.0f)) {
+        auto_report.stream = hal.stream.type;
+        auto_report.state = (uint_fast16_t)-1; // Send first report on next poll
+        auto_report.interval = interval;
+        auto_report.deadband = deadband;
+    }
+
+    return Status_OK;
+}
+
+void report_auto_poll (void)
+{
+    if(auto_report.enabled && hal.stream.type == auto_report.stream) {
+
+        bool send = sys.state != auto_report.state;
+        uint32_t ms = auto_report.interval ? hal.get_elapsed_ticks() : 0;
+        float position[N_AXIS];
+
+        if(!send && auto_report.interval)
+            send = ms - auto_report.ms >= auto_report.interval;
+
+        if(auto_report.deadband > 0.0f) {
+
+            uint_fast8_t idx = N_AXIS;
+            int32_t current_position[N_AXIS];
+
+            memcpy(current_position, sys_position, sizeof(sys_position));
+            system_convert_array_steps_to_mpos(position, current_position);
+
+            while(!send && idx) {
+                idx--;
+                send = fabsf(position[idx] - auto_report.position[idx]) > auto_report.deadband;
+            }
+        }
+
+        if(send) {
+
+            auto_report.ms = ms;
+            auto_report.state = sys.state;
+            if(auto_report.deadband > 0.0f)
+                memcpy(auto_report.position, position, sizeof(position));
+
+            // Add all fields that may change, unchanged fields are removed from the pushed report.
+            sys.report.wco = settings.status_report.work_coord_offset;
+            sys.report.overrides = settings.status_report.overrides;
+            sys.report.spindle = sys.report.coolant = On;
+
+            auto_report.pushing = true;
+            report_realtime_status();
+            auto_report.pushing = false;
+        }
+    }
+}
+
+void report_auto_reset (void)
+{
+    auto_report.enabled = false;
+}
+
+#endif
+
  // Prints real-time data. This function grabs a real-time snapshot of the stepper subprogram
  // and the actual location of the CNC machine. Users may change the following function to their
  // specific needs, but the desired real-time data report must be as short as possible. This is
@@ -1109,61 +1452,67 @@ void report_realtime_status (void)
     if(hal.probe.get_state)
         probe_state = hal.probe.get_state();
 
+    report_buf.s = report_buf.data;
+    report_buf.flushed = false;
+
     // Report current machine state and sub-states
-    hal.stream.write_all("<");
+    *report_buf.s++ = '<';
 
     switch (gc_state.tool_change && sys.state == STATE_CYCLE ? STATE_TOOL_CHANGE : sys.state) {
 
         case STATE_IDLE:
-            hal.stream.write_all("Idle");
+            report_append("Idle");
             break;
 
         case STATE_CYCLE:
-            hal.stream.write_all("Run");
+            report_append("Run");
             if(sys_probing_state == Probing_Active && settings.status_report.run_substate)
                 probing = true;
             else if (probing)
                 probing = probe_state.triggered;
             if(sys.flags.feed_hold_pending)
-                hal.stream.write_all(":1");
+                report_append(":1");
             else if(probing)
-                hal.stream.write_all(":2");
+                report_append(":2");
             break;
 
         case STATE_HOLD:
-            hal.stream.write_all(appendbuf(2, "Hold:", uitoa((uint32_t)(sys.holding_state - 1))));
+            report_append("Hold:");
+            report_append_uint((uint32_t)(sys.holding_state - 1));
             break;
 
         case STATE_JOG:
-            hal.stream.write_all("Jog");
+            report_append("Jog");
             break;
 
         case STATE_HOMING:
-            hal.stream.write_all("Home");
+            report_append("Home");
             break;
 
         case STATE_ESTOP:
         case STATE_ALARM:
-            if(settings.status_report.alarm_substate)
-                hal.stream.write_all(appendbuf(2, "Alarm:", uitoa((uint32_t)current_alarm)));
-            else
-                hal.stream.write_all("Alarm");
+            report_append("Alarm");
+            if(settings.status_report.alarm_substate) {
+                *report_buf.s++ = ':';
+                report_append_uint((uint32_t)current_alarm);
+            }
             break;
 
         case STATE_CHECK_MODE:
-            hal.stream.write_all("Check");
+            report_append("Check");
             break;
 
         case STATE_SAFETY_DOOR:
-            hal.stream.write_all(appendbuf(2, "Door:", uitoa((uint32_t)sys.parking_state)));
+            report_append("Door:");
+            report_append_uint((uint32_t)sys.parking_state);
             break;
 
         case STATE_SLEEP:
-            hal.stream.write_all("Sleep");
+            report_append("Sleep");
             break;
 
         case STATE_TOOL_CHANGE:
-            hal.stream.write_all("Tool");
+            report_append("Tool");
             break;
     }
 
@@ -1179,36 +1528,57 @@ void report_realtime_status (void)
     }
 
     // Report position
-    hal.stream.write_all(settings.status_report.machine_position ? "|MPos:" : "|WPos:");
-    hal.stream.write_all(get_axis_values(print_position));
+    report_append(settings.status_report.machine_position ? "|MPos:" : "|WPos:");
+    report_append_axis_values(&position_cache, print_position);
 
     // Returns planner and output stream buffer states.
 
     if (settings.status_report.buffer_state) {
-        hal.stream.write_all("|Bf:");
-        hal.stream.write_all(uitoa((uint32_t)plan_get_block_buffer_available()));
-        hal.stream.write_all(",");
-        hal.stream.write_all(uitoa(hal.stream.get_rx_buffer_available()));
+        report_append("|Bf:");
+        report_append_uint((uint32_t)plan_get_block_buffer_available());
+        *report_buf.s++ = ',';
+        report_append_uint(hal.stream.get_rx_buffer_available());
     }
 
     if(settings.status_report.line_numbers) {
         // Report current line number
         plan_block_t *cur_block = plan_get_current_block();
-        if (cur_block != NULL && cur_block->line_number > 0)
-            hal.stream.write_all(appendbuf(2, "|Ln:", uitoa((uint32_t)cur_block->line_number)));
+        if (cur_block != NULL && cur_block->line_number > 0) {
+            report_append("|Ln:");
+            report_append_uint((uint32_t)cur_block->line_number);
+        }
     }
 
+#ifdef ENABLE_STARVATION_STATS
+    starvation_event_t starvation;
+    uint32_t starvation_events;
+    if((starvation_events = starvation_get_last(&starvation))) {
+        report_append("|Sv:");
+        report_append_uint(starvation_events);
+        *report_buf.s++ = ',';
+        report_append_uint(starvation.duration);
+        *report_buf.s++ = ',';
+        report_append_uint((uint32_t)starvation.line);
+    }
+#endif
+
     spindle_state_t sp_state = hal.spindle.get_state();
 
     // Report realtime feed speed
     if(settings.status_report.feed_speed) {
         if(hal.driver_cap.variable_spindle) {
-            hal.stream.write_all(appendbuf(2, "|FS:", get_rate_value(st_get_realtime_rate())));
-            hal.stream.write_all(appendbuf(2, ",", uitoa(sp_state.on ? (uint32_t)sys.spindle_rpm : 0)));
-            if(hal.spindle.get_data /* && sys.mpg_mode */)
-                hal.stream.write_all(appendbuf(2, ",", uitoa((uint32_t)hal.spindle.get_data(SpindleData_RPM).rpm)));
-        } else
-            hal.stream.write_all(appendbuf(2, "|F:", get_rate_value(st_get_realtime_rate())));
+            report_append("|FS:");
+            report_append_rate(st_get_realtime_rate());
+            *report_buf.s++ = ',';
+            report_append_uint(sp_state.on ? (uint32_t)sys.spindle_rpm : 0);
+            if(hal.spindle.get_data /* && sys.mpg_mode */) {
+                *report_buf.s++ = ',';
+                report_append_uint((uint32_t)hal.spindle.get_data(SpindleData_RPM).rpm);
+            }
+        } else {
+            report_append("|F:");
+            report_append_rate(st_get_realtime_rate());
+        }
     }
 
     if(settings.status_report.pin_state) {
@@ -1218,9 +1588,11 @@ void report_realtime_status (void)
 
         if (lim_pin_state.value | ctrl_pin_state.value | probe_state.triggered | !probe_state.connected | sys.flags.block_delete_enabled) {
 
-            char *append = &buf[4];
+            char *append;
 
-            strcpy(buf, "|Pn:");
+            report_append("|Pn:");
+            report_reserve(16);
+            append = report_buf.s;
 
             if (probe_state.triggered)
                 *append++ = 'P';
@@ -1247,8 +1619,7 @@ void report_realtime_status (void)
                 if (hal.driver_cap.program_stop ? ctrl_pin_state.stop_disable : sys.flags.optional_stop_disable)
                     *append++ = 'T';
             }
-            *append = '\0';
-            hal.stream.write_all(buf);
+            report_buf.s = append;
         }
     }
 
@@ -1281,75 +1652,85 @@ void report_realtime_status (void)
     if(sys.report.value || gc_state.tool_change) {
 
         if(sys.report.wco) {
-            hal.stream.write_all("|WCO:");
-            hal.stream.write_all(get_axis_values(wco));
+            report_append("|WCO:");
+            report_append_axis_values(&wco_cache, wco);
         }
 
         if(sys.report.gwco) {
-            hal.stream.write_all("|WCS:G");
-            hal.stream.write_all(map_coord_system(gc_state.modal.coord_system.id));
+            report_append("|WCS:G");
+            report_append(map_coord_system(gc_state.modal.coord_system.id));
         }
 
         if(sys.report.overrides) {
-            hal.stream.write_all(appendbuf(2, "|Ov:", uitoa((uint32_t)sys.override.feed_rate)));
-            hal.stream.write_all(appendbuf(2, ",", uitoa((uint32_t)sys.override.rapid_rate)));
-            hal.stream.write_all(appendbuf(2, ",", uitoa((uint32_t)sys.override.spindle_rpm)));
+            report_append("|Ov:");
+            report_append_uint((uint32_t)sys.override.feed_rate);
+            *report_buf.s++ = ',';
+            report_append_uint((uint32_t)sys.override.rapid_rate);
+            *report_buf.s++ = ',';
+            report_append_uint((uint32_t)sys.override.spindle_rpm);
         }
 
         if(sys.report.spindle || sys.report.coolant || sys.report.tool || gc_state.tool_change) {
 
             coolant_state_t cl_state = hal.coolant.get_state();
 
-            char *append = &buf[3];
-
-            strcpy(buf, "|A:");
+            report_append("|A:");
+            report_reserve(4);
 
             if (sp_state.on)
-                *append++ = sp_state.ccw ? 'C' : 'S';
+                *report_buf.s++ = sp_state.ccw ? 'C' : 'S';
 
             if (cl_state.flood)
-                *append++ = 'F';
+                *report_buf.s++ = 'F';
 
             if (cl_state.mist)
-                *append++ = 'M';
+                *report_buf.s++ = 'M';
 
             if(gc_state.tool_change && !sys.report.tool)
-                *append++ = 'T';
-
-            *append = '\0';
-            hal.stream.write_all(buf);
+                *report_buf.s++ = 'T';
         }
 
         if(sys.report.scaling) {
-            axis_signals_tostring(buf, gc_get_g51_state());
-            hal.stream.write_all("|Sc:");
-            hal.stream.write_all(buf);
+            report_append("|Sc:");
+            report_reserve(N_AXIS);
+            report_buf.s = axis_signals_tostring(report_buf.s, gc_get_g51_state());
         }
 
         if(sys.report.mpg_mode && hal.driver_cap.mpg_mode)
-            hal.stream.write_all(sys.mpg_mode ? "|MPG:1" : "|MPG:0");
+            report_append(sys.mpg_mode ? "|MPG:1" : "|MPG:0");
 
         if(sys.report.homed && (sys.homing.mask || settings.homing.flags.single_axis_commands || settings.homing.flags.manual)) {
             axes_signals_t homing = {sys.homing.mask ? sys.homing.mask : AXES_BITMASK};
-            hal.stream.write_all(appendbuf(2, "|H:", (homing.mask & sys.homed.mask) == homing.mask ? "1" : "0"));
-            if(settings.homing.flags.single_axis_commands)
-                hal.stream.write_all(appendbuf(2, ",", uitoa(sys.homed.mask)));
+            report_append((homing.mask & sys.homed.mask) == homing.mask ? "|H:1" : "|H:0");
+            if(settings.homing.flags.single_axis_commands) {
+                report_append(",");
+                report_append_uint(sys.homed.mask);
+            }
         }
 
         if(sys.report.xmode && settings.mode == Mode_Lathe)
-            hal.stream.write_all(gc_state.modal.diameter_mode ? "|D:1" : "|D:0");
+            report_append(gc_state.modal.diameter_mode ? "|D:1" : "|D:0");
 
-        if(sys.report.tool)
-            hal.stream.write_all(appendbuf(2, "|T:", uitoa(gc_state.tool->tool)));
+        if(sys.report.tool) {
+            report_append("|T:");
+            report_append_uint(gc_state.tool->tool);
+        }
 
         if(sys.report.tlo_reference)
-            hal.stream.write_all(appendbuf(2, "|TLR:", uitoa(sys.tlo_reference_set.mask != 0)));
+            report_append(sys.tlo_reference_set.mask != 0 ? "|TLR:1" : "|TLR:0");
     }
 
     if(grbl.on_realtime_report)
-        grbl.on_realtime_report(hal.stream.write_all, sys.report);
+        grbl.on_realtime_report(report_append, sys.report);
+
+    report_append(">" ASCII_EOL);
+
+#ifdef ENABLE_AUTO_REPORT
+    if(auto_report.pushing)
+        report_delta();
+#endif
 
-    hal.stream.write_all(">" ASCII_EOL);
+    report_flush();
 
     if(settings.status_report.parser_state) {
 
@@ -66,6 +66,15 @@ void report_echo_line_received (char *line);
 // Prints realtime status report.
 void report_realtime_status (void);
 
+#ifdef ENABLE_AUTO_REPORT
+// Subscribes the current stream to pushed status reports, cancels the subscription if interval and deadband are 0.
+status_code_t report_auto_enable (uint32_t interval, float deadband);
+// Sends a pushed status report when due, called from the realtime loop.
+void report_auto_poll (void);
+// Cancels any subscription.
+void report_auto_reset (void);
+#endif
+
 // Prints recorded probe position.
 void report_probe_parameters (void);
 
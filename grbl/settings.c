@@ -93,6 +93,10 @@ const settings_t defaults = {
     .steppers.pulse_microseconds = DEFAULT_STEP_PULSE_MICROSECONDS,
     .steppers.pulse_delay_microseconds = DEFAULT_STEP_PULSE_DELAY,
     .steppers.idle_lock_time = DEFAULT_STEPPER_IDLE_LOCK_TIME,
+#ifdef ENABLE_ADAPTIVE_SEGMENTS
+    .steppers.segments = DEFAULT_STEPPER_SEGMENTS,
+    .steppers.segment_time = DEFAULT_STEPPER_SEGMENT_TIME,
+#endif
     .steppers.step_invert.mask = DEFAULT_STEPPING_INVERT_MASK,
     .steppers.dir_invert.mask = DEFAULT_DIRECTION_INVERT_MASK,
     .steppers.enable_invert.mask = INVERT_ST_ENABLE_MASK,
@@ -181,12 +185,20 @@ const settings_t defaults = {
     .axis[X_AXIS].max_travel = (-DEFAULT_X_MAX_TRAVEL),
     .axis[Y_AXIS].max_travel = (-DEFAULT_Y_MAX_TRAVEL),
     .axis[Z_AXIS].max_travel = (-DEFAULT_Z_MAX_TRAVEL),
+#ifdef ENABLE_S_CURVE_ACCELERATION
+    .axis[X_AXIS].jerk = DEFAULT_X_JERK,
+    .axis[Y_AXIS].jerk = DEFAULT_Y_JERK,
+    .axis[Z_AXIS].jerk = DEFAULT_Z_JERK,
+#endif
 
   #ifdef A_AXIS
     .axis[A_AXIS].steps_per_mm = DEFAULT_A_STEPS_PER_MM,
     .axis[A_AXIS].max_rate = DEFAULT_A_MAX_RATE,
     .axis[A_AXIS].acceleration = DEFAULT_A_ACCELERATION,
     .axis[A_AXIS].max_travel = (-DEFAULT_A_MAX_TRAVEL),
+  #ifdef ENABLE_S_CURVE_ACCELERATION
+    .axis[A_AXIS].jerk = DEFAULT_A_JERK,
+  #endif
     .homing.cycle[3].mask = HOMING_CYCLE_3,
   #endif
   #ifdef B_AXIS
@@ -194,6 +206,9 @@ const settings_t defaults = {
     .axis[B_AXIS].max_rate = DEFAULT_B_MAX_RATE,
     .axis[B_AXIS].acceleration = DEFAULT_B_ACCELERATION,
     .axis[B_AXIS].max_travel = (-DEFAULT_B_MAX_TRAVEL),
+  #ifdef ENABLE_S_CURVE_ACCELERATION
+    .axis[B_AXIS].jerk = DEFAULT_B_JERK,
+  #endif
     .homing.cycle[4].mask = HOMING_CYCLE_4,
   #endif
   #ifdef C_AXIS
@@ -201,6 +216,9 @@ const settings_t defaults = {
     .axis[C_AXIS].acceleration = DEFAULT_C_ACCELERATION,
     .axis[C_AXIS].max_rate = DEFAULT_C_MAX_RATE,
     .axis[C_AXIS].max_travel = (-DEFAULT_C_MAX_TRAVEL),
+  #ifdef ENABLE_S_CURVE_ACCELERATION
+    .axis[C_AXIS].jerk = DEFAULT_C_JERK,
+  #endif
     .homing.cycle[5].mask = HOMING_CYCLE_5,
   #endif
 
@@ -485,6 +503,13 @@ status_code_t settings_store_global_setting (setting_type_t setting, char *svalu
                 break;
 #endif
 
+#ifdef ENABLE_S_CURVE_ACCELERATION
+            case AxisSetting_Jerk:
+                found = true;
+                settings.axis[axis_idx].jerk = value * 60.0f * 60.0f * 60.0f; // Convert to mm/min^3 for grbl internal use.
+                break;
+#endif
+
             default: // for stopping compiler warning
                 break;
         }
@@ -513,6 +538,20 @@ status_code_t settings_store_global_setting (setting_type_t setting, char *svalu
                 settings.steppers.idle_lock_time = int_value;
                 break;
 
+#ifdef ENABLE_ADAPTIVE_SEGMENTS
+            case Setting_StepperSegments: // Reset to ensure change.
+                if(int_value < 4 || int_value > SEGMENT_POOL_SIZE)
+                    return Status_InvalidStatement;
+                settings.steppers.segments = (uint8_t)int_value;
+                break;
+
+            case Setting_StepperSegmentTime: // Reset to ensure change.
+                if(value <= 0.0f)
+                    return Status_NonPositiveValue;
+                settings.steppers.segment_time = value;
+                break;
+#endif
+
             case Setting_StepInvertMask:
                 settings.steppers.step_invert.mask = int_value & AXES_BITMASK;
                 break;
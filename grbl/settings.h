@@ -33,7 +33,9 @@
 
 
 // Define axis settings numbering scheme. Starts at Setting_AxisSettingsBase, every INCREMENT, over N_SETTINGS.
-#ifdef ENABLE_BACKLASH_COMPENSATION
+#if defined(ENABLE_S_CURVE_ACCELERATION)
+#define AXIS_N_SETTINGS          8
+#elif defined(ENABLE_BACKLASH_COMPENSATION)
 #define AXIS_N_SETTINGS          6
 #else
 #define AXIS_N_SETTINGS          4
@@ -53,6 +55,8 @@ typedef enum {
     Setting_InvertStepperEnable = 4,
     Setting_LimitPinsInvertMask = 5,
     Setting_InvertProbePin = 6,
+    Setting_StepperSegments = 7,
+    Setting_StepperSegmentTime = 8,
     Setting_StatusReportMask = 10,
     Setting_JunctionDeviation = 11,
     Setting_ArcTolerance = 12,
@@ -245,12 +249,13 @@ typedef enum {
     AxisSetting_MaxTravel = 3,
     AxisSetting_StepperCurrent = 4,
     AxisSetting_MicroSteps = 5,
-    AxisSetting_Backlash = 6
+    AxisSetting_Backlash = 6,
+    AxisSetting_Jerk = 7
     /*
-    AxisSetting_P_Gain = 7,
-    AxisSetting_I_Gain = 8,
-    AxisSetting_D_Gain = 9,
-    AxisSetting_I_MaxError = 10
+    AxisSetting_P_Gain = 8,
+    AxisSetting_I_Gain = 9,
+    AxisSetting_D_Gain = 10,
+    AxisSetting_I_MaxError = 11
     */
 } axis_setting_type_t;
 
@@ -406,6 +411,10 @@ typedef struct {
     float pulse_microseconds;
     float pulse_delay_microseconds;
     uint16_t idle_lock_time; // If value = 255, steppers do not disable.
+#ifdef ENABLE_ADAPTIVE_SEGMENTS
+    uint8_t segments;       // Number of segments in the segment buffer
+    float segment_time;     // Segment time window in ms
+#endif
 } stepper_settings_t;
 
 typedef struct {
@@ -416,6 +425,9 @@ typedef struct {
 #ifdef ENABLE_BACKLASH_COMPENSATION
     float backlash;
 #endif
+#ifdef ENABLE_S_CURVE_ACCELERATION
+    float jerk;
+#endif
 } axis_settings_t;
 
 typedef union {
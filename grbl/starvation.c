@@ -0,0 +1,178 @@
+/*
+  starvation.c - detection of planner and segment buffer starvation during a cycle
+
+  Part of GrblHAL
+
+  Copyright (c) 2020 Terje Io
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "grbl.h"
+
+#ifdef ENABLE_STARVATION_STATS
+
+#include <string.h>
+
+#include "hal.h"
+#include "starvation.h"
+
+typedef struct {
+    bool pending;           // Planner ran empty, waiting for the next block
+    bool running;           // Last call to st_prep_buffer() was made in a cycle
+    int32_t line;           // Line number of the last block loaded
+    uint32_t start;         // Time the planner ran empty
+    uint32_t prepped;       // Time of the last call to st_prep_buffer() in a cycle
+} starvation_state_t;
+
+typedef struct {
+    uint32_t count;
+    uint32_t planner;       // P events
+    uint32_t halted;        // H events
+    uint32_t segments;      // S events
+    uint32_t total;
+    uint32_t max;
+    uint_fast8_t head;
+    starvation_event_t log[STARVATION_LOG_SIZE];
+} starvation_stats_t;
+
+static starvation_state_t state = {0};
+static starvation_stats_t stats = {0};
+
+static inline uint32_t get_ticks (void)
+{
+    return hal.get_elapsed_ticks ? hal.get_elapsed_ticks() : 0;
+}
+
+static void add_event (char type, int32_t line, uint32_t duration)
+{
+    starvation_event_t *event = &stats.log[stats.head];
+
+    if(duration > STARVATION_TIMEOUT)
+        return;
+
+    event->type = type;
+    event->line = line;
+    event->duration = duration;
+
+    switch(type) {
+
+        case 'P':
+            stats.planner++;
+            break;
+
+        case 'H':
+            stats.halted++;
+            break;
+
+        default:
+            stats.segments++;
+            break;
+    }
+
+    stats.count++;
+    stats.total += duration;
+    stats.max = max(stats.max, duration);
+    stats.head = (stats.head + 1) % STARVATION_LOG_SIZE;
+}
+
+void starvation_segment_buffer (bool empty, plan_block_t *block)
+{
+    if(sys.state == STATE_CYCLE) {
+
+        uint32_t now = get_ticks();
+
+        // Unless resuming from a hold a drained buffer with a partially prepped block means prepping was late.
+        if(empty && block && state.running && !state.pending)
+            add_event('S', block->line_number, now - state.prepped);
+
+        state.running = true;
+        state.prepped = now;
+    } else
+        state.running = false;
+}
+
+void starvation_planner_block (plan_block_t *block, bool drained)
+{
+    if(block == NULL) {
+        if(!state.pending && sys.state == STATE_CYCLE) {
+            state.pending = true;
+            state.start = get_ticks();
+        }
+    } else {
+        if(state.pending) {
+            state.pending = false;
+            add_event(drained ? 'H' : 'P', state.line, get_ticks() - state.start);
+        }
+        state.line = block->line_number;
+    }
+}
+
+void starvation_discard (void)
+{
+    state.pending = state.running = false;
+}
+
+uint32_t starvation_get_last (starvation_event_t *event)
+{
+    if(stats.count)
+        memcpy(event, &stats.log[(stats.head + STARVATION_LOG_SIZE - 1) % STARVATION_LOG_SIZE], sizeof(starvation_event_t));
+
+    return stats.count;
+}
+
+void starvation_report (void)
+{
+    char buf[60];
+    uint_fast8_t idx, logged = (uint_fast8_t)min(stats.count, STARVATION_LOG_SIZE);
+
+    strcpy(buf, "[SV:");
+    strcat(buf, uitoa(stats.count));
+    strcat(buf, ",");
+    strcat(buf, uitoa(stats.planner));
+    strcat(buf, ",");
+    strcat(buf, uitoa(stats.halted));
+    strcat(buf, ",");
+    strcat(buf, uitoa(stats.segments));
+    strcat(buf, ",");
+    strcat(buf, uitoa(stats.total));
+    strcat(buf, ",");
+    strcat(buf, uitoa(stats.max));
+    strcat(buf, "]" ASCII_EOL);
+
+    hal.stream.write(buf);
+
+    for(idx = 0; idx < logged; idx++) {
+
+        starvation_event_t *event = &stats.log[(stats.head + STARVATION_LOG_SIZE - logged + idx) % STARVATION_LOG_SIZE];
+
+        strcpy(buf, "[SVE:");
+        buf[5] = event->type;
+        buf[6] = '\0';
+        strcat(buf, ",");
+        strcat(buf, uitoa((uint32_t)event->line));
+        strcat(buf, ",");
+        strcat(buf, uitoa(event->duration));
+        strcat(buf, "]" ASCII_EOL);
+
+        hal.stream.write(buf);
+    }
+}
+
+void starvation_reset (void)
+{
+    memset(&stats, 0, sizeof(starvation_stats_t));
+}
+
+#endif
@@ -0,0 +1,82 @@
+/*
+  starvation.h - detection of planner and segment buffer starvation during a cycle
+
+  Part of GrblHAL
+
+  Copyright (c) 2020 Terje Io
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  An event is recorded when motion is about to stop, or has stopped, because data did not arrive in time:
+
+    P   The planner ran empty during a cycle and a new block arrived before the segment buffer drained.
+        Motion slowed down towards a stop at the end of the last block.
+    H   As P but the segment buffer drained before the new block arrived, motion halted.
+    S   The segment buffer drained while the planner still had blocks, st_prep_buffer() was not called often enough.
+
+  The duration of P and H events is the time from the planner running empty until the next block arrived, the
+  duration of S events the time since st_prep_buffer() last topped up the segment buffer. The line number is
+  that of the last block executed before the event, it is 0 unless the program carries N words.
+  The planner running empty at a buffer synchronization, e.g. for M0, M2, M30, G4 or a tool change, is not an event.
+  Gaps longer than STARVATION_TIMEOUT milliseconds are taken to be pauses in the program and are not recorded
+  either. Durations are measured with hal.get_elapsed_ticks(), they are reported as 0 if it is not provided.
+
+  When events have been recorded the realtime report carries |Sv:<count>,<duration>,<line> with the total number
+  of events and the duration and line number of the last one. The $V system command outputs the totals
+  and the last STARVATION_LOG_SIZE events, oldest first, $VR clears them:
+
+    [SV:<count>,<P>,<H>,<S>,<total>,<max>]  Number of events of each type, total and max duration in milliseconds.
+    [SVE:<type>,<line>,<duration>]          One line per logged event.
+*/
+
+#ifndef _STARVATION_H_
+#define _STARVATION_H_
+
+#include "planner.h"
+
+#ifndef STARVATION_TIMEOUT
+#define STARVATION_TIMEOUT 5000 // ms
+#endif
+#ifndef STARVATION_LOG_SIZE
+#define STARVATION_LOG_SIZE 8
+#endif
+
+typedef struct {
+    char type;
+    int32_t line;
+    uint32_t duration;
+} starvation_event_t;
+
+// Called by st_prep_buffer() on entry, empty is true when the segment buffer is empty and block is the
+// planner block being prepped, if any.
+void starvation_segment_buffer (bool empty, plan_block_t *block);
+
+// Called by st_prep_buffer() after querying the planner for the next block to prep.
+void starvation_planner_block (plan_block_t *block, bool drained);
+
+// Drops any event in progress, called when the planner is emptied on purpose and on a stepper reset.
+void starvation_discard (void);
+
+// Returns the number of events recorded and the last event in event.
+uint32_t starvation_get_last (starvation_event_t *event);
+
+// Outputs the totals and the event log.
+void starvation_report (void);
+
+// Clears the totals and the event log.
+void starvation_reset (void);
+
+#endif
@@ -27,6 +27,12 @@
 
 #include "hal.h"
 #include "protocol.h"
+#ifdef ENABLE_LATENCY_STATS
+#include "latency.h"
+#endif
+#ifdef ENABLE_STARVATION_STATS
+#include "starvation.h"
+#endif
 
 //#include "debug.h"
 
@@ -59,16 +65,18 @@ typedef union {
 // Holds the planner block Bresenham algorithm execution data for the segments in the segment
 // buffer. Normally, this buffer is partially in-use, but, for the worst case scenario, it will
 // never exceed the number of accessible stepper buffer segments (SEGMENT_BUFFER_SIZE-1).
+// NOTE: With ENABLE_ADAPTIVE_SEGMENTS the buffers are allocated for SEGMENT_POOL_SIZE segments
+// and the number of segments set by $7 are linked into the ring buffers on reset.
 // NOTE: This data is copied from the prepped planner blocks so that the planner blocks may be
 // discarded when entirely consumed and completed by the segment buffer. Also, AMASS alters this
 // data for its own use.
-static st_block_t st_block_buffer[SEGMENT_BUFFER_SIZE - 1];
+static st_block_t st_block_buffer[SEGMENT_POOL_SIZE - 1];
 
 // Primary stepper segment ring buffer. Contains small, short line segments for the stepper
 // algorithm to execute, which are "checked-out" incrementally from the first block in the
 // planner buffer. Once "checked-out", the steps in the segments buffer cannot be modified by
 // the planner, where the remaining planner block steps still can.
-static segment_t segment_buffer[SEGMENT_BUFFER_SIZE];
+static segment_t segment_buffer[SEGMENT_POOL_SIZE];
 
 // Stepper ISR data struct. Contains the running data for the main stepper ISR.
 static stepper_t st;
@@ -89,15 +97,74 @@ static char *message = NULL; // TODO: do we need a queue for this?
 // Stepper timer ticks per minute
 static float cycles_per_min;
 
+#ifdef ENABLE_ADAPTIVE_SEGMENTS
+// Segment time window, from $8
+static float dt_segment;
+#define SEGMENT_MAX_STEPS (0xFFFF >> MAX_AMASS_LEVEL) // Max steps in a segment, AMASS multiplies it by up to 8
+#endif
+
 // Step segment ring buffer indices
 static volatile segment_t *segment_buffer_tail;
 static segment_t *segment_buffer_head, *segment_next_head;
+#ifdef ENABLE_LATENCY_STATS
+static uint_fast8_t segment_buffer_size; // Number of segments in the ring buffer, one is always kept free
+#endif
 
 // Pointers for the step segment being prepped from the planner buffer. Accessed only by the
 // main program. Pointers may be planning segments or planner blocks ahead of what being executed.
 static plan_block_t *pl_block;     // Pointer to the planner block being prepped
 static st_block_t *st_prep_block;  // Pointer to the stepper block data being prepped
 
+#ifdef ENABLE_STEP_EVENTS
+
+// Bresenham line tracer state for expanding segments to step events, executed by the foreground process.
+typedef struct {
+    segment_t *volatile next_segment;   // Next segment to expand
+    segment_t *segment;                 // Segment being expanded
+    st_block_t *block;                  // Block data for the segment being expanded
+    uint32_t counter[N_AXIS];           // Counter variables for the bresenham line tracer
+    uint32_t steps[N_AXIS];
+    uint32_t delta;                     // Timer cycles since the last event
+    volatile uint_fast16_t ticks;       // ISR ticks remaining to expand in the segment
+    volatile bool busy;                 // Set while the foreground process is expanding segments
+    bool segment_start;
+} step_expander_t;
+
+static step_expander_t expander;
+static step_event_t event_buffer[STEP_EVENT_BUFFER_SIZE];
+static volatile uint_fast16_t event_head, event_tail;
+
+#ifdef ENABLE_STEP_STREAM
+static struct {
+    bool loaded;    // True when the step bits of a loaded event are waiting to be output
+    int32_t wait;   // Timer cycles from the start of the next frame to when the loaded step bits are due
+} stream;
+#endif
+
+#endif
+
+#ifdef ENABLE_S_CURVE_ACCELERATION
+// Jerk limited speed ramp. The acceleration is ramped from its start value to the peak value and held there,
+// then ramped down to zero at the end of the ramp.
+typedef struct {
+    float time;         // Elapsed ramp time (min)
+    float duration;     // Ramp duration (min), 0.0 if the ramp is linear
+    float phase_1;      // End of the jerk limited phase at the start of the ramp (min)
+    float phase_2;      // End of the constant acceleration phase (min)
+    float jerk_1;       // Signed jerk of the first phase (mm/min^3)
+    float jerk;         // Signed jerk of the last phase (mm/min^3)
+    float accel_start;  // Signed acceleration at start of ramp (mm/min^2)
+    float accel;        // Signed peak acceleration (mm/min^2)
+    float speed_1;      // Signed speed change at end of first phase (mm/min)
+    float mm_1;         // Signed distance in excess of start speed travelled at end of first phase (mm)
+    float mm_end;       // Signed distance in excess of start speed travelled over the ramp (mm)
+    float delta_speed;  // Signed speed change over the ramp (mm/min)
+    float start_speed;  // Speed at start of ramp (mm/min)
+    float mm_start;     // Start of ramp measured from end of block (mm)
+    float mm_stop;      // End of ramp measured from end of block (mm)
+} s_curve_t;
+#endif
+
 // Segment preparation data struct. Contains all the necessary information to compute new segments
 // based on the current executing planner block.
 typedef struct {
@@ -125,6 +192,9 @@ typedef struct {
     float target_feed;      //
     float inv_feedrate;     // Used by PWM laser mode to speed up segment calculations.
     float current_spindle_rpm;
+#ifdef ENABLE_S_CURVE_ACCELERATION
+    s_curve_t s_curve;      // Jerk limited ramp state, used by the acceleration and deceleration ramps
+#endif
 } st_prep_t;
 
 static st_prep_t prep;
@@ -221,6 +291,312 @@ ISR_CODE void st_go_idle ()
 }
 
 
+// Starts execution of a segment: sets the spindle speed if requested and, if the segment starts a new
+// planner block, the direction bits, executes output commands and enqueues any message to be synchronized
+// with motion. Returns true for a new block.
+ISR_CODE inline static bool st_segment_start (segment_t *segment)
+{
+    bool new_block;
+
+    if((new_block = st.exec_block != segment->exec_block)) {
+
+        if((st.dir_change = st.exec_block == NULL || st.dir_outbits.value != segment->exec_block->direction_bits.value))
+            st.dir_outbits = segment->exec_block->direction_bits;
+        st.exec_block = segment->exec_block;
+        st.new_block = true;
+
+        if(st.exec_block->overrides.sync)
+            sys.override.control = st.exec_block->overrides;
+
+        // Execute output commands to be syncronized with motion
+        while(st.exec_block->output_commands) {
+            output_command_t *cmd = st.exec_block->output_commands;
+            cmd->is_executed = true;
+            if(cmd->is_digital)
+                hal.port.digital_out(cmd->port, cmd->value != 0.0f);
+            else
+                hal.port.analog_out(cmd->port, cmd->value);
+            st.exec_block->output_commands = cmd->next;
+        }
+
+        // Enqueue any message to be printed (by foreground process)
+        if(st.exec_block->message) {
+            if(message == NULL) {
+                message = st.exec_block->message;
+                protocol_enqueue_rt_command(output_message);
+            } else
+                free(st.exec_block->message); //
+            st.exec_block->message = NULL;
+        }
+    }
+
+    if(segment->update_rpm) {
+      #ifdef SPINDLE_PWM_DIRECT
+        hal.spindle.update_pwm(segment->spindle_pwm);
+      #else
+        hal.spindle.update_rpm(segment->spindle_rpm);
+      #endif
+    }
+
+    return new_block;
+}
+
+// Segment buffer empty. Shutdown.
+ISR_CODE static void st_cycle_complete (void)
+{
+    st_go_idle();
+    // Ensure pwm is set properly upon completion of rate-controlled motion.
+    if (st.exec_block->dynamic_rpm && settings.mode == Mode_Laser)
+        hal.spindle.set_state((spindle_state_t){0}, 0.0f);
+
+    system_set_exec_state_flag(EXEC_CYCLE_COMPLETE); // Flag main program for cycle complete
+}
+
+#ifdef ENABLE_STEP_EVENTS
+
+/* Step event version of "The Stepper Driver Interrupt". The Bresenham line tracer with AMASS described
+   below is executed by the foreground process when st_prep_buffer() is called, expanding the segments in the
+   segment buffer to step events with the timer cycles to the previous event. The interrupt is fired once for
+   each event, it outputs the steps loaded on the previous call, loads the next event and sets the timer to its
+   delay. Ticks not stepping any axis are merged into the delay of the next event.
+   If the event buffer runs empty while there are segments left to expand the interrupt expands the next event
+   itself, as the Bresenham interrupt does, unless the foreground process is interrupted while expanding.
+   NOTE: a segment is kept in the segment buffer until the first event of the next segment is loaded.
+*/
+
+ISR_CODE static void st_expand_segments (uint_fast16_t events);
+
+#ifdef ENABLE_BACKLASH_COMPENSATION
+static bool backlash_motion;
+#endif
+
+// Called when the event buffer is empty. Returns true if the foreground process is lagging behind, the next
+// event is then expanded unless the foreground process is busy doing so. Else the last segment is complete
+// and the cycle is ended.
+ISR_CODE static bool st_event_underrun (void)
+{
+    st.step_outbits.value = 0;
+
+    if(expander.ticks || expander.next_segment != segment_buffer_head) {
+        if(!expander.busy)
+            st_expand_segments(1);
+        return true;
+    }
+
+    if(st.exec_segment) { // Last segment is complete. Advance segment tail pointer.
+        segment_buffer_tail = st.exec_segment->next;
+        st.exec_segment = NULL;
+    }
+
+    if(st.exec_block)
+        st_cycle_complete();
+    else
+        st_go_idle();
+
+    return false;
+}
+
+// Loads the event at the tail of the event buffer: starts a new segment if flagged, checks the probe,
+// updates the machine position and sets the step bits to output. Returns the event delay.
+ISR_CODE static uint32_t st_event_load (void)
+{
+    step_event_t *event = &event_buffer[event_tail];
+    uint32_t delta = event->delta;
+
+    if(event->segment_start) {
+
+        // Previous segment is complete. Advance segment tail pointer.
+        if(st.exec_segment)
+            segment_buffer_tail = segment_buffer_tail->next;
+
+        st.exec_segment = (segment_t *)segment_buffer_tail;
+
+#ifdef ENABLE_BACKLASH_COMPENSATION
+        if(st_segment_start(st.exec_segment))
+            backlash_motion = st.exec_block->backlash_motion;
+#else
+        st_segment_start(st.exec_segment);
+#endif
+    }
+
+    // Check probing state.
+    if (sys_probing_state == Probing_Active && hal.probe.get_state().triggered) {
+        sys_probing_state = Probing_Off;
+        memcpy(sys_probe_position, sys_position, sizeof(sys_position));
+        bit_true(sys_rt_exec_state, EXEC_MOTION_CANCEL);
+    }
+
+    st.step_outbits = event->step_outbits;
+
+#ifdef ENABLE_BACKLASH_COMPENSATION
+    if(!backlash_motion)
+#endif
+    if(st.step_outbits.value) {
+        uint_fast8_t idx = N_AXIS;
+        do {
+            if(st.step_outbits.value & bit(--idx))
+                sys_position[idx] += st.dir_outbits.value & bit(idx) ? -1 : 1;
+        } while(idx);
+    }
+
+    // During a homing cycle, lock out and prevent desired axes from moving.
+    if (sys.state == STATE_HOMING)
+        st.step_outbits.value &= sys.homing_axis_lock.mask;
+
+    event_tail = (event_tail + 1) & (STEP_EVENT_BUFFER_SIZE - 1);
+
+    return delta;
+}
+
+#ifdef ENABLE_LATENCY_STATS
+ISR_CODE static void st_interrupt_handler (void)
+#else
+ISR_CODE void stepper_driver_interrupt_handler (void)
+#endif
+{
+    // Start a step pulse when there is a block to execute.
+    if(st.exec_block) {
+        hal.stepper.pulse_start(&st);
+        st.new_block = st.dir_change = false;
+    }
+
+    if(event_tail == event_head && st_event_underrun() && event_tail == event_head)
+        hal.stepper.cycles_per_tick(hal.f_step_timer / 100000); // Foreground process is expanding, wait 10 us for it.
+    else if(event_tail != event_head)
+        hal.stepper.cycles_per_tick(st_event_load());
+}
+
+#ifdef ENABLE_STEP_STREAM
+
+/* Step stream version of the interrupt above, called by the driver to fill frames of hal.stepper.stream.frame_cycles
+   timer cycles. An event is loaded when the steps of the previous are output and its steps are output at the start
+   of the frame its delay ends in. Steps ending up in the same frame as the previous are delayed to the next frame,
+   the time lost is caught up on by the following events.
+*/
+ISR_CODE uint_fast16_t stepper_stream_fill (step_frame_t *frame, uint_fast16_t count)
+{
+    uint_fast16_t filled = 0;
+    int32_t frame_cycles = (int32_t)hal.stepper.stream.frame_cycles;
+#ifdef ENABLE_LATENCY_STATS
+    uint32_t timestamp = latency_enter();
+#endif
+
+    while(filled < count) {
+
+        if(!stream.loaded) {
+            if(event_tail == event_head) {
+                stream.wait = 0;
+                if(!st_event_underrun())
+                    break; // Motion is complete.
+            } else {
+                stream.wait += (int32_t)st_event_load();
+                stream.loaded = true;
+                // Output direction changes at least one frame ahead of the step.
+                if(st.dir_change && stream.wait < frame_cycles)
+                    stream.wait = frame_cycles;
+                st.new_block = st.dir_change = false;
+            }
+        }
+
+        frame->dir_outbits = st.dir_outbits;
+        frame->step_outbits.value = 0;
+
+        if(stream.loaded) {
+            if(stream.wait < frame_cycles) {
+                frame->step_outbits = st.step_outbits;
+                stream.loaded = false;
+            }
+            stream.wait -= frame_cycles;
+        }
+
+        frame++;
+        filled++;
+    }
+
+#ifdef ENABLE_LATENCY_STATS
+    latency_exit(Latency_StepperInterrupt, timestamp);
+#endif
+
+    return filled;
+}
+
+#endif
+
+// Expands segments in the segment buffer to step events until the event buffer is full or the given number
+// of events is added. Called by the foreground process and by the interrupt on an event buffer underrun.
+ISR_CODE static void st_expand_segments (uint_fast16_t events)
+{
+    uint_fast8_t idx;
+    uint_fast16_t head = event_head, next_head;
+    axes_signals_t step_outbits;
+
+    while(events && (next_head = (head + 1) & (STEP_EVENT_BUFFER_SIZE - 1)) != event_tail) {
+
+        if(expander.ticks == 0) {
+
+            segment_t *segment = expander.next_segment;
+
+            if(segment == segment_buffer_head)
+                break; // No more segments to expand.
+
+            // If the segment starts a new planner block, initialize Bresenham line counters.
+            if(expander.block != segment->exec_block) {
+                expander.block = segment->exec_block;
+                idx = N_AXIS;
+                do {
+                    idx--;
+                    expander.counter[idx] = expander.block->step_event_count >> 1;
+                  #ifndef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
+                    expander.steps[idx] = expander.block->steps[idx];
+                  #endif
+                } while(idx);
+            }
+
+          #ifdef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
+            // Adjust Bresenham axis increment counters according to AMASS level.
+            idx = N_AXIS;
+            do {
+                idx--;
+                expander.steps[idx] = expander.block->steps[idx] >> segment->amass_level;
+            } while(idx);
+          #endif
+
+            expander.segment = segment;
+            expander.segment_start = true;
+            expander.ticks = segment->n_step ? segment->n_step : 1; // NOTE: A segment with no steps executes one tick.
+            expander.next_segment = segment->next;
+        }
+
+        // Execute step displacement profile by Bresenham line algorithm
+        step_outbits.value = 0;
+        idx = N_AXIS;
+        do {
+            idx--;
+            if((expander.counter[idx] += expander.steps[idx]) > expander.block->step_event_count) {
+                step_outbits.value |= bit(idx);
+                expander.counter[idx] -= expander.block->step_event_count;
+            }
+        } while(idx);
+
+        expander.delta += expander.segment->cycles_per_tick;
+
+        if(step_outbits.value || expander.segment_start) {
+            event_buffer[head].delta = expander.delta;
+            event_buffer[head].step_outbits = step_outbits;
+            event_buffer[head].dir_outbits = expander.block->direction_bits;
+            event_buffer[head].segment_start = expander.segment_start;
+            event_head = head = next_head;
+            expander.delta = 0;
+            expander.segment_start = false;
+            events--;
+        }
+
+        expander.ticks--;
+    }
+}
+
+#else // Bresenham line tracer executed by the interrupt
+
 /* "The Stepper Driver Interrupt" - This timer interrupt is the workhorse of Grbl. Grbl employs
    the venerable Bresenham line algorithm to manage and exactly synchronize multi-axis moves.
    Unlike the popular DDA algorithm, the Bresenham algorithm is not susceptible to numerical
@@ -266,7 +642,11 @@ ISR_CODE void st_go_idle ()
    ISR is 5usec typical and 25usec maximum, well below requirement.
    NOTE: This ISR expects at least one step to be executed per segment.
 */
+#ifdef ENABLE_LATENCY_STATS
+ISR_CODE static void st_interrupt_handler (void)
+#else
 ISR_CODE void stepper_driver_interrupt_handler (void)
+#endif
 {
 #ifdef ENABLE_BACKLASH_COMPENSATION
     static bool backlash_motion;
@@ -296,41 +676,13 @@ ISR_CODE void stepper_driver_interrupt_handler (void)
             st.step_count = st.exec_segment->n_step; // NOTE: Can sometimes be zero when moving slow.
 
             // If the new segment starts a new planner block, initialize stepper variables and counters.
-            if (st.exec_block != st.exec_segment->exec_block) {
+            if (st_segment_start(st.exec_segment)) {
 
-                if((st.dir_change = st.exec_block == NULL || st.dir_outbits.value != st.exec_segment->exec_block->direction_bits.value))
-                    st.dir_outbits = st.exec_segment->exec_block->direction_bits;
-                st.exec_block = st.exec_segment->exec_block;
                 st.step_event_count = st.exec_block->step_event_count;
-                st.new_block = true;
 #ifdef ENABLE_BACKLASH_COMPENSATION
                 backlash_motion = st.exec_block->backlash_motion;
 #endif
 
-                if(st.exec_block->overrides.sync)
-                    sys.override.control = st.exec_block->overrides;
-
-                // Execute output commands to be syncronized with motion
-                while(st.exec_block->output_commands) {
-                    output_command_t *cmd = st.exec_block->output_commands;
-                    cmd->is_executed = true;
-                    if(cmd->is_digital)
-                        hal.port.digital_out(cmd->port, cmd->value != 0.0f);
-                    else
-                        hal.port.analog_out(cmd->port, cmd->value);
-                    st.exec_block->output_commands = cmd->next;
-                }
-
-                // Enqueue any message to be printed (by foreground process)
-                if(st.exec_block->message) {
-                    if(message == NULL) {
-                        message = st.exec_block->message;
-                        protocol_enqueue_rt_command(output_message);
-                    } else
-                        free(st.exec_block->message); //
-                    st.exec_block->message = NULL;
-                }
-
                 // Initialize Bresenham line and distance counters
                 st.counter_x = st.counter_y = st.counter_z
                 #ifdef A_AXIS
@@ -365,22 +717,9 @@ ISR_CODE void stepper_driver_interrupt_handler (void)
             st.steps[C_AXIS] = st.exec_block->steps[C_AXIS] >> st.amass_level;
            #endif
          #endif
-
-            if(st.exec_segment->update_rpm) {
-              #ifdef SPINDLE_PWM_DIRECT
-                hal.spindle.update_pwm(st.exec_segment->spindle_pwm);
-              #else
-                hal.spindle.update_rpm(st.exec_segment->spindle_rpm);
-              #endif
-            }
         } else {
             // Segment buffer empty. Shutdown.
-            st_go_idle();
-            // Ensure pwm is set properly upon completion of rate-controlled motion.
-            if (st.exec_block->dynamic_rpm && settings.mode == Mode_Laser)
-                hal.spindle.set_state((spindle_state_t){0}, 0.0f);
-
-            system_set_exec_state_flag(EXEC_CYCLE_COMPLETE); // Flag main program for cycle complete
+            st_cycle_complete();
 
             return; // Nothing to do but exit.
         }
@@ -477,6 +816,21 @@ ISR_CODE void stepper_driver_interrupt_handler (void)
     }
 }
 
+#endif // ENABLE_STEP_EVENTS
+
+#ifdef ENABLE_LATENCY_STATS
+
+ISR_CODE void stepper_driver_interrupt_handler (void)
+{
+    uint32_t timestamp = latency_enter();
+
+    st_interrupt_handler();
+
+    latency_exit(Latency_StepperInterrupt, timestamp);
+}
+
+#endif
+
 // Reset and clear stepper subsystem variables
 void st_reset ()
 {
@@ -494,16 +848,22 @@ void st_reset ()
 
     // NOTE: buffer indices starts from 1 for simpler driver coding!
 
+    uint_fast8_t idx, n_segments = SEGMENT_BUFFER_SIZE;
+
+#ifdef ENABLE_ADAPTIVE_SEGMENTS
+    n_segments = min(settings.steppers.segments, SEGMENT_POOL_SIZE);
+    dt_segment = settings.steppers.segment_time / 60000.0f; // ms -> min
+#endif
+
     // Set up stepper block ringbuffer as circular linked list and add id
-    uint_fast8_t idx;
-    for(idx = 0 ; idx <= SEGMENT_BUFFER_SIZE - 2 ; idx++) {
-        st_block_buffer[idx].next = &st_block_buffer[idx == SEGMENT_BUFFER_SIZE - 2 ? 0 : idx + 1];
+    for(idx = 0 ; idx <= n_segments - 2 ; idx++) {
+        st_block_buffer[idx].next = &st_block_buffer[idx == n_segments - 2 ? 0 : idx + 1];
         st_block_buffer[idx].id = idx + 1;
     }
 
     // Set up segments ringbuffer as circular linked list, add id and clear AMASS level
-    for(idx = 0 ; idx <= SEGMENT_BUFFER_SIZE - 1 ; idx++) {
-        segment_buffer[idx].next = &segment_buffer[idx == SEGMENT_BUFFER_SIZE - 1 ? 0 : idx + 1];
+    for(idx = 0 ; idx <= n_segments - 1 ; idx++) {
+        segment_buffer[idx].next = &segment_buffer[idx == n_segments - 1 ? 0 : idx + 1];
         segment_buffer[idx].id = idx + 1;
         segment_buffer[idx].amass_level = 0;
     }
@@ -514,10 +874,26 @@ void st_reset ()
     pl_block = NULL;  // Planner block pointer used by segment buffer
     segment_buffer_tail = segment_buffer_head = &segment_buffer[0]; // empty = tail
     segment_next_head = segment_buffer_head->next;
+#ifdef ENABLE_LATENCY_STATS
+    segment_buffer_size = n_segments;
+#endif
+#ifdef ENABLE_STARVATION_STATS
+    starvation_discard();
+#endif
 
     memset(&prep, 0, sizeof(st_prep_t));
     memset(&st, 0, sizeof(stepper_t));
 
+#ifdef ENABLE_STEP_EVENTS
+    memset(&expander, 0, sizeof(step_expander_t));
+    expander.next_segment = segment_buffer_head;
+    event_head = event_tail = 0;
+#endif
+
+#ifdef ENABLE_STEP_STREAM
+    memset(&stream, 0, sizeof(stream));
+#endif
+
 #ifdef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
     // TODO: move to driver?
     // AMASS_LEVEL0: Normal operation. No AMASS. No upper cutoff frequency. Starts at LEVEL1 cutoff frequency.
@@ -582,6 +958,176 @@ void st_parking_restore_buffer()
     pl_block = NULL; // Set to reload next block.
 }
 
+#ifdef ENABLE_S_CURVE_ACCELERATION
+
+// Computes the ramp phases for the peak acceleration accel from the speed change, start acceleration and jerk held as
+// magnitudes in prep.s_curve. Returns the distance travelled over the ramp.
+static float s_curve_shape (float accel, float start_speed, bool decelerate)
+{
+    float a0 = prep.s_curve.accel_start, jerk = prep.s_curve.jerk;
+    float t1 = fabsf(accel - a0) / jerk, t3 = accel / jerk, t2;
+
+    prep.s_curve.jerk_1 = accel < a0 ? -jerk : jerk;
+    prep.s_curve.speed_1 = 0.5f * (a0 + accel) * t1;
+    prep.s_curve.mm_1 = t1 * t1 * (0.5f * a0 + prep.s_curve.jerk_1 * t1 * (1.0f / 6.0f));
+    t2 = (prep.s_curve.delta_speed - prep.s_curve.speed_1 - 0.5f * accel * t3) / accel;
+    prep.s_curve.accel = accel;
+    prep.s_curve.phase_1 = t1;
+    prep.s_curve.phase_2 = t1 + t2;
+    prep.s_curve.duration = t1 + t2 + t3;
+    prep.s_curve.mm_end = prep.s_curve.mm_1 + t2 * (prep.s_curve.speed_1 + 0.5f * accel * t2) +
+                           t3 * (prep.s_curve.delta_speed - jerk * t3 * t3 * (1.0f / 6.0f));
+
+    return start_speed * prep.s_curve.duration + (decelerate ? -prep.s_curve.mm_end : prep.s_curve.mm_end);
+}
+
+// Sets up a jerk limited ramp from start_speed to end_speed beginning at mm_start and ending at mm_end from end of block.
+// A ramp starting at zero acceleration is shaped with the acceleration and jerk settings and travels the distance the
+// planner and s_curve_profile() have planned for it.
+// accel_start is the acceleration of a ramp in progress when the planner recomputed the profile. It is carried into
+// the new ramp if in the same direction, the peak acceleration is then searched for that ends the ramp at mm_end.
+static void s_curve_init (float start_speed, float end_speed, float mm_start, float mm_end, float accel_start)
+{
+    bool decelerate = end_speed < start_speed;
+    float delta_speed = fabsf(end_speed - start_speed);
+    float jerk = pl_block->jerk, accel_max = pl_block->acceleration, accel = 0.0f;
+
+    prep.s_curve.duration = 0.0f;
+
+    if(jerk <= 0.0f || delta_speed == 0.0f)
+        return;
+
+    prep.s_curve.time = 0.0f;
+    prep.s_curve.jerk = jerk;
+    prep.s_curve.delta_speed = delta_speed;
+    prep.s_curve.start_speed = start_speed;
+    prep.s_curve.mm_start = mm_start;
+    prep.s_curve.mm_stop = mm_end;
+    prep.s_curve.accel_start = decelerate ? -accel_start : accel_start;
+
+    if(prep.s_curve.accel_start > 0.0f && 2.0f * delta_speed * jerk > prep.s_curve.accel_start * prep.s_curve.accel_start) {
+        // The distance travelled goes down as the peak acceleration goes up, bisect for the peak that fits.
+        uint_fast8_t iterations = 20;
+        float distance = mm_start - mm_end, lo = 0.0f;
+        float hi = min(accel_max, sqrtf(delta_speed * jerk + 0.5f * prep.s_curve.accel_start * prep.s_curve.accel_start));
+
+        if(s_curve_shape(hi, start_speed, decelerate) < distance) do {
+            accel = 0.5f * (lo + hi);
+            if(s_curve_shape(accel, start_speed, decelerate) > distance)
+                lo = accel;
+            else
+                hi = accel;
+        } while(--iterations);
+
+        accel = hi;
+    } else {
+        prep.s_curve.accel_start = 0.0f;
+        accel = min(accel_max, sqrtf(delta_speed * jerk));
+    }
+
+    if(accel > 0.0f) {
+        s_curve_shape(accel, start_speed, decelerate);
+        if(decelerate) {
+            prep.s_curve.jerk_1 = -prep.s_curve.jerk_1;
+            prep.s_curve.jerk = -prep.s_curve.jerk;
+            prep.s_curve.accel_start = -prep.s_curve.accel_start;
+            prep.s_curve.accel = -prep.s_curve.accel;
+            prep.s_curve.speed_1 = -prep.s_curve.speed_1;
+            prep.s_curve.mm_1 = -prep.s_curve.mm_1;
+            prep.s_curve.mm_end = -prep.s_curve.mm_end;
+            prep.s_curve.delta_speed = -delta_speed;
+        }
+    } else
+        prep.s_curve.duration = 0.0f;
+}
+
+// Computes the velocity profile of the prepped block with jerk limited ramps from the entry speed, the planned exit
+// speed and the nominal speed. The ramp distances are the same as the planner used for planning the entry speeds.
+static void s_curve_profile (float entry_speed, float nominal_speed)
+{
+    float acceleration = pl_block->acceleration, jerk = pl_block->jerk, mm = pl_block->millimeters;
+    float accel_mm = plan_s_curve_distance(entry_speed, nominal_speed, acceleration, jerk);
+    float decel_mm = plan_s_curve_distance(nominal_speed, prep.exit_speed, acceleration, jerk);
+
+    if (accel_mm + decel_mm <= mm) { // Trapezoid, acceleration-cruise, cruise-deceleration or cruise-only types
+        prep.maximum_speed = nominal_speed;
+        prep.accelerate_until = mm - accel_mm;
+        prep.decelerate_after = decel_mm;
+        if (accel_mm == 0.0f)
+            prep.ramp_type = Ramp_Cruise;
+    } else if (plan_s_curve_distance(entry_speed, prep.exit_speed, acceleration, jerk) >= mm) {
+        if (entry_speed > prep.exit_speed) // Deceleration-only type
+            prep.ramp_type = Ramp_Decel;
+        else { // Acceleration-only type
+            prep.accelerate_until = 0.0f;
+            prep.maximum_speed = prep.exit_speed;
+        }
+    } else { // Triangle type, bisect for the peak speed that fits the block.
+        uint_fast8_t iterations = 20;
+        float lo = max(entry_speed, prep.exit_speed), hi = nominal_speed, speed;
+
+        do {
+            speed = 0.5f * (lo + hi);
+            if (plan_s_curve_distance(entry_speed, speed, acceleration, jerk) +
+                 plan_s_curve_distance(speed, prep.exit_speed, acceleration, jerk) > mm)
+                hi = speed;
+            else
+                lo = speed;
+        } while(--iterations);
+
+        prep.maximum_speed = lo;
+        prep.accelerate_until = mm - plan_s_curve_distance(entry_speed, lo, acceleration, jerk);
+        prep.decelerate_after = plan_s_curve_distance(lo, prep.exit_speed, acceleration, jerk);
+    }
+}
+
+// Returns the signed acceleration of the jerk limited ramp in progress.
+static float s_curve_get_accel (void)
+{
+    float t = prep.s_curve.time;
+
+    if(t < prep.s_curve.phase_1)
+        return prep.s_curve.accel_start + prep.s_curve.jerk_1 * t;
+
+    return t < prep.s_curve.phase_2 ? prep.s_curve.accel : prep.s_curve.jerk * (prep.s_curve.duration - t);
+}
+
+// Advances the jerk limited ramp by time_var (min) and updates the current speed.
+// Returns the new distance from end of block. If the ramp ends within time_var it is cut to the end of the ramp
+// and the end of the ramp is returned.
+// NOTE: Position is computed from the start of the ramp and does not accumulate round-off.
+static float s_curve_advance (float *time_var)
+{
+    float t = prep.s_curve.time + *time_var, mm, u;
+
+    if(t >= prep.s_curve.duration) {
+        *time_var = prep.s_curve.duration - prep.s_curve.time;
+        prep.s_curve.time = prep.s_curve.duration;
+        prep.current_speed = prep.s_curve.start_speed + prep.s_curve.delta_speed;
+        return prep.s_curve.mm_stop;
+    }
+
+    if(t < prep.s_curve.phase_1) {
+        u = t * (prep.s_curve.accel_start + 0.5f * prep.s_curve.jerk_1 * t);
+        mm = t * t * (0.5f * prep.s_curve.accel_start + prep.s_curve.jerk_1 * t * (1.0f / 6.0f));
+    } else if(t < prep.s_curve.phase_2) {
+        u = t - prep.s_curve.phase_1;
+        mm = prep.s_curve.mm_1 + u * (prep.s_curve.speed_1 + 0.5f * prep.s_curve.accel * u);
+        u = prep.s_curve.speed_1 + prep.s_curve.accel * u;
+    } else {
+        u = prep.s_curve.duration - t;
+        mm = prep.s_curve.mm_end - u * (prep.s_curve.delta_speed - prep.s_curve.jerk * u * u * (1.0f / 6.0f));
+        u = prep.s_curve.delta_speed - 0.5f * prep.s_curve.jerk * u * u;
+    }
+
+    prep.s_curve.time = t;
+    prep.current_speed = prep.s_curve.start_speed + u;
+
+    return prep.s_curve.mm_start - prep.s_curve.start_speed * t - mm;
+}
+
+#endif
+
 /* Prepares step segment buffer. Continuously called from main program.
 
    The segment buffer is an intermediary buffer interface between the execution of steps
@@ -595,8 +1141,16 @@ void st_parking_restore_buffer()
    Currently, the segment buffer conservatively holds roughly up to 40-50 msec of steps.
    NOTE: Computation units are in steps, millimeters, and minutes.
 */
+#if defined(ENABLE_STEP_EVENTS) || defined(ENABLE_LATENCY_STATS)
+static void st_prep_segments (void)
+#else
 void st_prep_buffer()
+#endif
 {
+#ifdef ENABLE_STARVATION_STATS
+    starvation_segment_buffer(segment_buffer_tail == segment_buffer_head, pl_block);
+#endif
+
     // Block step prep buffer, while in a suspend state and there is no suspend motion to execute.
     if (sys.step_control.end_motion)
         return;
@@ -606,15 +1160,33 @@ void st_prep_buffer()
         // Determine if we need to load a new planner block or if the block needs to be recomputed.
         if (pl_block == NULL) {
 
+          #ifdef ENABLE_S_CURVE_ACCELERATION
+            bool s_curve_accel = true;
+            float accel_start = 0.0f;
+          #endif
+
             // Query planner for a queued block
 
             pl_block = sys.step_control.execute_sys_motion ? plan_get_system_motion_block() : plan_get_current_block();
 
+#ifdef ENABLE_STARVATION_STATS
+            if (!sys.step_control.execute_sys_motion)
+                starvation_planner_block(pl_block, segment_buffer_tail == segment_buffer_head);
+#endif
+
             if (pl_block == NULL)
                 return; // No planner blocks. Exit.
 
             // Check if we need to only recompute the velocity profile or load a new block.
             if (prep.recalculate.velocity_profile) {
+              #ifdef ENABLE_S_CURVE_ACCELERATION
+                // Carry the acceleration of a jerk limited ramp in progress into the recomputed ramp,
+                // a linear acceleration ramp in progress is completed linearly.
+                if (prep.s_curve.duration > 0.0f)
+                    accel_start = s_curve_get_accel();
+                else
+                    s_curve_accel = prep.ramp_type != Ramp_Accel;
+              #endif
                 if(settings.parking.flags.enabled) {
                     if (prep.recalculate.parking)
                         prep.recalculate.velocity_profile = Off;
@@ -744,8 +1316,17 @@ void st_prep_buffer()
                         prep.decelerate_after = inv_2_accel * (nominal_speed_sqr - exit_speed_sqr); // Should always be >= 0.0 due to planner reinit.
                         prep.maximum_speed = nominal_speed;
                         prep.ramp_type = Ramp_DecelOverride;
+                      #ifdef ENABLE_S_CURVE_ACCELERATION
+                        if (pl_block->jerk > 0.0f)
+                            prep.decelerate_after = plan_s_curve_distance(nominal_speed, prep.exit_speed, pl_block->acceleration, pl_block->jerk);
+                      #endif
                     }
-                } else if (intersect_distance > 0.0f) {
+                }
+              #ifdef ENABLE_S_CURVE_ACCELERATION
+                else if (pl_block->jerk > 0.0f)
+                    s_curve_profile(sqrtf(pl_block->entry_speed_sqr), nominal_speed);
+              #endif
+                else if (intersect_distance > 0.0f) {
                     if (intersect_distance < pl_block->millimeters) { // Either trapezoid or triangle types
                         // NOTE: For acceleration-cruise and cruise-only types, following calculation will be 0.0.
                         prep.decelerate_after = inv_2_accel * (nominal_speed_sqr - exit_speed_sqr);
@@ -774,6 +1355,18 @@ void st_prep_buffer()
                 }
             }
 
+          #ifdef ENABLE_S_CURVE_ACCELERATION
+            // Feed hold and deceleration override ramps are kept linear.
+            if (sys.step_control.execute_hold || prep.recalculate.decel_override)
+                prep.s_curve.duration = 0.0f;
+            else if (prep.ramp_type == Ramp_Accel && s_curve_accel)
+                s_curve_init(prep.current_speed, prep.maximum_speed, pl_block->millimeters, prep.accelerate_until, accel_start);
+            else if (prep.ramp_type == Ramp_Decel)
+                s_curve_init(prep.current_speed, prep.exit_speed, pl_block->millimeters, prep.mm_complete, accel_start);
+            else
+                prep.s_curve.duration = 0.0f;
+          #endif
+
             if(sys.state != STATE_HOMING)
                 sys.step_control.update_spindle_rpm |= (settings.mode == Mode_Laser); // Force update whenever updating block in laser mode.
         }
@@ -799,7 +1392,19 @@ void st_prep_buffer()
           the end of planner block (typical) or mid-block at the end of a forced deceleration,
           such as from a feed hold.
         */
+#ifdef ENABLE_ADAPTIVE_SEGMENTS
+        // Size the segment from the current step rate: it covers the $8 time window, extended to at least one
+        // step and shortened to at most SEGMENT_MAX_STEPS steps.
+        float dt_max = dt_segment, step_rate = prep.current_speed * prep.steps_per_mm; // steps/min
+        if(step_rate > 0.0f) {
+            if(dt_max * step_rate < 1.0f)
+                dt_max = 1.0f / step_rate;
+            else if(dt_max * step_rate > (float)SEGMENT_MAX_STEPS)
+                dt_max = (float)SEGMENT_MAX_STEPS / step_rate;
+        }
+#else
         float dt_max = DT_SEGMENT; // Maximum segment time
+#endif
         float dt = 0.0f; // Initialize segment time
         float time_var = dt_max; // Time worker variable
         float mm_var; // mm - Distance worker variable
@@ -829,6 +1434,20 @@ void st_prep_buffer()
                     break;
 
                 case Ramp_Accel:
+                  #ifdef ENABLE_S_CURVE_ACCELERATION
+                    if (prep.s_curve.duration > 0.0f) {
+                        if ((mm_remaining = s_curve_advance(&time_var)) > prep.accelerate_until)
+                            break;
+                        // End of ramp, acceleration-cruise or acceleration-deceleration ramp junction or end of block.
+                        prep.s_curve.duration = 0.0f;
+                        mm_remaining = prep.accelerate_until;
+                        prep.ramp_type = mm_remaining == prep.decelerate_after ? Ramp_Decel : Ramp_Cruise;
+                        prep.current_speed = prep.maximum_speed;
+                        if (prep.ramp_type == Ramp_Decel)
+                            s_curve_init(prep.maximum_speed, prep.exit_speed, mm_remaining, prep.mm_complete, 0.0f);
+                        break;
+                    }
+                  #endif
                     // NOTE: Acceleration ramp only computes during first do-while loop.
                     speed_var = pl_block->acceleration * time_var;
                     mm_remaining -= time_var * (prep.current_speed + 0.5f * speed_var);
@@ -838,6 +1457,10 @@ void st_prep_buffer()
                         time_var = 2.0f * (pl_block->millimeters - mm_remaining) / (prep.current_speed + prep.maximum_speed);
                         prep.ramp_type = mm_remaining == prep.decelerate_after ? Ramp_Decel : Ramp_Cruise;
                         prep.current_speed = prep.maximum_speed;
+                      #ifdef ENABLE_S_CURVE_ACCELERATION
+                        if (prep.ramp_type == Ramp_Decel)
+                            s_curve_init(prep.maximum_speed, prep.exit_speed, mm_remaining, prep.mm_complete, 0.0f);
+                      #endif
                     } else // Acceleration only.
                         prep.current_speed += speed_var;
                     break;
@@ -852,11 +1475,25 @@ void st_prep_buffer()
                         time_var = (mm_remaining - prep.decelerate_after) / prep.maximum_speed;
                         mm_remaining = prep.decelerate_after; // NOTE: 0.0 at EOB
                         prep.ramp_type = Ramp_Decel;
+                      #ifdef ENABLE_S_CURVE_ACCELERATION
+                        s_curve_init(prep.maximum_speed, prep.exit_speed, mm_remaining, prep.mm_complete, 0.0f);
+                      #endif
                     } else // Cruising only.
                         mm_remaining = mm_var;
                     break;
 
                 default: // case Ramp_Decel:
+                  #ifdef ENABLE_S_CURVE_ACCELERATION
+                    if (prep.s_curve.duration > 0.0f) {
+                        if ((mm_remaining = s_curve_advance(&time_var)) > prep.mm_complete)
+                            break;
+                        // End of ramp, end of block.
+                        prep.s_curve.duration = 0.0f;
+                        mm_remaining = prep.mm_complete;
+                        prep.current_speed = prep.exit_speed;
+                        break;
+                    }
+                  #endif
                     // NOTE: mm_var used as a misc worker variable to prevent errors when near zero speed.
                     speed_var = pl_block->acceleration * time_var; // Used as delta speed (mm/min)
                     if (prep.current_speed > speed_var) { // Check if at or below zero speed.
@@ -882,7 +1519,11 @@ void st_prep_buffer()
                 if (mm_remaining > minimum_mm) { // Check for very slow segments with zero steps.
                     // Increase segment time to ensure at least one step in segment. Override and loop
                     // through distance calculations until minimum_mm or mm_complete.
+                  #ifdef ENABLE_ADAPTIVE_SEGMENTS
+                    dt_max += dt_segment;
+                  #else
                     dt_max += DT_SEGMENT;
+                  #endif
                     time_var = dt_max - dt;
                 } else
                     break; // **Complete** Exit loop. Segment execution time maxed.
@@ -1019,6 +1660,31 @@ void st_prep_buffer()
 }
 
 
+#if defined(ENABLE_STEP_EVENTS) || defined(ENABLE_LATENCY_STATS)
+
+void st_prep_buffer()
+{
+#ifdef ENABLE_LATENCY_STATS
+    uint32_t timestamp = latency_enter();
+
+    if(sys.state & STATE_CYCLE)
+        latency_segment_fill((segment_buffer_head->id - segment_buffer_tail->id + segment_buffer_size) % segment_buffer_size, segment_buffer_size - 1);
+#endif
+
+    st_prep_segments();
+#ifdef ENABLE_STEP_EVENTS
+    expander.busy = true;
+    st_expand_segments(STEP_EVENT_BUFFER_SIZE);
+    expander.busy = false;
+#endif
+
+#ifdef ENABLE_LATENCY_STATS
+    latency_exit(Latency_PrepBuffer, timestamp);
+#endif
+}
+
+#endif
+
 // Called by realtime status reporting to fetch the current speed being executed. This value
 // however is not exactly the current speed, but the speed computed in the last step segment
 // in the segment buffer. It will always be behind by up to the number of segment blocks (-1)
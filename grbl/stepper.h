@@ -30,6 +30,14 @@
 #define SEGMENT_BUFFER_SIZE 10
 #endif
 
+#ifdef ENABLE_ADAPTIVE_SEGMENTS
+#ifndef SEGMENT_POOL_SIZE
+#define SEGMENT_POOL_SIZE 64            // Number of segments allocated, $7 sets how many of them are used. Max 255.
+#endif
+#else
+#define SEGMENT_POOL_SIZE SEGMENT_BUFFER_SIZE
+#endif
+
 typedef enum {
     SquaringMode_Both = 0,
     SquaringMode_A,
@@ -75,6 +83,28 @@ typedef struct st_segment {
     uint_fast8_t amass_level;       // Indicates AMASS level for the ISR to execute this segment
 } segment_t;
 
+#ifdef ENABLE_STEP_EVENTS
+
+#ifndef STEP_EVENT_BUFFER_SIZE
+#define STEP_EVENT_BUFFER_SIZE 256      // Must be a power of 2
+#endif
+
+// Precomputed step event, segments are expanded to these by running the Bresenham line tracer in the foreground.
+typedef struct {
+    uint32_t delta;                 // Timer cycles from the previous event to this
+    axes_signals_t step_outbits;    // Step bits to output
+    axes_signals_t dir_outbits;     // Direction bits to output
+    bool segment_start;             // Set for the first event of a segment
+} step_event_t;
+
+#endif
+
+// Step stream frame, the step and direction bits to output in a fixed period time slot. See hal.stepper.stream.
+typedef struct {
+    axes_signals_t step_outbits;    // Step bits to pulse in the frame, 0 if no axis is to be stepped
+    axes_signals_t dir_outbits;     // Direction bits to output
+} step_frame_t;
+
 // Stepper ISR data struct. Contains the running data for the main stepper ISR.
 typedef struct {
     // Used by the bresenham line algorithm
@@ -136,4 +166,9 @@ float st_get_realtime_rate();
 
 void stepper_driver_interrupt_handler (void);
 
+#ifdef ENABLE_STEP_STREAM
+// Fills frames with step bits for the drivers step stream, returns the number of frames filled.
+uint_fast16_t stepper_stream_fill (step_frame_t *frame, uint_fast16_t count);
+#endif
+
 #endif
@@ -22,6 +22,7 @@
 #ifndef _STREAM_H_
 #define _STREAM_H_
 
+#define ASCII_STX  0x02
 #define ASCII_ETX  0x03
 #define ASCII_ACK  0x06
 #define ASCII_BS   0x08
@@ -77,6 +78,17 @@ typedef enum {
     StreamType_Null
 } stream_type_t;
 
+// Stream types accepting binary protocol frames when ENABLE_BINARY_PROTOCOL is defined, a bitmask of
+// (1 << stream_type_t) values. Other stream types are text only.
+#ifndef BINARY_PROTOCOL_STREAMS
+#define BINARY_PROTOCOL_STREAMS ((1 << StreamType_Serial)|(1 << StreamType_Telnet)|(1 << StreamType_WebSocket))
+#endif
+
+// Stream types where credit based flow control may be enabled when ENABLE_CREDIT_FLOW_CONTROL is defined.
+#ifndef CREDIT_FLOW_CONTROL_STREAMS
+#define CREDIT_FLOW_CONTROL_STREAMS ((1 << StreamType_Telnet)|(1 << StreamType_WebSocket))
+#endif
+
 // These structures are not referenced in the core code, may be used by drivers
 
 typedef struct {
@@ -0,0 +1,245 @@
+/*
+  stream_mux.c - copies output of the controlling stream to read-only observer streams
+
+  Part of GrblHAL
+
+  Copyright (c) 2020 Terje Io
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "grbl.h"
+
+#ifdef ENABLE_STREAM_MUX
+
+#include <string.h>
+
+#include "hal.h"
+#include "stream_mux.h"
+
+typedef struct {
+    volatile bool active;
+    bool dropping;                      // Dropping output up to end of line
+    bool eol;                           // Ring buffer ends at a line boundary
+    bool terminate;                     // A partly sent line was dropped, an end of line is to be queued
+    stream_observer_t stream;
+    uint_fast16_t head;
+    uint_fast16_t tail;
+    uint_fast16_t line_start;           // Start of the line being queued
+    uint_fast16_t report_length;        // Length of status report held back, 0 if none
+    char report[STREAM_MUX_REPORT_SIZE];
+    char data[STREAM_MUX_TX_BUFFER_SIZE];
+} observer_t;
+
+static observer_t observers[STREAM_MUX_OBSERVERS] = {0};
+static stream_write_ptr ctrl_write, ctrl_write_all;  // Output functions of the controlling stream
+
+static inline uint_fast16_t ring_free (observer_t *observer)
+{
+    return (STREAM_MUX_TX_BUFFER_SIZE - 1) - BUFCOUNT(observer->head, observer->tail, STREAM_MUX_TX_BUFFER_SIZE);
+}
+
+static void ring_put (observer_t *observer, const char *s, uint_fast16_t length)
+{
+    uint_fast16_t chunk = STREAM_MUX_TX_BUFFER_SIZE - observer->head;
+
+    if(chunk > length)
+        chunk = length;
+
+    memcpy(&observer->data[observer->head], s, chunk);
+    if(length > chunk)
+        memcpy(observer->data, s + chunk, length - chunk);
+
+    observer->head = (observer->head + length) & (STREAM_MUX_TX_BUFFER_SIZE - 1);
+
+    if((observer->eol = s[length - 1] == ASCII_LF))
+        observer->line_start = observer->head;
+}
+
+// Removes the part of the line being queued from the ring buffer if none of it has been sent yet,
+// else flags it to be terminated.
+static void drop_line (observer_t *observer)
+{
+    uint_fast16_t count = BUFCOUNT(observer->head, observer->tail, STREAM_MUX_TX_BUFFER_SIZE);
+
+    if(((observer->line_start - observer->tail) & (STREAM_MUX_TX_BUFFER_SIZE - 1)) <= count) {
+        observer->head = observer->line_start;
+        observer->eol = true;
+    } else
+        observer->terminate = true;
+}
+
+// Queues the end of line for a dropped line and any status report held back if there is space for them now.
+// Reports are only queued at a line boundary.
+static void queue_pending (observer_t *observer)
+{
+    if(observer->terminate && ring_free(observer) >= sizeof(ASCII_EOL) - 1) {
+        ring_put(observer, ASCII_EOL, sizeof(ASCII_EOL) - 1);
+        observer->terminate = false;
+    }
+
+    if(observer->eol && observer->report_length && observer->report_length <= ring_free(observer)) {
+        ring_put(observer, observer->report, observer->report_length);
+        observer->report_length = 0;
+    }
+}
+
+static void fan_out (const char *s)
+{
+    uint_fast8_t idx = STREAM_MUX_OBSERVERS;
+    uint_fast16_t length = strlen(s);
+    bool eol = length && s[length - 1] == ASCII_LF;
+
+    while(idx) {
+
+        observer_t *observer = &observers[--idx];
+
+        if(!observer->active)
+            continue;
+
+        queue_pending(observer);
+
+        if(!length)
+            continue;
+
+        if(!observer->dropping && !observer->terminate && length <= ring_free(observer))
+            ring_put(observer, s, length);
+        else if(!observer->dropping && observer->eol && *s == '<' && eol && length <= STREAM_MUX_REPORT_SIZE)
+            memcpy(observer->report, s, observer->report_length = length); // Hold back the latest status report
+        else {
+            if(!observer->dropping && !observer->eol && !observer->terminate)
+                drop_line(observer); // Start of the line is queued
+            observer->dropping = !eol;
+        }
+    }
+}
+
+static void mux_write (const char *s)
+{
+    ctrl_write(s);
+    fan_out(s);
+}
+
+static void mux_write_all (const char *s)
+{
+    ctrl_write_all(s);
+    fan_out(s);
+}
+
+bool stream_mux_is_observer (stream_type_t type)
+{
+    uint_fast8_t idx = STREAM_MUX_OBSERVERS;
+
+    while(idx) {
+        if(observers[--idx].active && observers[idx].stream.type == type)
+            return true;
+    }
+
+    return false;
+}
+
+bool stream_mux_attach (const stream_observer_t *stream)
+{
+    uint_fast8_t idx = STREAM_MUX_OBSERVERS;
+    observer_t *observer = NULL;
+
+    if(stream->type == hal.stream.type || stream_mux_is_observer(stream->type))
+        return false;
+
+    while(idx) {
+        if(!observers[--idx].active)
+            observer = &observers[idx];
+    }
+
+    if(observer) {
+        memcpy(&observer->stream, stream, sizeof(stream_observer_t));
+        observer->head = observer->tail = observer->line_start = observer->report_length = 0;
+        observer->dropping = observer->terminate = false;
+        observer->eol = true;
+        observer->active = true;
+    }
+
+    return observer != NULL;
+}
+
+void stream_mux_detach (stream_type_t type)
+{
+    uint_fast8_t idx = STREAM_MUX_OBSERVERS;
+
+    while(idx) {
+        if(observers[--idx].stream.type == type)
+            observers[idx].active = false;
+    }
+}
+
+void stream_mux_observer_input (char c)
+{
+    if(c == CMD_STATUS_REPORT || c == CMD_STATUS_REPORT_LEGACY)
+        hal.stream.enqueue_realtime_command(c);
+}
+
+void stream_mux_poll (void)
+{
+    uint_fast8_t idx = STREAM_MUX_OBSERVERS, active = 0;
+
+    while(idx) {
+
+        observer_t *observer = &observers[--idx];
+
+        if(!observer->active)
+            continue;
+
+        if(observer->stream.type == hal.stream.type) { // Observer has taken control
+            observer->active = false;
+            continue;
+        }
+
+        uint_fast16_t count = BUFCOUNT(observer->head, observer->tail, STREAM_MUX_TX_BUFFER_SIZE), chunk;
+
+        if(count > (chunk = observer->stream.get_tx_buffer_available()))
+            count = chunk;
+
+        if(count) {
+            if((chunk = STREAM_MUX_TX_BUFFER_SIZE - observer->tail) > count)
+                chunk = count;
+            observer->stream.write_n(&observer->data[observer->tail], chunk);
+            if(count > chunk)
+                observer->stream.write_n(observer->data, count - chunk);
+            observer->tail = (observer->tail + count) & (STREAM_MUX_TX_BUFFER_SIZE - 1);
+        }
+
+        queue_pending(observer);
+        active++;
+    }
+
+    // Insert output fan out when observers are attached, also after the controlling stream has been switched.
+    if(active) {
+        if(hal.stream.write != mux_write) {
+            ctrl_write = hal.stream.write;
+            hal.stream.write = mux_write;
+        }
+        if(hal.stream.write_all != mux_write_all) {
+            ctrl_write_all = hal.stream.write_all;
+            hal.stream.write_all = mux_write_all;
+        }
+    } else {
+        if(hal.stream.write == mux_write)
+            hal.stream.write = ctrl_write;
+        if(hal.stream.write_all == mux_write_all)
+            hal.stream.write_all = ctrl_write_all;
+    }
+}
+
+#endif
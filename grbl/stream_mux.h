@@ -0,0 +1,76 @@
+/*
+  stream_mux.h - copies output of the controlling stream to read-only observer streams
+
+  Part of GrblHAL
+
+  Copyright (c) 2020 Terje Io
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+/*
+  The controlling stream is the stream in hal.stream, input is only read from it. Observer streams, e.g. a
+  WebSocket dashboard and a Telnet logger, receive a copy of all output written to the controlling stream.
+
+  Output to each observer is queued in a separate ring buffer and is moved to the observer stream only as far
+  as the stream can accept it without blocking, a slow observer never stalls the controlling stream. When a
+  ring buffer is full output is dropped up to the end of the line. The start of a dropped line is removed from
+  the ring buffer if none of it has been sent yet, else it is terminated with an end of line so that the next
+  line does not run into it. Realtime status reports are not dropped: a report that does not fit replaces any
+  report previously held back and is queued at the next line boundary when space is available, the observer
+  thus always receives the latest report.
+
+  Input from observer streams is discarded, except for status report requests.
+*/
+
+#ifndef _STREAM_MUX_H_
+#define _STREAM_MUX_H_
+
+#ifndef STREAM_MUX_OBSERVERS
+#define STREAM_MUX_OBSERVERS 2
+#endif
+
+#ifndef STREAM_MUX_TX_BUFFER_SIZE
+#define STREAM_MUX_TX_BUFFER_SIZE 1024 // must be a power of 2
+#endif
+
+#ifndef STREAM_MUX_REPORT_SIZE
+#define STREAM_MUX_REPORT_SIZE 256 // Max length of a status report held back when the ring buffer is full
+#endif
+
+typedef void (*stream_write_n_ptr)(const char *s, unsigned int length);
+
+typedef struct {
+    stream_type_t type;
+    uint16_t (*get_tx_buffer_available)(void);  // Number of characters write_n() accepts without blocking.
+    stream_write_n_ptr write_n;
+} stream_observer_t;
+
+// Attaches an observer stream, returns false if all slots are in use or if the stream is the controlling stream or already attached.
+bool stream_mux_attach (const stream_observer_t *observer);
+
+// Detaches an observer stream, pending output is discarded.
+void stream_mux_detach (stream_type_t type);
+
+// Returns true if a stream of the given type is attached as an observer.
+bool stream_mux_is_observer (stream_type_t type);
+
+// Handles a character received from an observer stream, only status report requests are passed on.
+void stream_mux_observer_input (char c);
+
+// Moves queued output to observer streams, called from the realtime loop.
+void stream_mux_poll (void);
+
+#endif
@@ -31,6 +31,15 @@
 #ifdef KINEMATICS_API
 #include "kinematics.h"
 #endif
+#ifdef ENABLE_CREDIT_FLOW_CONTROL
+#include "flow_control.h"
+#endif
+#ifdef ENABLE_LATENCY_STATS
+#include "latency.h"
+#endif
+#ifdef ENABLE_STARVATION_STATS
+#include "starvation.h"
+#endif
 
 // Pin change interrupt for pin-out commands, i.e. cycle start, feed hold, and reset. Sets
 // only the realtime command execute variable to have the main program execute these when
@@ -423,6 +432,67 @@ status_code_t system_execute_line (char *line)
                 retval = Status_IdleError;
             break;
 
+#ifdef ENABLE_CREDIT_FLOW_CONTROL
+        case 'W': // Enable or disable credit based flow control
+            if (line[2] == '\0')
+                retval = flow_control_enable(FLOW_CONTROL_ACK_BATCH);
+            else {
+                uint_fast8_t counter = 3;
+                float parameter;
+                if (line[2] != '=')
+                    retval = Status_InvalidStatement;
+                else if (!read_float(line, &counter, &parameter) || line[counter] != '\0')
+                    retval = Status_BadNumberFormat;
+                else if (parameter - truncf(parameter) != 0.0f || parameter < 0.0f || parameter > 255.0f)
+                    retval = Status_InvalidStatement;
+                else
+                    retval = flow_control_enable((uint_fast8_t)parameter);
+            }
+            break;
+#endif
+
+#ifdef ENABLE_AUTO_REPORT
+        case 'A': // Subscribe to or cancel pushed status reports
+            {
+                uint_fast8_t counter = 3;
+                float interval, deadband = 0.0f;
+                bool ok = line[2] == '=' && read_float(line, &counter, &interval);
+                if (ok && line[counter] == ',') {
+                    counter++;
+                    ok = read_float(line, &counter, &deadband);
+                }
+                if (!ok || line[counter] != '\0')
+                    retval = Status_BadNumberFormat;
+                else if (!isintf(interval) || interval < 0.0f || deadband < 0.0f)
+                    retval = Status_InvalidStatement;
+                else
+                    retval = report_auto_enable((uint32_t)interval, deadband);
+            }
+            break;
+#endif
+
+#ifdef ENABLE_LATENCY_STATS
+        case 'L': // Report or clear latency statistics
+            if (line[2] == '\0')
+                latency_report();
+            else if (line[2] == 'R' && line[3] == '\0')
+                latency_reset();
+            else
+                retval = Status_InvalidStatement;
+            break;
+#endif
+
+#ifdef ENABLE_STARVATION_STATS
+        case 'V': // Report or clear planner and segment buffer starvation events
+            if (line[2] == '\0')
+                starvation_report();
+            else if (line[2] == 'R' && line[3] == '\0')
+                starvation_reset();
+            else
+                retval = Status_InvalidStatement;
+            break;
+#endif
+
 #ifdef DEBUGOUT
         case 'Q':
             nvs_memmap();
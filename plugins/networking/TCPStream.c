@@ -46,6 +46,18 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "TCPStream.h"
 
+#if TELNET_ZERO_COPY_RX
+#include "utils.h"
+#endif
+
+#ifdef ENABLE_CREDIT_FLOW_CONTROL
+#include "grbl/flow_control.h"
+#endif
+
+#ifdef ENABLE_STREAM_MUX
+#include "grbl/stream_mux.h"
+#endif
+
 typedef enum
 {
     TCPState_Idle,
@@ -57,6 +69,9 @@ typedef struct pbuf_entry
 {
     struct pbuf *pbuf;
     struct pbuf_entry *next;
+#if TELNET_ZERO_COPY_RX
+    bool ack;   // Acknowledge data to the connection when the packet is released
+#endif
 } pbuf_entry_t;
 
 typedef struct
@@ -64,6 +79,9 @@ typedef struct
     uint16_t port;
     TCPState_t state;
     bool linkLost;
+#ifdef ENABLE_STREAM_MUX
+    bool observer;              // Connection is attached as a read-only observer
+#endif
     uint32_t timeout;
     uint32_t timeoutMax;
     struct tcp_pcb *pcbConnect;
@@ -71,6 +89,18 @@ typedef struct
     pbuf_entry_t queue[PBUF_POOL_SIZE];
     pbuf_entry_t *rcvTail;
     pbuf_entry_t *rcvHead;
+#if TELNET_ZERO_COPY_RX
+    // Packets from rcvTail to rcvRead are consumed and to be released, from rcvRead to rcvFiltered are available
+    // for reading and from rcvFiltered to rcvHead are to be scanned for realtime commands.
+    pbuf_entry_t * volatile rcvRead;
+    pbuf_entry_t * volatile rcvFiltered;
+    pbuf_entry_t * volatile rcvFlushTo;
+    volatile uint8_t flushRequest;
+    uint8_t flushSeen;
+    volatile bool rxCancel;
+    bool cancelPending;
+    volatile uint32_t rxQueued;
+#endif
     struct pbuf *pbufHead;
     struct pbuf *pbufCurrent;
     uint32_t bufferIndex;
@@ -106,6 +136,14 @@ static const sessiondata_t defaultSettings =
 
 static sessiondata_t streamSession;
 
+#ifdef ENABLE_STREAM_MUX
+static const stream_observer_t observer = {
+    .type = StreamType_Telnet,
+    .get_tx_buffer_available = TCPStreamTxFree,
+    .write_n = TCPStreamWrite
+};
+#endif
+
 void TCPStreamInit (void)
 {
     memcpy(&streamSession, &defaultSettings, sizeof(sessiondata_t));
@@ -117,8 +155,156 @@ void TCPStreamInit (void)
     }
 
     streamSession.rcvTail = streamSession.rcvHead = &streamSession.queue[0];
+#if TELNET_ZERO_COPY_RX
+    streamSession.rcvRead = streamSession.rcvFiltered = streamSession.rcvTail;
+#endif
+}
+
+#if TELNET_ZERO_COPY_RX
+
+//
+// TCPStreamReadSpan - releases consumed characters and returns the number of contiguous characters
+// available in the packet currently read, data is set to point to the first of them.
+//
+uint_fast16_t TCPStreamReadSpan (char **data, uint_fast16_t consumed)
+{
+    static char cancel = ASCII_CAN;
+
+    // Discard input received before a flush request
+    if(streamSession.flushSeen != streamSession.flushRequest) {
+        streamSession.flushSeen = streamSession.flushRequest;
+        streamSession.rcvRead = streamSession.rcvFlushTo;
+        streamSession.pbufCurrent = NULL;
+        streamSession.cancelPending = streamSession.rxCancel;
+        streamSession.rxCancel = false;
+        consumed = 0;
+    }
+
+    if(streamSession.cancelPending) {
+        if(!consumed) {
+            *data = &cancel;
+            return 1;
+        }
+        streamSession.cancelPending = false;
+        consumed = 0;
+    }
+
+    streamSession.bufferIndex += consumed;
+
+    while(true) {
+
+        if(streamSession.pbufCurrent == NULL) {
+            if(streamSession.rcvRead == streamSession.rcvFiltered)
+                return 0; // no data available
+            streamSession.pbufCurrent = streamSession.rcvRead->pbuf;
+            streamSession.bufferIndex = 0;
+        }
+
+        if(streamSession.bufferIndex < streamSession.pbufCurrent->len)
+            break;
+
+        streamSession.bufferIndex = 0;
+        if((streamSession.pbufCurrent = streamSession.pbufCurrent->next) == NULL)
+            streamSession.rcvRead = streamSession.rcvRead->next; // Hand packet back for release by TCPStreamPoll()
+    }
+
+    *data = (char *)streamSession.pbufCurrent->payload + streamSession.bufferIndex;
+
+    return streamSession.pbufCurrent->len - streamSession.bufferIndex;
+}
+
+//
+// TCPStreamGetC - returns -1 if no data available
+//
+int16_t TCPStreamGetC (void)
+{
+    char *data;
+    int16_t c;
+
+    if(!TCPStreamReadSpan(&data, 0))
+        return -1; // no data available else EOF
+
+    c = *data;
+    TCPStreamReadSpan(&data, 1);
+
+    return c;
+}
+
+inline uint16_t TCPStreamRxCount (void)
+{
+    return (uint16_t)streamSession.rxQueued;
+}
+
+// Received data is held in packets not yet acknowledged to the sender, the TCP window is the buffer size.
+uint16_t TCPStreamRxFree (void)
+{
+    uint32_t queued = streamSession.rxQueued;
+
+    return queued >= TCP_WND ? 0 : (uint16_t)(TCP_WND - queued);
+}
+
+// Requests input available for reading to be discarded, may be called from TCPStreamPoll() context
+// by a realtime command picked out.
+void TCPStreamRxFlush (void)
+{
+    streamSession.rcvFlushTo = streamSession.rcvFiltered;
+    streamSession.flushRequest++;
 }
 
+void TCPStreamRxCancel (void)
+{
+    streamSession.rxCancel = true;
+    TCPStreamRxFlush();
+}
+
+// Removes realtime commands from the packet chain, compacting the payload of each buffer.
+// Tail of chain is dropped if the input is flushed by a command.
+static void streamFilterRX (struct pbuf *p)
+{
+    char *src, *dst, *end, *rt;
+    uint8_t flushRequest;
+    struct pbuf *q, *r;
+
+    for(q = p; q != NULL; q = q->next) {
+
+        // discard input if MPG has taken over...
+        if(hal.stream.type == StreamType_MPG) {
+            q->len = 0;
+            continue;
+        }
+
+        src = dst = q->payload;
+        end = src + q->len;
+
+        while(src < end) {
+
+            rt = scan_for_rt_commands(src, end);
+
+            if(dst != src)
+                memmove(dst, src, rt - src);
+            dst += rt - src;
+
+            if((src = rt) < end) {
+                flushRequest = streamSession.flushRequest;
+                if(!hal.stream.enqueue_realtime_command(*src))
+                    *dst++ = *src;
+                src++;
+                if(flushRequest != streamSession.flushRequest) {
+                    // Input was flushed, drop data preceding the command as well
+                    for(r = p; r != q; r = r->next)
+                        r->len = 0;
+                    dst = q->payload;
+                }
+            }
+        }
+
+        // NOTE: tot_len is left as received for acknowledging the data on release.
+        q->len = dst - (char *)q->payload;
+    }
+}
+
+#else
+
 //
 // TCPStreamGetC - returns -1 if no data available
 //
@@ -178,6 +364,8 @@ static bool streamBufferRX (char c)
     return !streamSession.rxbuf.overflow;
 }
 
+#endif // TELNET_ZERO_COPY_RX
+
 bool TCPStreamPutC (const char c)
 {
     uint32_t next_head = (streamSession.txbuf.head + 1) & (TX_BUFFER_SIZE - 1);  // Get and update head pointer
@@ -193,47 +381,62 @@ bool TCPStreamPutC (const char c)
     return true;
 }
 
-void TCPStreamWriteS (const char *data)
-{
-    char c, *ptr = (char *)data;
 
-    while((c = *ptr++) != '\0')
-        TCPStreamPutC(c);
+uint16_t TCPStreamTxCount(void) {
+
+    uint_fast16_t head = streamSession.txbuf.head, tail = streamSession.txbuf.tail;
+
+    return BUFCOUNT(head, tail, TX_BUFFER_SIZE);
 }
 
-void TCPStreamWriteLn (const char *data)
-{
-    TCPStreamWriteS(data);
-    TCPStreamWriteS(ASCII_EOL);
+uint16_t TCPStreamTxFree(void) {
+
+    return (TX_BUFFER_SIZE - 1) - TCPStreamTxCount();
 }
 
+//
+// TCPStreamWrite - copies data to the transmit buffer in at most two chunks per block of free space
+//
 void TCPStreamWrite (const char *data, unsigned int length)
 {
-    char *ptr = (char *)data;
+    uint_fast16_t head, space, chunk;
 
-    while(length--)
-        TCPStreamPutC(*ptr++);
-}
+    while(length) {
 
-uint16_t TCPStreamTxCount(void) {
+        head = streamSession.txbuf.head;
 
-    uint_fast16_t head = streamSession.txbuf.head, tail = streamSession.txbuf.tail;
+        if((space = (TX_BUFFER_SIZE - 1) - TCPStreamTxCount()) == 0) {  // Buffer full, block until space is available...
+            if(!hal.stream_blocking_callback())
+                return;
+            continue;
+        }
 
-    return BUFCOUNT(head, tail, TX_BUFFER_SIZE);
-}
+        if(space > length)
+            space = length;
 
-static int16_t streamReadTXC (void)
-{
-    int16_t data;
-    uint_fast16_t bptr = streamSession.txbuf.tail;
+        if((chunk = TX_BUFFER_SIZE - head) > space)                 // Space up to end of buffer
+            chunk = space;
 
-    if(bptr == streamSession.txbuf.head)
-        return -1; // no data available else EOF
+        memcpy(&streamSession.txbuf.data[head], data, chunk);       // Add data to buffer,
+        if(space > chunk)
+            memcpy(streamSession.txbuf.data, data + chunk, space - chunk);
 
-    data = streamSession.txbuf.data[bptr++];                 // Get next character, increment tmp pointer
-    streamSession.txbuf.tail = bptr & (TX_BUFFER_SIZE - 1);  // and update pointer
+        streamSession.txbuf.head = (head + space) & (TX_BUFFER_SIZE - 1); // update head pointer once
 
-    return data;
+        data += space;
+        length -= space;
+    }
+}
+
+void TCPStreamWriteS (const char *data)
+{
+    TCPStreamWrite(data, strlen(data));
+}
+
+void TCPStreamWriteLn (const char *data)
+{
+    TCPStreamWriteS(data);
+    TCPStreamWrite(ASCII_EOL, sizeof(ASCII_EOL) - 1);
 }
 
 void TCPStreamTxFlush (void)
@@ -241,6 +444,47 @@ void TCPStreamTxFlush (void)
     streamSession.txbuf.tail = streamSession.txbuf.head;
 }
 
+#if TELNET_ZERO_COPY_RX
+
+// Releases packets handed back by the reader
+static void streamReleaseBuffers (sessiondata_t *session)
+{
+    while(session->rcvTail != session->rcvRead) {
+        if(session->rcvTail->ack && session->pcbConnect)
+            tcp_recved(session->pcbConnect, session->rcvTail->pbuf->tot_len);
+        session->rxQueued -= session->rcvTail->pbuf->tot_len;
+        pbuf_free(session->rcvTail->pbuf);
+        session->rcvTail = session->rcvTail->next;
+    }
+}
+
+static void streamFreeBuffers (sessiondata_t *session)
+{
+    pbuf_entry_t *entry;
+
+    SYS_ARCH_DECL_PROTECT(lev);
+    SYS_ARCH_PROTECT(lev);
+
+    // Free packets not yet available for reading
+    for(entry = session->rcvFiltered; entry != session->rcvHead; entry = entry->next) {
+        session->rxQueued -= entry->pbuf->tot_len;
+        pbuf_free(entry->pbuf);
+    }
+    session->rcvHead = session->rcvFiltered;
+
+    // Packets available for reading may be in use by the reader, request them to be handed back
+    // and release them later without acknowledging the data.
+    for(entry = session->rcvTail; entry != session->rcvHead; entry = entry->next)
+        entry->ack = false;
+
+    TCPStreamRxFlush();
+    streamReleaseBuffers(session);
+
+    SYS_ARCH_UNPROTECT(lev);
+}
+
+#else
+
 static void streamFreeBuffers (sessiondata_t *session)
 {
     SYS_ARCH_DECL_PROTECT(lev);
@@ -262,6 +506,8 @@ static void streamFreeBuffers (sessiondata_t *session)
     SYS_ARCH_UNPROTECT(lev);
 }
 
+#endif
+
 void TCPStreamNotifyLinkStatus (bool up)
 {
     if(!up)
@@ -279,11 +525,19 @@ static void streamError (void *arg, err_t err)
     session->lastErr = err;
     session->pcbConnect = NULL;
     session->timeout = 0;
+#if !TELNET_ZERO_COPY_RX
     session->pbufHead = session->pbufCurrent = NULL;
     session->bufferIndex = 0;
+    session->rcvTail = session->rcvHead;
+#endif
     session->lastSendTime = 0;
     session->linkLost = false;
-    session->rcvTail = session->rcvHead;
+#ifdef ENABLE_STREAM_MUX
+    if(session->observer) {
+        session->observer = false;
+        stream_mux_detach(StreamType_Telnet);
+    }
+#endif
 }
 
 static err_t streamPoll (void *arg, struct tcp_pcb *pcb)
@@ -313,6 +567,14 @@ static void closeSocket (sessiondata_t *session, struct tcp_pcb *pcb)
     session->pcbConnect = NULL;
     session->state = TCPState_Listen;
 
+#ifdef ENABLE_STREAM_MUX
+    if(session->observer) {
+        session->observer = false;
+        stream_mux_detach(StreamType_Telnet);
+        return;
+    }
+#endif
+
     // Switch grbl I/O stream back to UART
     selectStream(StreamType_Serial);
 }
@@ -327,16 +589,40 @@ static err_t streamReceive (void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_
         sessiondata_t *session = arg;
 
         if(p) {
+#ifdef ENABLE_STREAM_MUX
+            if(session->observer) {
+                // Read-only connection, pass on status report requests only
+                struct pbuf *q;
+                for(q = p; q != NULL; q = q->next) {
+                    uint_fast16_t idx;
+                    for(idx = 0; idx < q->len; idx++)
+                        stream_mux_observer_input(((char *)q->payload)[idx]);
+                }
+                tcp_recved(pcb, p->tot_len);
+                pbuf_free(p);
+                return ERR_OK;
+            }
+#endif
             // Attempt to queue data
             SYS_ARCH_DECL_PROTECT(lev);
             SYS_ARCH_PROTECT(lev);
 
             if(session->rcvHead->next == session->rcvTail) {
+#if TELNET_ZERO_COPY_RX
+                // Queue full, let lwIP hold on to the packet and deliver it again later
+                SYS_ARCH_UNPROTECT(lev);
+                return ERR_MEM;
+#else
                 // Queue full, discard
                 SYS_ARCH_UNPROTECT(lev);
                 pbuf_free(p);
+#endif
             } else {
                 session->rcvHead->pbuf = p;
+#if TELNET_ZERO_COPY_RX
+                session->rcvHead->ack = true;
+                session->rxQueued += p->tot_len;
+#endif
                 session->rcvHead = session->rcvHead->next;
                 SYS_ARCH_UNPROTECT(lev);
             }
@@ -387,6 +673,19 @@ static err_t TCPStreamAccept (void *arg, struct tcp_pcb *pcb, err_t err)
     tcp_poll(pcb, streamPoll, 1000 / TCP_SLOW_INTERVAL);
     tcp_sent(pcb, streamSent);
 
+#ifdef ENABLE_STREAM_MUX
+    // Attach as an observer if the WebSocket stream is in control
+    if((session->observer = hal.stream.type == StreamType_WebSocket && stream_mux_attach(&observer)))
+        return ERR_OK;
+#endif
+
+#ifdef ENABLE_CREDIT_FLOW_CONTROL
+    flow_control_reset(); // New connection, host has to enable flow control again
+#endif
+#ifdef ENABLE_AUTO_REPORT
+    report_auto_reset(); // and subscribe to status reports
+#endif
+
     // Switch grbl I/O stream to TCP/IP connection
     selectStream(StreamType_Telnet);
 
@@ -414,12 +713,22 @@ void TCPStreamClose (void)
     streamSession.state = TCPState_Idle;
     streamSession.pcbConnect = streamSession.pcbListen = NULL;
     streamSession.timeout = 0;
+#if !TELNET_ZERO_COPY_RX
     streamSession.rcvTail = streamSession.rcvHead;
     streamSession.pbufHead = streamSession.pbufCurrent = NULL;
     streamSession.bufferIndex = 0;
+#endif
     streamSession.lastSendTime = 0;
     streamSession.linkLost = false;
 
+#ifdef ENABLE_STREAM_MUX
+    if(streamSession.observer) {
+        streamSession.observer = false;
+        stream_mux_detach(StreamType_Telnet);
+        return;
+    }
+#endif
+
     // Switch grbl I/O stream back to UART
     selectStream(StreamType_Serial);
 }
@@ -433,9 +742,11 @@ void TCPStreamListen (uint16_t port)
     streamSession.timeout = 0;
     streamSession.timeoutMax = SOCKET_TIMEOUT;
     streamSession.port = port;
+#if !TELNET_ZERO_COPY_RX
     streamSession.rcvTail = streamSession.rcvHead;
     streamSession.pbufHead = streamSession.pbufCurrent = NULL;
     streamSession.bufferIndex = 0;
+#endif
     streamSession.lastSendTime = 0;
     streamSession.linkLost = false;
 
@@ -453,7 +764,21 @@ void TCPStreamListen (uint16_t port)
 //
 void TCPStreamPoll (void)
 {
-    static uint8_t tempBuffer[PBUF_POOL_BUFSIZE];
+#if TELNET_ZERO_COPY_RX
+
+    // 1. Release packets consumed, also after the connection is closed
+    streamReleaseBuffers(&streamSession);
+
+    if(streamSession.state != TCPState_Connected)
+        return;
+
+    // and pick out realtime commands from packets received, making them available for reading
+    while(streamSession.rcvFiltered != streamSession.rcvHead) {
+        streamFilterRX(streamSession.rcvFiltered->pbuf);
+        streamSession.rcvFiltered = streamSession.rcvFiltered->next;
+    }
+
+#else
 
     if(streamSession.state != TCPState_Connected)
         return;
@@ -495,31 +820,34 @@ void TCPStreamPoll (void)
         }
     }
 
+#endif // TELNET_ZERO_COPY_RX
+
 //    tcp_output(streamSession.pcbConnect);
 
-    int_fast16_t TXCount;
+    uint_fast16_t TXCount;
 
-    // 2. Process output stream
+    // 2. Process output stream, data is passed to lwIP directly from the transmit buffer
     if((TXCount = TCPStreamTxCount()) && tcp_sndbuf(streamSession.pcbConnect) && streamSession.pcbConnect->snd_queuelen < TCP_SND_QUEUELEN) {
 
-        uint_fast16_t idx;
+        uint_fast16_t tail = streamSession.txbuf.tail, chunk;
 
         if(TXCount > tcp_sndbuf(streamSession.pcbConnect))
             TXCount = tcp_sndbuf(streamSession.pcbConnect);
 
         while(TXCount && streamSession.pcbConnect->snd_queuelen < TCP_SND_QUEUELEN)
         {
-            idx = 0;
+            if((chunk = TX_BUFFER_SIZE - tail) > TXCount) // Data up to end of buffer
+                chunk = TXCount;
 
-            while(TXCount && idx < sizeof(tempBuffer)) {
-                tempBuffer[idx] = (uint8_t)streamReadTXC();
-                idx++;
-                TXCount--;
-            }
+            if(tcp_write(streamSession.pcbConnect, &streamSession.txbuf.data[tail], (u16_t)chunk, 1) != ERR_OK)
+                break;
 
-            tcp_write(streamSession.pcbConnect, tempBuffer, (u16_t)idx, 1);
+            tail = (tail + chunk) & (TX_BUFFER_SIZE - 1);
+            TXCount -= chunk;
         }
 
+        streamSession.txbuf.tail = tail;
+
         tcp_output(streamSession.pcbConnect);
         streamSession.lastSendTime = xTaskGetTickCount();
     }
@@ -39,17 +39,27 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef __TCPSTREAM_H__
 #define __TCPSTREAM_H__
 
+// Set to 1 to keep received packets queued and read input directly from them instead of copying it to
+// the input buffer, realtime commands are picked out when packets are received.
+#ifndef TELNET_ZERO_COPY_RX
+#define TELNET_ZERO_COPY_RX 0
+#endif
+
 void TCPStreamInit(void);
 void TCPStreamListen(uint16_t port);
 void TCPStreamClose(void);
 void TCPStreamPoll(void);
 void TCPStreamNotifyLinkStatus(bool bLinkStatusUp);
 int16_t TCPStreamGetC(void);
+#if TELNET_ZERO_COPY_RX
+uint_fast16_t TCPStreamReadSpan(char **data, uint_fast16_t consumed);
+#endif
 bool TCPStreamPutC(const char data);
 void TCPStreamWriteS(const char *data);
 void TCPStreamWriteLn(const char *data);
 void TCPStreamWrite(const char *data, unsigned int length);
 uint16_t TCPStreamTxCount(void);
+uint16_t TCPStreamTxFree(void);
 uint16_t TCPStreamRxCount(void);
 uint16_t TCPStreamRxFree(void);
 void TCPStreamRxFlush(void);
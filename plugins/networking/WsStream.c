@@ -52,6 +52,14 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "grbl/grbl.h"
 
+#ifdef ENABLE_CREDIT_FLOW_CONTROL
+#include "grbl/flow_control.h"
+#endif
+
+#ifdef ENABLE_STREAM_MUX
+#include "grbl/stream_mux.h"
+#endif
+
 //#define WSDEBUG
 
 #define CRLF "\r\n"
@@ -126,6 +134,9 @@ typedef struct ws_sessiondata
     ws_frame_start_t start;
     frame_header_t header;
     bool linkLost;
+#ifdef ENABLE_STREAM_MUX
+    bool observer;              // Connection is attached as a read-only observer
+#endif
     uint32_t timeout;
     uint32_t timeoutMax;
     struct tcp_pcb *pcbConnect;
@@ -144,6 +155,7 @@ typedef struct ws_sessiondata
     uint8_t reconnectCount;
     uint8_t connectCount;
     uint8_t pingCount;
+    uint_fast16_t txPending; // Number of characters pending without a complete message at last poll
     char *http_request;
     uint32_t hdrsize;
     void (*traffic_handler)(struct ws_sessiondata *session);
@@ -196,6 +208,14 @@ static const ws_sessiondata_t defaultSettings =
 
 static ws_sessiondata_t streamSession;
 
+#ifdef ENABLE_STREAM_MUX
+static const stream_observer_t observer = {
+    .type = StreamType_WebSocket,
+    .get_tx_buffer_available = WsStreamTxFree,
+    .write_n = WsStreamWrite
+};
+#endif
+
 void WsStreamInit (void)
 {
     memcpy(&streamSession, &defaultSettings, sizeof(ws_sessiondata_t));
@@ -252,6 +272,14 @@ void WsStreamRxCancel (void)
 
 bool WsStreamRxInsert (char c)
 {
+#ifdef ENABLE_STREAM_MUX
+    // Read-only connection, pass on status report requests only
+    if(streamSession.observer) {
+        stream_mux_observer_input(c);
+        return true;
+    }
+#endif
+
     // discard input if MPG has taken over...
     if(hal.stream.type != StreamType_MPG) {
 
@@ -283,47 +311,62 @@ bool WsStreamPutC (const char c) {
     return true;
 }
 
-void WsStreamWriteS (const char *data)
-{
-    char c, *ptr = (char *)data;
 
-    while((c = *ptr++) != '\0')
-        WsStreamPutC(c);
+uint16_t WsStreamTxCount(void) {
+
+    uint_fast16_t head = streamSession.txbuf.head, tail = streamSession.txbuf.tail;
+
+    return BUFCOUNT(head, tail, TX_BUFFER_SIZE);
 }
 
-void WsStreamWriteLn (const char *data)
-{
-    WsStreamWriteS(data);
-    WsStreamWriteS(ASCII_EOL);
+uint16_t WsStreamTxFree(void) {
+
+    return (TX_BUFFER_SIZE - 1) - WsStreamTxCount();
 }
 
+//
+// WsStreamWrite - copies data to the transmit buffer in at most two chunks per block of free space
+//
 void WsStreamWrite (const char *data, unsigned int length)
 {
-    char *ptr = (char *)data;
+    uint_fast16_t head, space, chunk;
 
-    while(length--)
-        WsStreamPutC(*ptr++);
-}
+    while(length) {
 
-uint16_t WsStreamTxCount(void) {
+        head = streamSession.txbuf.head;
 
-    uint_fast16_t head = streamSession.txbuf.head, tail = streamSession.txbuf.tail;
+        if((space = (TX_BUFFER_SIZE - 1) - WsStreamTxCount()) == 0) {  // Buffer full, block until space is available...
+            if(!hal.stream_blocking_callback())
+                return;
+            continue;
+        }
 
-    return BUFCOUNT(head, tail, TX_BUFFER_SIZE);
-}
+        if(space > length)
+            space = length;
 
-static int16_t streamReadTXC (void)
-{
-    int16_t data;
-    uint_fast16_t bptr = streamSession.txbuf.tail;
+        if((chunk = TX_BUFFER_SIZE - head) > space)                 // Space up to end of buffer
+            chunk = space;
 
-    if(bptr == streamSession.txbuf.head)
-        return -1; // no data available else EOF
+        memcpy(&streamSession.txbuf.data[head], data, chunk);       // Add data to buffer,
+        if(space > chunk)
+            memcpy(streamSession.txbuf.data, data + chunk, space - chunk);
 
-    data = streamSession.txbuf.data[bptr++];                 // Get next character, increment tmp pointer
-    streamSession.txbuf.tail = bptr & (TX_BUFFER_SIZE - 1);  // and update pointer
+        streamSession.txbuf.head = (head + space) & (TX_BUFFER_SIZE - 1); // update head pointer once
 
-    return data;
+        data += space;
+        length -= space;
+    }
+}
+
+void WsStreamWriteS (const char *data)
+{
+    WsStreamWrite(data, strlen(data));
+}
+
+void WsStreamWriteLn (const char *data)
+{
+    WsStreamWriteS(data);
+    WsStreamWrite(ASCII_EOL, sizeof(ASCII_EOL) - 1);
 }
 
 void WsStreamTxFlush (void)
@@ -384,6 +427,12 @@ static void streamError (void *arg, err_t err)
     streamSession->lastSendTime = 0;
     streamSession->linkLost = false;
     streamSession->rcvTail = streamSession->rcvHead;
+#ifdef ENABLE_STREAM_MUX
+    if(streamSession->observer) {
+        streamSession->observer = false;
+        stream_mux_detach(StreamType_WebSocket);
+    }
+#endif
 }
 
 static err_t streamPoll (void *arg, struct tcp_pcb *pcb)
@@ -414,6 +463,14 @@ static void closeSocket (ws_sessiondata_t *session, struct tcp_pcb *pcb)
     session->state = WsState_Listen;
     session->traffic_handler = WsConnectionHandler;
 
+#ifdef ENABLE_STREAM_MUX
+    if(session->observer) {
+        session->observer = false;
+        stream_mux_detach(StreamType_WebSocket);
+        return;
+    }
+#endif
+
     // Switch grbl I/O stream back to UART
     selectStream(StreamType_Serial);
 }
@@ -526,6 +583,14 @@ void WsStreamClose (void)
     streamSession.lastSendTime = 0;
     streamSession.linkLost = false;
 
+#ifdef ENABLE_STREAM_MUX
+    if(streamSession.observer) {
+        streamSession.observer = false;
+        stream_mux_detach(StreamType_WebSocket);
+        return;
+    }
+#endif
+
     // Switch grbl I/O stream back to UART
     selectStream(StreamType_Serial);
 }
@@ -721,7 +786,19 @@ static void WsConnectionHandler (ws_sessiondata_t *session)
                     http_write(session->pcbConnect, response, (u16_t *)&len, 1);
                     session->traffic_handler = WsStreamHandler;
                     session->lastSendTime = xTaskGetTickCount();
-                    selectStream(StreamType_WebSocket);
+#ifdef ENABLE_STREAM_MUX
+                    // Attach as an observer if the Telnet stream is in control
+                    if(!(session->observer = hal.stream.type == StreamType_Telnet && stream_mux_attach(&observer)))
+#endif
+                    {
+#ifdef ENABLE_CREDIT_FLOW_CONTROL
+                        flow_control_reset(); // New connection, host has to enable flow control again
+#endif
+#ifdef ENABLE_AUTO_REPORT
+                        report_auto_reset(); // and subscribe to status reports
+#endif
+                        selectStream(StreamType_WebSocket);
+                    }
                 }
             }
         }
@@ -938,7 +1015,7 @@ static uint32_t WsParse (ws_sessiondata_t *session, uint8_t *payload, uint32_t l
 
 static void WsStreamHandler (ws_sessiondata_t *session)
 {
-    static uint8_t tempBuffer[PBUF_POOL_BUFSIZE];
+    static uint8_t tempBuffer[4];
 
     uint8_t *payload = session->pbufCurrent ? session->pbufCurrent->payload : NULL;
 
@@ -989,47 +1066,69 @@ static void WsStreamHandler (ws_sessiondata_t *session)
 
 //    tcp_output(session->pcbConnect);
 
-    uint_fast16_t TXCount;
+    uint_fast16_t TXCount, TXPending;
 
-    // 2. Process output stream
-    if((TXCount = WsStreamTxCount()) && tcp_sndbuf(session->pcbConnect) > 4) {
+    // 2. Process output stream, a frame carries whole messages (lines) unless the data pending does not fit
+    //    or is not terminated by the next poll. Data is passed to lwIP directly from the transmit buffer.
+    //    The header and the one or two payload chunks are separate writes so room for three is required.
+    if((TXCount = TXPending = WsStreamTxCount()) && tcp_sndbuf(session->pcbConnect) > 4 && tcp_sndqueuelen(session->pcbConnect) + 3 <= TCP_SND_QUEUELEN) {
 
-        int16_t c;
-        uint_fast16_t idx = 0;
+        uint_fast16_t idx = 0, tail = session->txbuf.tail, chunk;
 
         if(TXCount > tcp_sndbuf(session->pcbConnect) - 4)
             TXCount = tcp_sndbuf(session->pcbConnect) - 4;
 
-        if(TXCount > sizeof(tempBuffer) - 4)
-            TXCount = sizeof(tempBuffer) - 4;
-
-        tempBuffer[idx++] = session->ftype.token;
-        tempBuffer[idx++] = TXCount < 126 ? TXCount : 126;
-        if(TXCount >= 126) {
-            tempBuffer[idx++] = (TXCount >> 8) & 0xFF;
-            tempBuffer[idx++] = TXCount & 0xFF;
+        if(TXCount == TXPending && TXPending != session->txPending) {
+            // Trim frame to end of last complete message
+            while(TXCount && session->txbuf.data[(tail + TXCount - 1) & (TX_BUFFER_SIZE - 1)] != ASCII_LF)
+                TXCount--;
         }
 
-        while(TXCount) {
-            if((c = (uint8_t)streamReadTXC()) == -1)
-                break;
-            tempBuffer[idx++] = (uint8_t)c;
-            TXCount--;
-        }
+        // Wait for the message to be completed if none is
+        session->txPending = TXCount ? 0 : TXPending;
+
+        if(TXCount) {
+
+            tempBuffer[idx++] = session->ftype.token;
+            tempBuffer[idx++] = TXCount < 126 ? TXCount : 126;
+            if(TXCount >= 126) {
+                tempBuffer[idx++] = (TXCount >> 8) & 0xFF;
+                tempBuffer[idx++] = TXCount & 0xFF;
+            }
 
 #ifdef WSDEBUG
     DEBUG_PRINT(uitoa(tempBuffer[1]));
     DEBUG_PRINT(" - ");
     DEBUG_PRINT(uitoa(idx));
     DEBUG_PRINT(" - ");
-    DEBUG_PRINT(uitoa(plen));
+    DEBUG_PRINT(uitoa(TXCount));
     DEBUG_PRINT("\r\n");
 #endif
 
-        tcp_write(session->pcbConnect, tempBuffer, (u16_t)idx, 1);
-        tcp_output(session->pcbConnect);
+            if(tcp_write(session->pcbConnect, tempBuffer, (u16_t)idx, 1) == ERR_OK) {
+
+                while(TXCount) {
+
+                    if((chunk = TX_BUFFER_SIZE - tail) > TXCount) // Data up to end of buffer
+                        chunk = TXCount;
+
+                    if(tcp_write(session->pcbConnect, &session->txbuf.data[tail], (u16_t)chunk, 1) != ERR_OK) {
+                        // The header is queued with the full length, framing cannot be recovered.
+                        tcp_abort(session->pcbConnect); // streamError() resets the session
+                        return;
+                    }
+
+                    tail = (tail + chunk) & (TX_BUFFER_SIZE - 1);
+                    TXCount -= chunk;
+                }
+
+                session->txbuf.tail = tail;
+            }
 
-        session->lastSendTime = xTaskGetTickCount();
+            tcp_output(session->pcbConnect);
+
+            session->lastSendTime = xTaskGetTickCount();
+        }
     }
 
     // Send ping every 3 seconds if no outgoing traffic.
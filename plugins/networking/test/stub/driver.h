@@ -0,0 +1,17 @@
+//
+// driver.h - driver stand-in for the host test harness
+//
+// Part of GrblHAL
+//
+
+#ifndef __DRIVER_H__
+#define __DRIVER_H__
+
+#include "grbl/hal.h"
+
+#define TELNET_ENABLE       1
+#define WEBSOCKET_ENABLE    0
+
+void selectStream (stream_type_t stream);
+
+#endif
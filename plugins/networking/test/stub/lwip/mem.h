@@ -0,0 +1,3 @@
+//
+// mem.h - empty, the host test harness only uses the raw TCP API in tcp.h
+//
@@ -0,0 +1,14 @@
+//
+// sys.h - minimal lwIP system API for the host test harness
+//
+// Part of GrblHAL
+//
+
+#ifndef __LWIP_SYS_H__
+#define __LWIP_SYS_H__
+
+#include <stdint.h>
+
+uint32_t sys_now (void);
+
+#endif
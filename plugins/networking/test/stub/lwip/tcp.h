@@ -0,0 +1,70 @@
+//
+// tcp.h - minimal lwIP raw TCP API for the host test harness, implemented in lwip_stub.c
+//
+// Part of GrblHAL
+//
+
+#ifndef __LWIP_TCP_H__
+#define __LWIP_TCP_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef uint8_t u8_t;
+typedef uint16_t u16_t;
+typedef uint32_t u32_t;
+typedef int8_t err_t;
+
+#define ERR_OK      0
+#define ERR_MEM     -1
+#define ERR_CONN    -11
+#define ERR_ABRT    -13
+
+#define TCP_PRIO_MIN    1
+#define IP_ADDR_ANY     NULL
+
+struct pbuf {
+    struct pbuf *next;
+    void *payload;
+    u16_t tot_len;
+    u16_t len;
+};
+
+struct tcp_pcb;
+
+typedef err_t (*tcp_accept_fn)(void *arg, struct tcp_pcb *newpcb, err_t err);
+typedef err_t (*tcp_recv_fn)(void *arg, struct tcp_pcb *tpcb, struct pbuf *p, err_t err);
+typedef err_t (*tcp_sent_fn)(void *arg, struct tcp_pcb *tpcb, u16_t len);
+typedef err_t (*tcp_poll_fn)(void *arg, struct tcp_pcb *tpcb);
+typedef void (*tcp_err_fn)(void *arg, err_t err);
+
+struct tcp_pcb {
+    void *arg;
+    tcp_accept_fn accept;
+    tcp_recv_fn recv;
+    tcp_err_fn errf;
+    u16_t snd_queuelen;
+    u16_t snd_buf;
+};
+
+#define tcp_sndbuf(pcb) ((pcb)->snd_buf)
+#define tcp_accepted(pcb)
+#define tcp_listen(pcb) (pcb)
+
+struct tcp_pcb *tcp_new (void);
+err_t tcp_bind (struct tcp_pcb *pcb, const void *ipaddr, u16_t port);
+void tcp_arg (struct tcp_pcb *pcb, void *arg);
+void tcp_accept (struct tcp_pcb *pcb, tcp_accept_fn accept);
+void tcp_recv (struct tcp_pcb *pcb, tcp_recv_fn recv);
+void tcp_sent (struct tcp_pcb *pcb, tcp_sent_fn sent);
+void tcp_err (struct tcp_pcb *pcb, tcp_err_fn err);
+void tcp_poll (struct tcp_pcb *pcb, tcp_poll_fn poll, u8_t interval);
+void tcp_setprio (struct tcp_pcb *pcb, u8_t prio);
+void tcp_recved (struct tcp_pcb *pcb, u16_t len);
+err_t tcp_write (struct tcp_pcb *pcb, const void *dataptr, u16_t len, u8_t apiflags);
+err_t tcp_output (struct tcp_pcb *pcb);
+err_t tcp_close (struct tcp_pcb *pcb);
+void tcp_abort (struct tcp_pcb *pcb);
+u8_t pbuf_free (struct pbuf *p);
+
+#endif
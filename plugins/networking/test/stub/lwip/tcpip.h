@@ -0,0 +1,3 @@
+//
+// tcpip.h - empty, the host test harness only uses the raw TCP API in tcp.h
+//
@@ -0,0 +1,175 @@
+//
+// lwip_stub.c - lwIP stand-in for the host test harness, records the calls made by the stream
+//
+// Part of GrblHAL
+//
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "lwip/sys.h"
+#include "lwip_stub.h"
+
+lwip_stub_t lwip_stub;
+struct tcp_pcb *lwip_stub_listen_pcb;
+
+static struct tcp_pcb pcbs[4];
+static uint_fast8_t n_pcbs;
+
+static struct tcp_pcb *pcb_alloc (void)
+{
+    struct tcp_pcb *pcb = n_pcbs < sizeof(pcbs) / sizeof(struct tcp_pcb) ? &pcbs[n_pcbs++] : NULL;
+
+    if(pcb) {
+        memset(pcb, 0, sizeof(struct tcp_pcb));
+        pcb->snd_buf = 512;
+    }
+
+    return pcb;
+}
+
+void lwip_stub_reset (void)
+{
+    memset(&lwip_stub, 0, sizeof(lwip_stub_t));
+    lwip_stub_listen_pcb = NULL;
+    n_pcbs = 0;
+}
+
+struct pbuf *lwip_stub_packet (const char *data, uint16_t length, uint16_t pbuf_size)
+{
+    struct pbuf *head = NULL, **tail = &head;
+    uint16_t tot_len = length;
+
+    do {
+        uint16_t len = length > pbuf_size ? pbuf_size : length;
+        struct pbuf *p = calloc(1, sizeof(struct pbuf));
+
+        p->payload = malloc(len ? len : 1);
+        memcpy(p->payload, data, len);
+        p->len = len;
+        p->tot_len = tot_len;
+        *tail = p;
+        tail = &p->next;
+        data += len;
+        length -= len;
+        tot_len -= len;
+        lwip_stub.pbufs++;
+    } while(length);
+
+    return head;
+}
+
+struct tcp_pcb *lwip_stub_connect (void)
+{
+    struct tcp_pcb *pcb = pcb_alloc();
+
+    if(pcb)
+        pcb->arg = lwip_stub_listen_pcb->arg; // Inherited from the listening pcb as by lwIP
+
+    if(pcb && lwip_stub_listen_pcb->accept(lwip_stub_listen_pcb->arg, pcb, ERR_OK) != ERR_OK)
+        pcb = NULL;
+
+    return pcb;
+}
+
+err_t lwip_stub_receive (struct tcp_pcb *pcb, struct pbuf *p)
+{
+    return pcb->recv ? pcb->recv(pcb->arg, pcb, p, ERR_OK) : ERR_CONN;
+}
+
+uint32_t sys_now (void)
+{
+    return 0;
+}
+
+struct tcp_pcb *tcp_new (void)
+{
+    return (lwip_stub_listen_pcb = pcb_alloc());
+}
+
+err_t tcp_bind (struct tcp_pcb *pcb, const void *ipaddr, u16_t port)
+{
+    return ERR_OK;
+}
+
+void tcp_arg (struct tcp_pcb *pcb, void *arg)
+{
+    pcb->arg = arg;
+}
+
+void tcp_accept (struct tcp_pcb *pcb, tcp_accept_fn accept)
+{
+    pcb->accept = accept;
+}
+
+void tcp_recv (struct tcp_pcb *pcb, tcp_recv_fn recv)
+{
+    pcb->recv = recv;
+}
+
+void tcp_sent (struct tcp_pcb *pcb, tcp_sent_fn sent)
+{
+}
+
+void tcp_err (struct tcp_pcb *pcb, tcp_err_fn err)
+{
+    pcb->errf = err;
+}
+
+void tcp_poll (struct tcp_pcb *pcb, tcp_poll_fn poll, u8_t interval)
+{
+}
+
+void tcp_setprio (struct tcp_pcb *pcb, u8_t prio)
+{
+}
+
+void tcp_recved (struct tcp_pcb *pcb, u16_t len)
+{
+    lwip_stub.recved += len;
+}
+
+err_t tcp_write (struct tcp_pcb *pcb, const void *dataptr, u16_t len, u8_t apiflags)
+{
+    if(lwip_stub.written + len > sizeof(lwip_stub.tx))
+        return ERR_MEM;
+
+    memcpy(&lwip_stub.tx[lwip_stub.written], dataptr, len);
+    lwip_stub.written += len;
+
+    return ERR_OK;
+}
+
+err_t tcp_output (struct tcp_pcb *pcb)
+{
+    return ERR_OK;
+}
+
+err_t tcp_close (struct tcp_pcb *pcb)
+{
+    if(pcb != lwip_stub_listen_pcb)
+        lwip_stub.closed = true;
+
+    return ERR_OK;
+}
+
+void tcp_abort (struct tcp_pcb *pcb)
+{
+    lwip_stub.aborted = true;
+}
+
+u8_t pbuf_free (struct pbuf *p)
+{
+    u8_t count = 0;
+
+    while(p) {
+        struct pbuf *next = p->next;
+        free(p->payload);
+        free(p);
+        lwip_stub.freed++;
+        count++;
+        p = next;
+    }
+
+    return count;
+}
@@ -0,0 +1,36 @@
+//
+// lwip_stub.h - lwIP stand-in for the host test harness, records the calls made by the stream
+//
+// Part of GrblHAL
+//
+
+#ifndef __LWIP_STUB_H__
+#define __LWIP_STUB_H__
+
+#include "lwip/tcp.h"
+
+typedef struct {
+    uint32_t recved;        // Bytes acknowledged with tcp_recved()
+    uint32_t pbufs;         // pbufs allocated by lwip_stub_packet()
+    uint32_t freed;         // pbufs released with pbuf_free()
+    uint32_t written;       // Bytes passed to tcp_write()
+    bool closed;
+    bool aborted;
+    char tx[1024];          // Data passed to tcp_write()
+} lwip_stub_t;
+
+extern lwip_stub_t lwip_stub;
+extern struct tcp_pcb *lwip_stub_listen_pcb;
+
+// Creates a packet holding data as a chain of pbufs with at most pbuf_size bytes each.
+struct pbuf *lwip_stub_packet (const char *data, uint16_t length, uint16_t pbuf_size);
+
+// Accepts a new connection on the listening pcb, returns the connection pcb or NULL if refused.
+struct tcp_pcb *lwip_stub_connect (void);
+
+// Delivers a packet to the receive callback of the connection, NULL closes the connection.
+err_t lwip_stub_receive (struct tcp_pcb *pcb, struct pbuf *p);
+
+void lwip_stub_reset (void);
+
+#endif
@@ -0,0 +1,15 @@
+//
+// lwipopts.h - lwIP options for the host test harness
+//
+// Part of GrblHAL
+//
+
+#ifndef __LWIPOPTS_H__
+#define __LWIPOPTS_H__
+
+#define NO_SYS                  1
+#define PBUF_POOL_SIZE          8
+#define TCP_WND                 4096
+#define TCP_SND_QUEUELEN        8
+
+#endif
@@ -0,0 +1,298 @@
+//
+// tcpstream_test.c - host tests for the zero copy input of the raw "Telnet" stream
+//
+// Part of GrblHAL
+//
+// Runs TCPStream.c against the lwIP stand-in in stub/, see the Makefile.
+//
+
+#include <stdio.h>
+#include <string.h>
+
+#include "networking.h"
+#include "lwip_stub.h"
+
+grbl_hal_t hal;
+
+static char rt_commands[64];
+static uint_fast8_t n_rt_commands;
+static uint_fast16_t failures;
+
+#define CHECK(cond) check(cond, #cond, __LINE__)
+
+static void check (bool ok, const char *cond, int line)
+{
+    if(!ok) {
+        failures++;
+        printf("FAIL line %d: %s\n", line, cond);
+    }
+}
+
+// Stands in for the core, realtime commands are recorded and a reset cancels the input.
+static bool enqueue_realtime_command (char c)
+{
+    switch((uint8_t)c) {
+
+        case '?':
+        case '!':
+        case '~':
+        case ASCII_CAN:
+            break;
+
+        default:
+            if((uint8_t)c < 0x80)
+                return false;
+            break;
+    }
+
+    if(n_rt_commands < sizeof(rt_commands))
+        rt_commands[n_rt_commands++] = c;
+
+    if(c == ASCII_CAN)
+        TCPStreamRxCancel();
+
+    return true;
+}
+
+void selectStream (stream_type_t stream)
+{
+    hal.stream.type = stream;
+}
+
+// Used by utils.c, the core is not linked.
+char *ftoa (float n, uint8_t decimal_places)
+{
+    static char buf[32];
+
+    snprintf(buf, sizeof(buf), "%.*f", decimal_places, n);
+
+    return buf;
+}
+
+// Reads all input available the way the protocol loop does, a span at a time.
+static uint_fast16_t read_all (char *out, uint_fast16_t size)
+{
+    char *data;
+    uint_fast16_t length = 0, span, consumed = 0;
+
+    while((span = TCPStreamReadSpan(&data, consumed))) {
+        if(length + span < size) {
+            memcpy(out + length, data, span);
+            length += span;
+        }
+        consumed = span;
+    }
+
+    out[length] = '\0';
+
+    return length;
+}
+
+static struct tcp_pcb *setup (void)
+{
+    lwip_stub_reset();
+    memset(&hal, 0, sizeof(grbl_hal_t));
+    hal.stream.type = StreamType_Serial;
+    hal.stream.enqueue_realtime_command = enqueue_realtime_command;
+    n_rt_commands = 0;
+
+    TCPStreamInit();
+    TCPStreamListen(23);
+
+    return lwip_stub_connect();
+}
+
+// Realtime commands are picked out wherever the pbuf boundaries of a packet fall.
+static void test_realtime_split (void)
+{
+    static const char input[] = "G1X1?0Y2\nG1!X2~\nG0\x85Z5\n?";
+    char out[64];
+    uint16_t pbuf_size;
+
+    for(pbuf_size = 1; pbuf_size <= sizeof(input); pbuf_size++) {
+
+        struct tcp_pcb *pcb = setup();
+
+        CHECK(pcb != NULL && hal.stream.type == StreamType_Telnet);
+        CHECK(lwip_stub_receive(pcb, lwip_stub_packet(input, sizeof(input) - 1, pbuf_size)) == ERR_OK);
+        TCPStreamPoll();
+
+        CHECK(read_all(out, sizeof(out)) == 18);
+        CHECK(!strcmp(out, "G1X10Y2\nG1X2\nG0Z5\n"));
+        CHECK(n_rt_commands == 5 && !memcmp(rt_commands, "?!~\x85?", 5));
+
+        TCPStreamPoll();
+        CHECK(lwip_stub.recved == sizeof(input) - 1 && lwip_stub.freed == lwip_stub.pbufs);
+    }
+}
+
+// Packets are acknowledged and released once fully read, not before.
+static void test_release (void)
+{
+    static const char *packets[] = { "G1X1Y1\n", "G1X2Y2\nG1X3Y3\n", "M5\n" };
+    char *data, out[64];
+    uint_fast8_t idx;
+    uint32_t total = 0;
+    struct tcp_pcb *pcb = setup();
+
+    for(idx = 0; idx < 3; idx++) {
+        total += strlen(packets[idx]);
+        CHECK(lwip_stub_receive(pcb, lwip_stub_packet(packets[idx], strlen(packets[idx]), 4)) == ERR_OK);
+    }
+
+    CHECK(TCPStreamRxCount() == total);
+    CHECK(TCPStreamRxFree() == TCP_WND - total);
+
+    // Partially read first packet, nothing is released
+    TCPStreamPoll();
+    CHECK(TCPStreamReadSpan(&data, 0) == 4 && !memcmp(data, "G1X1", 4));
+    CHECK(TCPStreamReadSpan(&data, 2) == 2 && !memcmp(data, "X1", 2));
+    TCPStreamPoll();
+    CHECK(lwip_stub.recved == 0 && lwip_stub.freed == 0);
+
+    // First packet read, it is released with the next poll
+    CHECK(TCPStreamReadSpan(&data, 2) == 3 && !memcmp(data, "Y1\n", 3));
+    CHECK(TCPStreamReadSpan(&data, 3) == 4 && !memcmp(data, "G1X2", 4));
+    TCPStreamPoll();
+    CHECK(lwip_stub.recved == strlen(packets[0]) && lwip_stub.freed == 2);
+    CHECK(TCPStreamRxCount() == total - strlen(packets[0]));
+
+    // Remaining input is returned in order, all pbufs are freed and all data is acknowledged
+    CHECK(TCPStreamReadSpan(&data, 0) == 4);
+    CHECK(read_all(out, sizeof(out)) == total - strlen(packets[0]));
+    CHECK(!strcmp(out, "G1X2Y2\nG1X3Y3\nM5\n"));
+    TCPStreamPoll();
+    CHECK(lwip_stub.recved == total && lwip_stub.freed == lwip_stub.pbufs);
+    CHECK(TCPStreamRxCount() == 0 && TCPStreamRxFree() == TCP_WND);
+    CHECK(TCPStreamGetC() == -1);
+}
+
+// Packets are left with lwIP when the queue is full and accepted again when there is room.
+static void test_queue_full (void)
+{
+    char out[64];
+    uint_fast8_t idx;
+    struct tcp_pcb *pcb = setup();
+    struct pbuf *p;
+
+    for(idx = 0; idx < PBUF_POOL_SIZE - 1; idx++)
+        CHECK(lwip_stub_receive(pcb, lwip_stub_packet("G4P0\n", 5, 8)) == ERR_OK);
+
+    p = lwip_stub_packet("M2\n", 3, 8);
+    CHECK(lwip_stub_receive(pcb, p) == ERR_MEM);
+    CHECK(lwip_stub.freed == 0 && TCPStreamRxCount() == 5 * (PBUF_POOL_SIZE - 1));
+
+    TCPStreamPoll();
+    CHECK(read_all(out, sizeof(out)) == 5 * (PBUF_POOL_SIZE - 1));
+    TCPStreamPoll();
+    CHECK(lwip_stub_receive(pcb, p) == ERR_OK);
+    TCPStreamPoll();
+    CHECK(read_all(out, sizeof(out)) == 3 && !strcmp(out, "M2\n"));
+    TCPStreamPoll();
+    CHECK(lwip_stub.recved == 5 * (PBUF_POOL_SIZE - 1) + 3 && lwip_stub.freed == lwip_stub.pbufs);
+}
+
+// A reset discards all input received before it, also in earlier packets, and is read as a single ASCII_CAN.
+static void test_cancel (void)
+{
+    static const char first[] = "G1X1\nG1X2\n", second[] = "G1X3\n\x18G1X4\n";
+    char out[64];
+    struct tcp_pcb *pcb = setup();
+
+    CHECK(lwip_stub_receive(pcb, lwip_stub_packet(first, sizeof(first) - 1, 4)) == ERR_OK);
+    TCPStreamPoll();
+    CHECK(TCPStreamGetC() == 'G');
+
+    CHECK(lwip_stub_receive(pcb, lwip_stub_packet(second, sizeof(second) - 1, 4)) == ERR_OK);
+    TCPStreamPoll();
+
+    CHECK(read_all(out, sizeof(out)) == 6);
+    CHECK(!strcmp(out, "\x18G1X4\n"));
+    CHECK(n_rt_commands == 1 && rt_commands[0] == ASCII_CAN);
+
+    // Discarded input is acknowledged as consumed
+    TCPStreamPoll();
+    CHECK(lwip_stub.recved == sizeof(first) + sizeof(second) - 2 && lwip_stub.freed == lwip_stub.pbufs);
+}
+
+// A flush discards input available for reading, input received later is read.
+static void test_flush (void)
+{
+    char out[64];
+    struct tcp_pcb *pcb = setup();
+
+    CHECK(lwip_stub_receive(pcb, lwip_stub_packet("G1X1\nG1X2\n", 10, 3)) == ERR_OK);
+    TCPStreamPoll();
+    CHECK(TCPStreamGetC() == 'G');
+    TCPStreamRxFlush();
+    CHECK(read_all(out, sizeof(out)) == 0);
+
+    CHECK(lwip_stub_receive(pcb, lwip_stub_packet("M3\n", 3, 3)) == ERR_OK);
+    TCPStreamPoll();
+    CHECK(read_all(out, sizeof(out)) == 3 && !strcmp(out, "M3\n"));
+    TCPStreamPoll();
+    CHECK(lwip_stub.recved == 13 && lwip_stub.freed == lwip_stub.pbufs);
+}
+
+// Closing the connection frees all packets without acknowledging unread data. The packet being read is
+// released once the reader has handed it back.
+static void test_close (void)
+{
+    char out[64];
+    struct tcp_pcb *pcb = setup();
+
+    CHECK(lwip_stub_receive(pcb, lwip_stub_packet("G1X1\n", 5, 2)) == ERR_OK);
+    TCPStreamPoll();
+    CHECK(lwip_stub_receive(pcb, lwip_stub_packet("G1X2\n", 5, 2)) == ERR_OK);
+    CHECK(TCPStreamGetC() == 'G');
+
+    CHECK(lwip_stub_receive(pcb, NULL) == ERR_OK);
+    CHECK(lwip_stub.closed && hal.stream.type == StreamType_Serial);
+    TCPStreamPoll();
+    CHECK(lwip_stub.recved == 0 && lwip_stub.freed == 3);
+    CHECK(read_all(out, sizeof(out)) == 0);
+    TCPStreamPoll();
+    CHECK(lwip_stub.recved == 0 && lwip_stub.freed == lwip_stub.pbufs);
+    CHECK(TCPStreamRxCount() == 0 && TCPStreamRxFree() == TCP_WND);
+
+    // A new connection starts with empty input
+    CHECK((pcb = lwip_stub_connect()) != NULL);
+    CHECK(read_all(out, sizeof(out)) == 0);
+    CHECK(lwip_stub_receive(pcb, lwip_stub_packet("M2\n", 3, 2)) == ERR_OK);
+    TCPStreamPoll();
+    CHECK(read_all(out, sizeof(out)) == 3 && !strcmp(out, "M2\n"));
+    TCPStreamPoll();
+    CHECK(lwip_stub.recved == 3 && lwip_stub.freed == lwip_stub.pbufs);
+}
+
+// Output written to the stream is passed to tcp_write() by the poll.
+static void test_output (void)
+{
+    setup();
+
+    TCPStreamWriteLn("ok");
+    CHECK(TCPStreamTxCount() == 4);
+    TCPStreamPoll();
+    CHECK(lwip_stub.written == 4 && !memcmp(lwip_stub.tx, "ok\r\n", 4));
+    CHECK(TCPStreamTxCount() == 0);
+}
+
+int main (void)
+{
+    test_realtime_split();
+    test_release();
+    test_queue_full();
+    test_cancel();
+    test_flush();
+    test_close();
+    test_output();
+
+    if(failures) {
+        printf("%u checks failed\n", (unsigned)failures);
+        return 1;
+    }
+
+    printf("OK\n");
+
+    return 0;
+}
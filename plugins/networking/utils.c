@@ -81,3 +81,42 @@ bool is_valid_password (const char *password)
 
     return len >= PASSWORD_LENGTH_MIN && len <= PASSWORD_LENGTH_MAX;
 }
+
+// Characters that may be realtime commands: control characters other than CR and LF,
+// the legacy realtime commands ?, ! and ~ and DEL and top bit set characters.
+static inline bool is_rt_candidate (uint8_t c)
+{
+    return c < ' ' ? !(c == '\n' || c == '\r') : (c >= '~' || c == '?' || c == '!');
+}
+
+#define BYTES(c) (0x01010101UL * (uint32_t)(c))
+#define HAS_ZERO(w) (((w) - BYTES(0x01)) & ~(w) & BYTES(0x80))
+
+// Returns a pointer to the first character in data that may be a realtime command, or end if none.
+// Input is scanned four characters at a time, characters are only checked individually
+// when a word contains a candidate, CR or LF.
+char *scan_for_rt_commands (char *data, const char *end)
+{
+    uint32_t w;
+
+    while(end - data >= 4) {
+
+        memcpy(&w, data, 4);
+
+        if(((w - BYTES(' ')) & ~w & BYTES(0x80)) ||      // a character < ' ',
+            (((w + BYTES(127 - 0x7D)) | w) & BYTES(0x80)) || // > '}',
+             HAS_ZERO(w ^ BYTES('?')) || HAS_ZERO(w ^ BYTES('!'))) {
+            uint_fast8_t idx;
+            for(idx = 0; idx < 4; idx++) {
+                if(is_rt_candidate((uint8_t)data[idx]))
+                    return data + idx;
+            }
+        }
+        data += 4;
+    }
+
+    while(data < end && !is_rt_candidate((uint8_t)*data))
+        data++;
+
+    return data;
+}
@@ -25,5 +25,6 @@ bool is_valid_port (uint16_t port);
 bool is_valid_hostname (const char *hostname);
 bool is_valid_ssid (const char *ssid);
 bool is_valid_password (const char *password);
+char *scan_for_rt_commands (char *data, const char *end);
 
 #endif
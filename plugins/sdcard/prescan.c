@@ -0,0 +1,607 @@
+/*
+  prescan.c - program index for SD card jobs: line checkpoints with modal state, tool changes and extents
+
+  Part of GrblHAL
+
+  Copyright (c) 2020 Terje Io
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "prescan.h"
+
+#if SDCARD_ENABLE && SDCARD_PRESCAN
+
+#include <string.h>
+#include <float.h>
+
+#ifdef ARDUINO
+#include "../grbl/protocol.h"
+#else
+#include "grbl/protocol.h"
+#endif
+
+#define G_UNSET 0xFFFF
+
+typedef enum {
+    ModalG_Motion = 0,
+    ModalG_Plane,
+    ModalG_Units,
+    ModalG_Distance,
+    ModalG_FeedRateMode,
+    ModalG_WCS,
+    ModalG_Groups
+} modal_g_group_t;
+
+typedef struct {
+    uint16_t g[ModalG_Groups];  // G-code * 10 per modal group, G_UNSET if not programmed
+    uint8_t spindle;            // 3, 4 or 5, 0 if not programmed
+    uint8_t coolant;            // bit 0: flood, bit 1: mist, bit 7: programmed
+    int32_t tool;               // -1 if not programmed
+    float feed_rate;            // 0 if not programmed
+    float rpm;                  // -1 if not programmed
+} scan_modal_t;
+
+typedef struct {
+    uint32_t line;              // Line number of the checkpoint
+    uint32_t offset;            // File offset of the start of the line
+    scan_modal_t modal;         // Modal state before the line is executed
+    float position[N_AXIS];     // Programmed position in mm, in work coordinates
+    axes_signals_t programmed;  // Axes with a programmed position before the line
+} checkpoint_t;
+
+typedef struct {
+    uint32_t line;
+    int32_t tool;
+} tool_change_t;
+
+typedef struct {
+    uint32_t id;                // Hash of the file name
+    uint32_t size;              // File size
+    uint32_t lines;             // Number of lines indexed
+    bool complete;              // Set when the whole file has been indexed
+    char name[50];
+    uint32_t interval;          // Number of lines between checkpoints
+    uint_fast8_t checkpoints;
+    uint32_t tool_changes;
+    axes_signals_t programmed;  // Axes with programmed positions
+    float min[N_AXIS];          // Program extents in mm, in work coordinates
+    float max[N_AXIS];
+    checkpoint_t checkpoint[SDCARD_INDEX_SIZE];
+    tool_change_t tool_change[SDCARD_INDEX_TOOLS];
+} program_index_t;
+
+static program_index_t program = {0};
+static checkpoint_t scan;
+static bool resume = false;     // Set when scan is positioned at the line to resume from
+static char block[LINE_BUFFER_SIZE];
+
+// FNV-1a
+static uint32_t name_hash (const char *name)
+{
+    uint32_t hash = 2166136261UL;
+
+    while(*name)
+        hash = (hash ^ (uint8_t)*name++) * 16777619UL;
+
+    return hash;
+}
+
+static void index_reset (FIL *handle, const char *name, uint32_t id)
+{
+    uint_fast8_t idx;
+    const char *leafname = strrchr(name, '/');
+
+    memset(&program, 0, sizeof(program_index_t));
+
+    program.id = id;
+    program.size = (uint32_t)f_size(handle);
+    program.interval = SDCARD_INDEX_INTERVAL;
+    program.checkpoints = 1;
+    strncpy(program.name, leafname ? leafname + 1 : name, sizeof(program.name) - 1);
+
+    for(idx = 0; idx < ModalG_Groups; idx++)
+        program.checkpoint[0].modal.g[idx] = G_UNSET;
+    program.checkpoint[0].modal.tool = -1;
+    program.checkpoint[0].modal.rpm = -1.0f;
+
+    for(idx = 0; idx < N_AXIS; idx++) {
+        program.min[idx] = FLT_MAX;
+        program.max[idx] = -FLT_MAX;
+    }
+}
+
+// Adds a checkpoint for the current scan position, every other checkpoint is dropped when the index is full.
+static void index_add_checkpoint (void)
+{
+    if(program.checkpoints == SDCARD_INDEX_SIZE) {
+
+        uint_fast8_t idx;
+
+        for(idx = 1; idx < SDCARD_INDEX_SIZE / 2; idx++)
+            memcpy(&program.checkpoint[idx], &program.checkpoint[idx * 2], sizeof(checkpoint_t));
+
+        program.checkpoints = SDCARD_INDEX_SIZE / 2;
+        program.interval *= 2;
+
+        if(scan.line % program.interval)
+            return;
+    }
+
+    memcpy(&program.checkpoint[program.checkpoints++], &scan, sizeof(checkpoint_t));
+}
+
+// Updates the scan state from a block stripped of whitespace and comments, letters in upper case.
+static void parse_block (bool extend)
+{
+    float value, axis_values[N_AXIS];
+    bool move = true, tool_change = false;
+    uint_fast8_t idx, char_counter = 0;
+    uint_fast16_t code;
+    axes_signals_t axis_words = {0};
+    char letter;
+
+    while((letter = block[char_counter++])) {
+
+        if(!read_float(block, &char_counter, &value))
+            return;
+
+        code = (uint_fast16_t)(value * 10.0f + 0.5f);
+
+        switch(letter) {
+
+            case 'G':
+                switch(code) {
+
+                    case 0: case 10: case 20: case 30: case 382: case 383: case 384: case 385:
+                        scan.modal.g[ModalG_Motion] = code;
+                        break;
+
+                    case 170: case 180: case 190:
+                        scan.modal.g[ModalG_Plane] = code;
+                        break;
+
+                    case 200: case 210:
+                        scan.modal.g[ModalG_Units] = code;
+                        break;
+
+                    case 900: case 910:
+                        scan.modal.g[ModalG_Distance] = code;
+                        break;
+
+                    case 930: case 940:
+                        scan.modal.g[ModalG_FeedRateMode] = code;
+                        break;
+
+                    case 540: case 550: case 560: case 570: case 580: case 590: case 591: case 592: case 593:
+                        scan.modal.g[ModalG_WCS] = code;
+                        break;
+
+                    default:
+                        if(code >= 800 && code < 900)
+                            scan.modal.g[ModalG_Motion] = code;
+                        else
+                            move = false; // Axis words are not a programmed position, e.g. G4, G10, G28, G53 or G92
+                        break;
+                }
+                break;
+
+            case 'M':
+                switch(code) {
+
+                    case 30: case 40: case 50:
+                        scan.modal.spindle = (uint8_t)(code / 10);
+                        break;
+
+                    case 60:
+                        tool_change = true;
+                        break;
+
+                    case 70:
+                        scan.modal.coolant |= 0x82;
+                        break;
+
+                    case 80:
+                        scan.modal.coolant |= 0x81;
+                        break;
+
+                    case 90:
+                        scan.modal.coolant = 0x80;
+                        break;
+                }
+                break;
+
+            case 'T':
+                scan.modal.tool = (int32_t)value;
+                break;
+
+            case 'F':
+                scan.modal.feed_rate = value;
+                break;
+
+            case 'S':
+                scan.modal.rpm = value;
+                break;
+
+            case 'X':
+                axis_words.x = On;
+                axis_values[X_AXIS] = value;
+                break;
+
+            case 'Y':
+                axis_words.y = On;
+                axis_values[Y_AXIS] = value;
+                break;
+
+            case 'Z':
+                axis_words.z = On;
+                axis_values[Z_AXIS] = value;
+                break;
+#ifdef A_AXIS
+            case 'A':
+                axis_words.a = On;
+                axis_values[A_AXIS] = value;
+                break;
+#endif
+#ifdef B_AXIS
+            case 'B':
+                axis_words.b = On;
+                axis_values[B_AXIS] = value;
+                break;
+#endif
+#ifdef C_AXIS
+            case 'C':
+                axis_words.c = On;
+                axis_values[C_AXIS] = value;
+                break;
+#endif
+            default:
+                break;
+        }
+    }
+
+    if(move && axis_words.mask) {
+
+        bool inches = scan.modal.g[ModalG_Units] == 200, incremental = scan.modal.g[ModalG_Distance] == 910;
+
+        program.programmed.mask |= axis_words.mask;
+        scan.programmed.mask |= axis_words.mask;
+
+        idx = N_AXIS;
+        do {
+            if(axis_words.mask & bit(--idx)) {
+                // Rotary axes are not scaled in grbl but are treated as linear here, as in the parser.
+                value = inches ? axis_values[idx] * MM_PER_INCH : axis_values[idx];
+                scan.position[idx] = incremental ? scan.position[idx] + value : value;
+                if(scan.position[idx] < program.min[idx])
+                    program.min[idx] = scan.position[idx];
+                if(scan.position[idx] > program.max[idx])
+                    program.max[idx] = scan.position[idx];
+            }
+        } while(idx);
+    }
+
+    if(tool_change && extend) {
+        if(program.tool_changes < SDCARD_INDEX_TOOLS) {
+            program.tool_change[program.tool_changes].line = scan.line;
+            program.tool_change[program.tool_changes].tool = scan.modal.tool;
+        }
+        program.tool_changes++;
+    }
+}
+
+status_code_t prescan_seek (FIL *handle, const char *name, uint32_t line, bool rebuild, char *buffer, uint_fast16_t size, uint32_t *offset)
+{
+    UINT count;
+    char c, *data, comment = 0;
+    bool line_start = true, extend;
+    uint_fast8_t eol = 0;
+    uint_fast16_t idx, length = 0;
+    uint32_t id = name_hash(name), pos;
+
+    resume = false;
+
+    if(rebuild || program.id != id || program.size != (uint32_t)f_size(handle))
+        index_reset(handle, name, id);
+
+    // Start from the last checkpoint at or before the line
+    for(idx = program.checkpoints - 1; idx && program.checkpoint[idx].line > line; idx--);
+
+    memcpy(&scan, &program.checkpoint[idx], sizeof(checkpoint_t));
+
+    *offset = pos = scan.offset;
+
+    if(f_lseek(handle, pos) != FR_OK)
+        return Status_SDReadError;
+
+    if(scan.line == line) {
+        resume = true;
+        return Status_OK;
+    }
+
+    extend = scan.line >= program.lines;
+
+    while(true) {
+
+        if(f_read(handle, buffer, size, &count) != FR_OK)
+            return Status_SDReadError;
+
+        if(count == 0)
+            break;
+
+        data = buffer;
+
+        do {
+
+            if(eol == 1)
+                scan.line++;
+
+            if((c = *data++) == '\r' || c == '\n') {
+                if(eol++ == 0) {
+                    block[length] = '\0';
+                    if(length)
+                        parse_block(extend);
+                    length = comment = 0;
+                    line_start = true;
+                }
+            } else {
+
+                eol = 0;
+
+                if(line_start) {
+
+                    line_start = false;
+
+                    if((extend = scan.line >= program.lines)) {
+                        program.lines = scan.line + 1;
+                        if(scan.line && (scan.line % program.interval) == 0)
+                            index_add_checkpoint();
+                    }
+
+                    if(scan.line == line) {
+                        *offset = pos;
+                        resume = f_lseek(handle, pos) == FR_OK;
+                        return resume ? Status_OK : Status_SDReadError;
+                    }
+                }
+
+                if(comment == '(')
+                    comment = c == ')' ? 0 : comment;
+                else if(comment == 0) {
+                    if(c == '(' || c == ';')
+                        comment = c;
+                    else if(c > ' ' && c != '/' && length < sizeof(block) - 1)
+                        block[length++] = CAPS(c);
+                }
+            }
+
+            scan.offset = ++pos;
+
+        } while(--count);
+
+        if(!protocol_execute_realtime())
+            return Status_Reset;
+    }
+
+    if(length) { // Last line is not terminated
+        block[length] = '\0';
+        parse_block(extend);
+    }
+
+    program.complete = true;
+
+    return line == PRESCAN_TO_END ? Status_OK : Status_GcodeInvalidLineNumber;
+}
+
+static void append_float (const char *word, float value)
+{
+    strcat(block, word);
+    strcat(block, ftoa(value, N_DECIMAL_COORDVALUE_MM));
+}
+
+static status_code_t execute_block (void)
+{
+    status_code_t status = *block ? gc_execute_block(block, NULL) : Status_OK;
+
+    *block = '\0';
+
+    return status;
+}
+
+// Moves to the programmed position of the line resumed from, in work coordinates of the coordinate system
+// restored: Z is raised to the highest Z indexed before the other axes are moved. The spindle and coolant are
+// started there before Z is lowered, at the feed rate restored if there is one.
+static status_code_t move_to_resume_position (void)
+{
+    uint_fast8_t idx;
+    uint_fast16_t wcs = scan.modal.g[ModalG_WCS];
+    status_code_t status;
+    bool lower_z = false, move = false;
+
+    strcpy(block, "G21G90G94");
+    if(wcs != G_UNSET) {
+        strcat(block, "G");
+        strcat(block, uitoa(wcs / 10));
+        if(wcs % 10) {
+            strcat(block, ".");
+            strcat(block, uitoa(wcs % 10));
+        }
+    }
+
+    if((status = execute_block()) != Status_OK)
+        return status;
+
+    if(scan.programmed.z) {
+
+        float safe_z = max(program.max[Z_AXIS], gc_state.position[Z_AXIS] - gc_get_offset(Z_AXIS));
+
+        if((lower_z = scan.position[Z_AXIS] < safe_z)) {
+            strcpy(block, "G0");
+            append_float("Z", safe_z);
+            if((status = execute_block()) != Status_OK)
+                return status;
+        }
+    }
+
+    strcpy(block, "G0");
+    for(idx = 0; idx < N_AXIS; idx++) {
+        if(idx != Z_AXIS && (scan.programmed.mask & bit(idx))) {
+            append_float(axis_letter[idx], scan.position[idx]);
+            move = true;
+        }
+    }
+
+    if(!move)
+        *block = '\0';
+
+    if((status = execute_block()) != Status_OK || !lower_z)
+        return status;
+
+    // Start spindle and coolant before Z is lowered
+    if(scan.modal.spindle) {
+        strcat(block, "M");
+        strcat(block, uitoa(scan.modal.spindle));
+    }
+
+    if(scan.modal.coolant)
+        strcat(block, scan.modal.coolant & 0x02 ? "M7" : (scan.modal.coolant & 0x01 ? "M8" : "M9"));
+
+    if(scan.modal.rpm >= 0.0f) {
+        strcat(block, "S");
+        strcat(block, ftoa(scan.modal.rpm, N_DECIMAL_SETTINGVALUE));
+    }
+
+    if((status = execute_block()) != Status_OK)
+        return status;
+
+    // The feed rate is not in units per minute in inverse time mode
+    if(scan.modal.feed_rate > 0.0f && scan.modal.g[ModalG_FeedRateMode] != 930) {
+        strcpy(block, "G1");
+        append_float("F", scan.modal.g[ModalG_Units] == 200 ? scan.modal.feed_rate * MM_PER_INCH : scan.modal.feed_rate);
+    } else
+        strcpy(block, "G0");
+    append_float("Z", scan.position[Z_AXIS]);
+
+    return execute_block();
+}
+
+status_code_t prescan_restore_modal_state (void)
+{
+    uint_fast8_t idx;
+    uint_fast16_t code;
+    status_code_t status;
+    bool mist_and_flood = (scan.modal.coolant & 0x03) == 0x03;
+
+    if((status = move_to_resume_position()) != Status_OK)
+        return status;
+
+    for(idx = 0; idx < ModalG_Groups; idx++) {
+        // Arcs, canned cycles and probing require parameters, the line resumed from has to restate the motion mode
+        if((code = scan.modal.g[idx]) != G_UNSET && !(idx == ModalG_Motion && !(code == 0 || code == 10 || code == 800))) {
+            strcat(block, "G");
+            strcat(block, uitoa(code / 10));
+            if(code % 10) {
+                strcat(block, ".");
+                strcat(block, uitoa(code % 10));
+            }
+        }
+    }
+
+    if(scan.modal.spindle) {
+        strcat(block, "M");
+        strcat(block, uitoa(scan.modal.spindle));
+    }
+
+    if(scan.modal.coolant)
+        strcat(block, scan.modal.coolant & 0x02 ? "M7" : (scan.modal.coolant & 0x01 ? "M8" : "M9"));
+
+    if(scan.modal.feed_rate > 0.0f) {
+        strcat(block, "F");
+        strcat(block, ftoa(scan.modal.feed_rate, N_DECIMAL_SETTINGVALUE));
+    }
+
+    if(scan.modal.rpm >= 0.0f) {
+        strcat(block, "S");
+        strcat(block, ftoa(scan.modal.rpm, N_DECIMAL_SETTINGVALUE));
+    }
+
+    if(scan.modal.tool >= 0) {
+        strcat(block, "T");
+        strcat(block, uitoa((uint32_t)scan.modal.tool));
+    }
+
+    if((status = execute_block()) != Status_OK)
+        return status;
+
+    // Flood and mist coolant belong to the same modal group and cannot be set in the same block
+    if(mist_and_flood) {
+        strcpy(block, "M8");
+        status = execute_block();
+    }
+
+    return status;
+}
+
+static void report_position (float *position, axes_signals_t axes)
+{
+    uint_fast8_t idx;
+    bool inches = settings.flags.report_inches;
+
+    for(idx = 0; idx < N_AXIS; idx++) {
+        if(idx)
+            hal.stream.write(",");
+        hal.stream.write(ftoa(axes.mask & bit(idx) ? (inches ? position[idx] / MM_PER_INCH : position[idx]) : 0.0f,
+                               inches ? N_DECIMAL_COORDVALUE_INCH : N_DECIMAL_COORDVALUE_MM));
+    }
+}
+
+void prescan_report (void)
+{
+    uint32_t idx;
+
+    if(program.id == 0)
+        return;
+
+    hal.stream.write("[SDINDEX:");
+    hal.stream.write(program.name);
+    hal.stream.write("|L:");
+    hal.stream.write(uitoa(program.lines));
+    if(!program.complete)
+        hal.stream.write("+");
+    if(program.programmed.mask) {
+        hal.stream.write("|BB:");
+        report_position(program.min, program.programmed);
+        hal.stream.write(":");
+        report_position(program.max, program.programmed);
+    }
+    hal.stream.write("|TC:");
+    hal.stream.write(uitoa(program.tool_changes));
+    if(resume) {
+        hal.stream.write("|RL:");
+        hal.stream.write(uitoa(scan.line));
+        hal.stream.write(":");
+        report_position(scan.position, scan.programmed);
+    }
+    hal.stream.write("]" ASCII_EOL);
+
+    for(idx = 0; idx < program.tool_changes && idx < SDCARD_INDEX_TOOLS; idx++) {
+        hal.stream.write("[SDTC:");
+        hal.stream.write(uitoa(program.tool_change[idx].line));
+        hal.stream.write(",");
+        hal.stream.write(uitoa((uint32_t)program.tool_change[idx].tool));
+        hal.stream.write("]" ASCII_EOL);
+    }
+}
+
+#endif
@@ -0,0 +1,61 @@
+/*
+  prescan.h - program index for SD card jobs: line checkpoints with modal state, tool changes and extents
+
+  Part of GrblHAL
+
+  Copyright (c) 2020 Terje Io
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  The index holds up to SDCARD_INDEX_SIZE checkpoints, each with the file offset, modal state and programmed
+  position at the start of a line. Checkpoints are spaced SDCARD_INDEX_INTERVAL lines apart, the spacing is
+  doubled each time the index fills up so a seek never has to scan more than 2/SDCARD_INDEX_SIZE of the lines.
+
+  Line numbers are counted the same way as in SD card error and reset messages.
+*/
+
+#ifndef _SDCARD_PRESCAN_H_
+#define _SDCARD_PRESCAN_H_
+
+#include "sdcard.h"
+
+#if SDCARD_ENABLE && SDCARD_PRESCAN
+
+#ifndef SDCARD_INDEX_SIZE
+#define SDCARD_INDEX_SIZE 32        // Max number of checkpoints
+#endif
+#ifndef SDCARD_INDEX_INTERVAL
+#define SDCARD_INDEX_INTERVAL 256   // Initial number of lines between checkpoints
+#endif
+#ifndef SDCARD_INDEX_TOOLS
+#define SDCARD_INDEX_TOOLS 16       // Max number of tool changes recorded
+#endif
+
+#define PRESCAN_TO_END ((uint32_t)-1) // Line number for indexing the whole file
+
+// Scans the open file up to the start of line and leaves it positioned there, the index is (re)built as needed.
+// buffer is used for reading the file. Returns the file offset of the line in offset.
+status_code_t prescan_seek (FIL *handle, const char *name, uint32_t line, bool rebuild, char *buffer, uint_fast16_t size, uint32_t *offset);
+
+// Executes blocks restoring the modal state found by the last seek.
+status_code_t prescan_restore_modal_state (void);
+
+// Outputs the index summary: number of lines, program extents and tool changes.
+void prescan_report (void);
+
+#endif
+
+#endif
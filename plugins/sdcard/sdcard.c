@@ -23,6 +23,10 @@
 
 #if SDCARD_ENABLE
 
+#if SDCARD_PRESCAN
+#include "prescan.h"
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -67,6 +71,12 @@ const char *dev = "";
 /* uses fatfs - http://www.elm-chan.org/fsw/ff/00index_e.html */
 
 #define MAX_PATHLEN 128
+
+// Size of each of the two read buffers, a multiple of the sector size lets FatFS read sectors directly into them.
+#ifndef SDCARD_READ_BUFFER_SIZE
+#define SDCARD_READ_BUFFER_SIZE 512
+#endif
+
 #define LCAPS(c) ((c >= 'A' && c <= 'Z') ? c | 0x20 : c)
 
 #if FF_USE_LFN
@@ -110,6 +120,24 @@ static file_t file = {
     .pos = 0
 };
 
+typedef struct {
+    uint_fast16_t length;
+    char data[SDCARD_READ_BUFFER_SIZE + 1];
+} read_buffer_t;
+
+// Input is read block-wise into one buffer while it is consumed from the other, the next block
+// is read ahead from the realtime loop.
+typedef struct {
+    read_buffer_t *current;     // Buffer input is consumed from
+    read_buffer_t *next;        // Buffer read ahead, empty when length is 0
+    uint_fast16_t index;        // Index of next character in current buffer
+    bool eof;                   // Set when the last block has been read
+    char last;                  // Last character read from file
+    read_buffer_t buffer[2];
+} read_ahead_t;
+
+static read_ahead_t rd;
+
 static bool frewind = false;
 static io_stream_t active_stream;
 static driver_reset_ptr driver_reset;
@@ -117,8 +145,10 @@ static on_unknown_sys_command_ptr on_unknown_sys_command;
 static on_realtime_report_ptr on_realtime_report;
 static on_state_change_ptr state_change_requested;
 static on_program_completed_ptr on_program_completed;
+static on_execute_realtime_ptr on_execute_realtime;
 
 static void sdcard_end_job (void);
+static void sdcard_read_ahead (uint_fast16_t state);
 static void sdcard_report (stream_write_ptr stream_write, report_tracking_flags_t report);
 static void trap_state_change_request(uint_fast16_t state);
 static void sdcard_on_program_completed (program_flow_t program_flow);
@@ -259,6 +289,17 @@ static void file_close (void)
     }
 }
 
+static void file_rewind (void)
+{
+    rd.current = &rd.buffer[0];
+    rd.next = &rd.buffer[1];
+    rd.current->length = rd.next->length = rd.index = 0;
+    rd.eof = false;
+    rd.last = '\n';
+    file.pos = file.line = 0;
+    file.eol = false;
+}
+
 static bool file_open (char *filename)
 {
     if(file.handle)
@@ -267,9 +308,7 @@ static bool file_open (char *filename)
     if(f_open(&cncfile, filename, FA_READ) == FR_OK) {
         file.handle = &cncfile;
         file.size = f_size(file.handle);
-        file.pos = 0;
-        file.line = 0;
-        file.eol = false;
+        file_rewind();
         char *leafname = strrchr(filename, '/');
         strncpy(file.name, leafname ? leafname + 1 : filename, sizeof(file.name));
         file.name[sizeof(file.name) - 1] = '\0';
@@ -278,22 +317,47 @@ static bool file_open (char *filename)
     return file.handle != NULL;
 }
 
-static int16_t file_read (void)
+// Reads the next block of the file into buffer, a newline is added if the last line is not terminated.
+static void file_fill (read_buffer_t *buffer)
 {
-    signed char c;
-    UINT count;
+    UINT count = 0;
+
+    if(!rd.eof && file.handle) {
 
-    if(f_read(file.handle, &c, 1, &count) == FR_OK && count == 1)
-        file.pos = f_tell(file.handle);
-    else
-        c = -1;
+        if(f_read(file.handle, buffer->data, SDCARD_READ_BUFFER_SIZE, &count) != FR_OK)
+            count = 0;
 
-    if(c == '\r' || c == '\n')
-        file.eol++;
-    else
-        file.eol = 0;
+        if(count)
+            rd.last = buffer->data[count - 1];
+
+        if((rd.eof = count < SDCARD_READ_BUFFER_SIZE) && rd.last != '\r' && rd.last != '\n')
+            buffer->data[count++] = '\n';
+    }
 
-    return (int16_t)c;
+    buffer->length = count;
+}
+
+// Releases consumed characters from the current buffer and counts lines.
+static void file_consume (uint_fast16_t consumed)
+{
+    char *c = &rd.current->data[rd.index];
+
+    rd.index += consumed;
+    if((file.pos += consumed) > file.size) // Added newline
+        file.pos = file.size;
+
+    while(consumed--) {
+
+        if(file.eol == 1)
+            file.line++;
+
+        if(*c == '\r' || *c == '\n')
+            file.eol++;
+        else
+            file.eol = 0;
+
+        c++;
+    }
 }
 
 static bool sdcard_mount (void)
@@ -347,6 +411,9 @@ static void sdcard_end_job (void)
     if(grbl.on_state_change == trap_state_change_request)
         grbl.on_state_change = state_change_requested;
 
+    if(grbl.on_execute_realtime == sdcard_read_ahead)
+        grbl.on_execute_realtime = on_execute_realtime;
+
     memcpy(&hal.stream, &active_stream, sizeof(io_stream_t));   // Restore stream pointers
     hal.stream.reset_read_buffer();                             // and flush input buffer
     on_realtime_report = NULL;
@@ -357,30 +424,65 @@ static void sdcard_end_job (void)
     frewind = false;
 }
 
-static int16_t sdcard_read (void)
+static uint_fast16_t sdcard_read_span (char **data, uint_fast16_t consumed)
 {
-    int16_t c = -1;
-
-    if(file.eol == 1)
-        file.line++;
+    if(consumed)
+        file_consume(consumed);
 
     if(file.handle) {
 
-        if(sys.state == STATE_IDLE || (sys.state & (STATE_CYCLE|STATE_HOLD|STATE_CHECK_MODE)))
-            c = file_read();
+        if(!(sys.state == STATE_IDLE || (sys.state & (STATE_CYCLE|STATE_HOLD|STATE_CHECK_MODE))))
+            return 0;
+
+        if(rd.index == rd.current->length) { // Current buffer consumed, switch to the buffer read ahead
 
-        if(c == -1) { // EOF or error reading or grbl problem
-            file_close();
-            if(file.eol == 0) // Return newline if line was incorrectly terminated
-                c = '\n';
+            read_buffer_t *buffer = rd.current;
+
+            if(rd.next->length == 0) // Read ahead has not kept up
+                file_fill(rd.next);
+
+            rd.current = rd.next;
+            rd.next = buffer;
+            rd.next->length = rd.index = 0;
+
+            if(rd.current->length == 0) { // EOF or error reading
+                if(!consumed)   // Not when releasing the last line, it has yet to be executed and may rewind the file (M2)
+                    file_close();
+                return 0;
+            }
         }
 
+        *data = &rd.current->data[rd.index];
+
+        return rd.current->length - rd.index;
+
     } else if(sys.state == STATE_IDLE) // TODO: end on ok count match line count?
         sdcard_end_job();
 
+    return 0;
+}
+
+static int16_t sdcard_read (void)
+{
+    char *data;
+    int16_t c = SERIAL_NO_DATA;
+
+    if(sdcard_read_span(&data, 0)) {
+        c = (int16_t)*data;
+        file_consume(1);
+    }
+
     return c;
 }
 
+static void sdcard_read_ahead (uint_fast16_t state)
+{
+    if(file.handle && !rd.eof && rd.next->length == 0)
+        file_fill(rd.next);
+
+    on_execute_realtime(state);
+}
+
 static int16_t await_cycle_start (void)
 {
     return -1;
@@ -398,8 +500,10 @@ static void trap_state_change_request(uint_fast16_t state)
 {
     if(state == STATE_CYCLE) {
 
-        if(hal.stream.read == await_cycle_start)
+        if(hal.stream.read == await_cycle_start) {
             hal.stream.read = sdcard_read;
+            hal.stream.read_span = sdcard_read_span;
+        }
 
         if(grbl.on_state_change== trap_state_change_request) {
             grbl.on_state_change = state_change_requested;
@@ -452,9 +556,9 @@ static void sdcard_on_program_completed (program_flow_t program_flow)
 
     if(frewind) {
         f_lseek(file.handle, 0);
-        file.pos = file.line = 0;
-        file.eol = false;
+        file_rewind();
         hal.stream.read = await_cycle_start;
+        hal.stream.read_span = NULL;
         if(grbl.on_state_change != trap_state_change_request) {
             state_change_requested = grbl.on_state_change;
             grbl.on_state_change = trap_state_change_request;
@@ -474,10 +578,12 @@ static bool sdcard_suspend (bool suspend)
     if(suspend) {
         hal.stream.reset_read_buffer();
         hal.stream.read = active_stream.read;               // Restore normal stream input for tool change (jog etc)
+        hal.stream.read_span = active_stream.read_span;
         hal.stream.enqueue_realtime_command = active_stream.enqueue_realtime_command;
         grbl.report.status_message = report_status_message;  // as well as normal status messages reporting
     } else {
         hal.stream.read = sdcard_read;                      // Resume reading from SD card
+        hal.stream.read_span = sdcard_read_span;
         hal.stream.enqueue_realtime_command = drop_input_stream;
         grbl.report.status_message = trap_status_report;     // and redirect status messages back to us
     }
@@ -486,6 +592,32 @@ static bool sdcard_suspend (bool suspend)
 }
 #endif
 
+static void sdcard_start_job (void)
+{
+    gc_state.last_error = Status_OK;                            // Start with no errors
+    grbl.report.status_message(Status_OK);                      // and confirm command to originator
+    memcpy(&active_stream, &hal.stream, sizeof(io_stream_t));   // Save current stream pointers
+    hal.stream.type = StreamType_SDCard;                        // then redirect to read from SD card instead
+    hal.stream.read = sdcard_read;                              // ...
+    hal.stream.read_span = sdcard_read_span;                    // ...
+    hal.stream.enqueue_realtime_command = drop_input_stream;    // Drop input from current stream except realtime commands
+#if M6_ENABLE
+    hal.stream.suspend_read = sdcard_suspend;                   // ...
+#else
+    hal.stream.suspend_read = NULL;                             // ...
+#endif
+    on_realtime_report = grbl.on_realtime_report;
+    grbl.on_realtime_report = sdcard_report;                     // Add percent complete to real time report
+
+    on_program_completed = grbl.on_program_completed;
+    grbl.on_program_completed = sdcard_on_program_completed;
+
+    on_execute_realtime = grbl.on_execute_realtime;
+    grbl.on_execute_realtime = sdcard_read_ahead;               // Read ahead from the realtime loop
+
+    grbl.report.status_message = trap_status_report;             // Redirect status message reports here
+}
+
 static status_code_t sdcard_parse (uint_fast16_t state, char *line, char *lcline)
 {
     status_code_t retval = Status_Unhandled;
@@ -512,10 +644,10 @@ static status_code_t sdcard_parse (uint_fast16_t state, char *line, char *lcline
                 retval = Status_SystemGClock;
             else {
                 if(file_open(&lcline[3])) {
-                    int16_t c;
-                    char buf[2] = {0};
-                    while((c = file_read()) != -1) {
-                        buf[0] = (char)c;
+                    UINT count;
+                    char *buf = rd.buffer[0].data;
+                    while(f_read(file.handle, buf, SDCARD_READ_BUFFER_SIZE, &count) == FR_OK && count) {
+                        buf[count] = '\0';
                         hal.stream.write(buf);
                     }
                     file_close();
@@ -530,29 +662,57 @@ static status_code_t sdcard_parse (uint_fast16_t state, char *line, char *lcline
                 retval = Status_SystemGClock;
             else {
                 if(file_open(&lcline[3])) {
-                    gc_state.last_error = Status_OK;                            // Start with no errors
-                    grbl.report.status_message(Status_OK);                      // and confirm command to originator
-                    memcpy(&active_stream, &hal.stream, sizeof(io_stream_t));   // Save current stream pointers
-                    hal.stream.type = StreamType_SDCard;                        // then redirect to read from SD card instead
-                    hal.stream.read = sdcard_read;                              // ...
-                    hal.stream.enqueue_realtime_command = drop_input_stream;    // Drop input from current stream except realtime commands
-#if M6_ENABLE
-                    hal.stream.suspend_read = sdcard_suspend;                   // ...
-#else
-                    hal.stream.suspend_read = NULL;                             // ...
-#endif
-                    on_realtime_report = grbl.on_realtime_report;
-                    grbl.on_realtime_report = sdcard_report;                     // Add percent complete to real time report
+                    sdcard_start_job();
+                    retval = Status_OK;
+                } else
+                    retval = Status_SDReadError;
+            }
+            break;
 
-                    on_program_completed = grbl.on_program_completed;
-                    grbl.on_program_completed = sdcard_on_program_completed;
+#if SDCARD_PRESCAN
 
-                    grbl.report.status_message = trap_status_report;             // Redirect status message reports here
-                    retval = Status_OK;
+        case 'I':
+            if(line[3] == '\0') {
+                prescan_report();
+                retval = Status_OK;
+            } else if(line[3] != '=')
+                retval = Status_InvalidStatement;
+            else if (!(state == STATE_IDLE || state == STATE_CHECK_MODE))
+                retval = Status_SystemGClock;
+            else if(file_open(&lcline[4])) {
+                uint32_t offset;
+                if((retval = prescan_seek(file.handle, &lcline[4], PRESCAN_TO_END, true, rd.buffer[0].data, SDCARD_READ_BUFFER_SIZE, &offset)) == Status_OK)
+                    prescan_report();
+                file_close();
+            } else
+                retval = Status_SDReadError;
+            break;
+
+        case 'L':
+            if(line[3] != '=')
+                retval = Status_InvalidStatement;
+            else if (!(state == STATE_IDLE || state == STATE_CHECK_MODE))
+                retval = Status_SystemGClock;
+            else {
+                char *filename;
+                uint32_t lineno = (uint32_t)strtoul(&lcline[4], &filename, 10), offset;
+                if(filename == &lcline[4] || *filename++ != ',')
+                    retval = Status_BadNumberFormat;
+                else if(file_open(filename)) {
+                    if((retval = prescan_seek(file.handle, filename, lineno, false, rd.buffer[0].data, SDCARD_READ_BUFFER_SIZE, &offset)) == Status_OK &&
+                         (retval = prescan_restore_modal_state()) == Status_OK) {
+                        prescan_report(); // Reports the line resumed from and its programmed position
+                        file_rewind();
+                        file.line = lineno;
+                        file.pos = offset;
+                        sdcard_start_job();
+                    } else
+                        file_close();
                 } else
                     retval = Status_SDReadError;
             }
             break;
+#endif
 
         default:
             retval = Status_InvalidStatement;
@@ -0,0 +1,17 @@
+//
+// driver.h - driver stand-in for the host test harness
+//
+// Part of GrblHAL
+//
+
+#ifndef __DRIVER_H__
+#define __DRIVER_H__
+
+#include "grbl/hal.h"
+
+#define SDCARD_ENABLE   1
+#ifndef SDCARD_PRESCAN
+#define SDCARD_PRESCAN  0
+#endif
+
+#endif
@@ -0,0 +1,195 @@
+//
+// fat_image.c - FAT16 image file writer and FatFS disk driver reading it, for the host test harness
+//
+// Part of GrblHAL
+//
+// The image has one sector per cluster and the smallest cluster count FatFS accepts as FAT16, files are
+// stored in contiguous clusters in the root directory.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fatfs/src/ff.h"
+#include "fatfs/src/diskio.h"
+
+#include "fat_image.h"
+
+#define SECTOR_SIZE     512
+#define N_CLUSTERS      4200    // FAT16 starts at 4086 clusters
+#define N_FATS          2
+#define RESERVED        1
+#define ROOT_ENTRIES    512
+#define FAT_SECTORS     (((N_CLUSTERS + 2) * 2 + SECTOR_SIZE - 1) / SECTOR_SIZE)
+#define ROOT_SECTORS    (ROOT_ENTRIES * 32 / SECTOR_SIZE)
+#define DATA_START      (RESERVED + N_FATS * FAT_SECTORS + ROOT_SECTORS)
+#define N_SECTORS       (DATA_START + N_CLUSTERS)
+
+static char image_path[128];
+static FILE *image = NULL;
+
+static void put16 (unsigned char *p, unsigned int value)
+{
+    p[0] = value & 0xFF;
+    p[1] = (value >> 8) & 0xFF;
+}
+
+static void put32 (unsigned char *p, unsigned long value)
+{
+    put16(p, value & 0xFFFF);
+    put16(p + 2, (value >> 16) & 0xFFFF);
+}
+
+// Stores name in directory entry format, padded with spaces and without the dot.
+static bool put_name (unsigned char *entry, const char *name)
+{
+    const char *ext = strchr(name, '.');
+    size_t len = ext ? (size_t)(ext - name) : strlen(name);
+
+    if(len == 0 || len > 8 || (ext && strlen(ext + 1) > 3))
+        return false;
+
+    memset(entry, ' ', 11);
+    memcpy(entry, name, len);
+    if(ext)
+        memcpy(entry + 8, ext + 1, strlen(ext + 1));
+
+    return true;
+}
+
+bool fat_image_create (const char *path, const fat_image_file_t *files, unsigned int n_files)
+{
+    unsigned char *disk, *boot, *root;
+    unsigned int idx, fat, cluster = 2;
+    bool ok = n_files <= ROOT_ENTRIES;
+    FILE *f;
+
+    if(!ok || (disk = calloc(N_SECTORS, SECTOR_SIZE)) == NULL)
+        return false;
+
+    boot = disk;
+    boot[0] = 0xEB;
+    boot[1] = 0x3C;
+    boot[2] = 0x90;
+    memcpy(&boot[3], "MSDOS5.0", 8);
+    put16(&boot[11], SECTOR_SIZE);
+    boot[13] = 1;                       // Sectors per cluster
+    put16(&boot[14], RESERVED);
+    boot[16] = N_FATS;
+    put16(&boot[17], ROOT_ENTRIES);
+    put16(&boot[19], N_SECTORS);
+    boot[21] = 0xF8;                    // Media, fixed disk
+    put16(&boot[22], FAT_SECTORS);
+    put16(&boot[24], 32);               // Sectors per track
+    put16(&boot[26], 2);                // Heads
+    boot[36] = 0x80;                    // Drive number
+    boot[38] = 0x29;                    // Extended boot signature
+    put32(&boot[39], 0x47524C48);       // Volume serial number
+    memcpy(&boot[43], "NO NAME    FAT16   ", 19);
+    put16(&boot[510], 0xAA55);
+
+    for(fat = 0; fat < N_FATS; fat++) {
+        unsigned char *table = disk + (RESERVED + fat * FAT_SECTORS) * SECTOR_SIZE;
+        put16(&table[0], 0xFFF8);
+        put16(&table[2], 0xFFFF);
+    }
+
+    root = disk + (RESERVED + N_FATS * FAT_SECTORS) * SECTOR_SIZE;
+
+    for(idx = 0; ok && idx < n_files; idx++) {
+
+        unsigned char *entry = &root[idx * 32];
+        unsigned int clusters = (files[idx].size + SECTOR_SIZE - 1) / SECTOR_SIZE, n;
+
+        if(!(ok = put_name(entry, files[idx].name) && cluster + clusters <= N_CLUSTERS + 2))
+            break;
+
+        entry[11] = 0x20;               // Archive
+        put16(&entry[22], 0);           // 00:00:00
+        put16(&entry[24], (40 << 9) | (8 << 5) | 1); // 2020-08-01
+        put16(&entry[26], clusters ? cluster : 0);
+        put32(&entry[28], files[idx].size);
+
+        if(clusters)
+            memcpy(disk + (DATA_START + cluster - 2) * SECTOR_SIZE, files[idx].data, files[idx].size);
+
+        for(n = 0; n < clusters; n++, cluster++) for(fat = 0; fat < N_FATS; fat++)
+            put16(disk + (RESERVED + fat * FAT_SECTORS) * SECTOR_SIZE + cluster * 2, n == clusters - 1 ? 0xFFFF : cluster + 1);
+    }
+
+    if(ok && (ok = (f = fopen(path, "wb")) != NULL)) {
+        ok = fwrite(disk, SECTOR_SIZE, N_SECTORS, f) == N_SECTORS;
+        ok = fclose(f) == 0 && ok;
+    }
+
+    free(disk);
+
+    if(ok) {
+        if(image) {
+            fclose(image);
+            image = NULL;
+        }
+        strncpy(image_path, path, sizeof(image_path) - 1);
+    }
+
+    return ok;
+}
+
+// FatFS disk driver, drive 0 is the image file last written.
+
+DSTATUS disk_initialize (BYTE pdrv)
+{
+    if(pdrv == 0 && image == NULL && *image_path)
+        image = fopen(image_path, "rb");
+
+    return disk_status(pdrv);
+}
+
+DSTATUS disk_status (BYTE pdrv)
+{
+    return pdrv == 0 && image ? STA_PROTECT : STA_NOINIT;
+}
+
+DRESULT disk_read (BYTE pdrv, BYTE *buff, DWORD sector, UINT count)
+{
+    if(disk_status(pdrv) & STA_NOINIT)
+        return RES_NOTRDY;
+
+    if(sector + count > N_SECTORS)
+        return RES_PARERR;
+
+    if(fseek(image, (long)sector * SECTOR_SIZE, SEEK_SET) || fread(buff, SECTOR_SIZE, count, image) != count)
+        return RES_ERROR;
+
+    return RES_OK;
+}
+
+DRESULT disk_ioctl (BYTE pdrv, BYTE cmd, void *buff)
+{
+    if(disk_status(pdrv) & STA_NOINIT)
+        return RES_NOTRDY;
+
+    switch(cmd) {
+
+        case CTRL_SYNC:
+            break;
+
+        case GET_SECTOR_COUNT:
+            *(DWORD *)buff = N_SECTORS;
+            break;
+
+        case GET_SECTOR_SIZE:
+            *(WORD *)buff = SECTOR_SIZE;
+            break;
+
+        case GET_BLOCK_SIZE:
+            *(DWORD *)buff = 1;
+            break;
+
+        default:
+            return RES_PARERR;
+    }
+
+    return RES_OK;
+}
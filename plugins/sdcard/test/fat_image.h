@@ -0,0 +1,22 @@
+//
+// fat_image.h - FAT16 image file written by and read from the host test harness
+//
+// Part of GrblHAL
+//
+
+#ifndef __FAT_IMAGE_H__
+#define __FAT_IMAGE_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct {
+    const char *name;       // 8.3 name, upper case
+    const char *data;
+    size_t size;
+} fat_image_file_t;
+
+// Writes an image holding files in the root directory, FatFS reads it via diskio.c.
+bool fat_image_create (const char *path, const fat_image_file_t *files, unsigned int n_files);
+
+#endif
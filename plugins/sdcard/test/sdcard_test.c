@@ -0,0 +1,568 @@
+//
+// sdcard_test.c - host tests for the SD card reader running on FatFS over an image file
+//
+// Part of GrblHAL
+//
+// sdcard.c is included to reach its static state, FatFS reads the files from the FAT16 image written
+// by fat_image.c. Built with SDCARD_READ_BUFFER_SIZE set to 4, 16 and 512 by the Makefile, and with
+// SDCARD_PRESCAN set for testing resuming from a line with $FL.
+//
+
+#include "../sdcard.c"
+#include "fat_image.h"
+
+#define IMAGE_FILE  "sdcard_test.img"
+#define MAX_FILES   48
+#define MAX_SIZE    (3 * SDCARD_READ_BUFFER_SIZE + 64)
+#define MAX_OUTPUT  (2 * MAX_SIZE + 8)
+
+typedef enum {
+    Read_Lines = 0, // As the protocol loop does, lines are released before they are executed
+    Read_Spans,     // Whole spans
+    Read_Chars      // Character by character via hal.stream.read
+} read_mode_t;
+
+typedef struct {
+    char name[13];
+    char description[48];
+    char data[MAX_SIZE];
+    size_t size;
+} test_file_t;
+
+grbl_hal_t hal;
+system_t sys;
+grbl_t grbl;
+parser_state_t gc_state;
+
+static test_file_t files[MAX_FILES];
+static fat_image_file_t image_files[MAX_FILES];
+static uint_fast8_t n_files = 0;
+static char output[MAX_OUTPUT];
+static size_t output_length;
+static uint_fast8_t rewinds;
+static bool cycle_start;
+static uint_fast16_t failures;
+#if SDCARD_PRESCAN
+static test_file_t *program_file;
+static char executed[512];
+static float work_offset_z;
+#endif
+
+#define CHECK(cond) check(cond, #cond, __LINE__)
+
+static void check (bool ok, const char *cond, int line)
+{
+    if(!ok) {
+        failures++;
+        printf("FAIL line %d: %s\n", line, cond);
+    }
+}
+
+// Stands in for the serial stream and the core.
+
+static void stream_write (const char *s)
+{
+    size_t length = strlen(s);
+
+    if(output_length + length < sizeof(output)) {
+        memcpy(&output[output_length], s, length + 1);
+        output_length += length;
+    }
+}
+
+static int16_t stream_read (void)
+{
+    return SERIAL_NO_DATA;
+}
+
+static void stream_reset_read_buffer (void)
+{
+}
+
+static bool stream_enqueue_realtime_command (char c)
+{
+    return false;
+}
+
+static status_code_t status_message (status_code_t status_code)
+{
+    return status_code;
+}
+
+static void execute_realtime (uint_fast16_t state)
+{
+}
+
+static void state_change (uint_fast16_t state)
+{
+}
+
+static void program_completed (program_flow_t program_flow)
+{
+}
+
+void report_init_fns (void)
+{
+    grbl.report.status_message = status_message;
+}
+
+message_code_t report_feedback_message (message_code_t message_code)
+{
+    return message_code;
+}
+
+bool protocol_enqueue_rt_command (on_execute_realtime_ptr fn)
+{
+    return true;
+}
+
+char *ftoa (float n, uint8_t decimal_places)
+{
+    static char buf[32];
+
+    snprintf(buf, sizeof(buf), "%.*f", decimal_places, n);
+
+    return buf;
+}
+
+#if SDCARD_PRESCAN
+
+// Core functions used by prescan.c, blocks executed are recorded separated by '|'.
+
+settings_t settings;
+
+char const *const axis_letter[N_AXIS] = {
+    "X",
+    "Y",
+    "Z"
+#if N_AXIS > 3
+    ,"A"
+#endif
+#if N_AXIS > 4
+    ,"B"
+#endif
+#if N_AXIS > 5
+    ,"C"
+#endif
+};
+
+status_code_t gc_execute_block (char *block, char *message)
+{
+    if(strlen(executed) + strlen(block) < sizeof(executed) - 1) {
+        strcat(executed, block);
+        strcat(executed, "|");
+    }
+
+    return Status_OK;
+}
+
+float gc_get_offset (uint_fast8_t idx)
+{
+    return idx == Z_AXIS ? work_offset_z : 0.0f;
+}
+
+bool protocol_execute_realtime (void)
+{
+    return true;
+}
+
+char *uitoa (uint32_t n)
+{
+    static char buf[12];
+
+    sprintf(buf, "%u", (unsigned int)n);
+
+    return buf;
+}
+
+bool read_float (char *line, uint_fast8_t *char_counter, float *float_ptr)
+{
+    char *start = &line[*char_counter], *end = start;
+    bool negative = *end == '-';
+    float value = 0.0f, scale = 0.0f;
+
+    if(*end == '-' || *end == '+')
+        end++;
+
+    for(; (*end >= '0' && *end <= '9') || (*end == '.' && scale == 0.0f); end++) {
+        if(*end == '.')
+            scale = 1.0f;
+        else if(scale == 0.0f)
+            value = value * 10.0f + (*end - '0');
+        else
+            value += (*end - '0') * (scale /= 10.0f);
+    }
+
+    if(end == start || (end == start + 1 && !(*start >= '0' && *start <= '9')))
+        return false;
+
+    *float_ptr = negative ? -value : value;
+    *char_counter += end - start;
+
+    return true;
+}
+
+#endif
+
+static status_code_t sys_command (const char *command)
+{
+    char line[64], lcline[64];
+    uint_fast8_t idx = 0;
+
+    do {
+        line[idx] = command[idx];
+        lcline[idx] = LCAPS(command[idx]);
+    } while(command[idx++]);
+
+    return grbl.on_unknown_sys_command(STATE_IDLE, line, lcline);
+}
+
+// Test files, lines are made up from the pattern. Files are added in the order they are stored in the image.
+
+static test_file_t *add_file (const char *description, const char *data, size_t size)
+{
+    test_file_t *file = &files[n_files];
+
+    sprintf(file->name, "T%02u.NC", (unsigned int)n_files);
+    strncpy(file->description, description, sizeof(file->description) - 1);
+    memcpy(file->data, data, size);
+    file->size = size;
+
+    image_files[n_files].name = file->name;
+    image_files[n_files].data = file->data;
+    image_files[n_files].size = file->size;
+
+    return &files[n_files++];
+}
+
+static test_file_t *add_lines (const char *description, size_t size)
+{
+    static const char pattern[] = "G0X1Y2\nG1X10.5F600\nM3S1000\nG2X5Y5I1J1\n";
+    char data[MAX_SIZE];
+    size_t idx;
+
+    for(idx = 0; idx < size; idx++)
+        data[idx] = pattern[idx % (sizeof(pattern) - 1)];
+
+    return add_file(description, data, size);
+}
+
+static void add_files (void)
+{
+    char description[48];
+    test_file_t *file;
+    uint_fast8_t blocks;
+    int offset;
+    size_t idx;
+
+    add_file("empty", "", 0);
+    add_file("one line", "G0X1\n", 5);
+    add_file("unterminated", "G0X1\nG1Y2", 9);
+    add_file("cr", "G0X1\rG0X2\rG0X3\r", 15);
+    add_file("blank lines", "\n\nG0X1\n\n\nG0X2\n\n", 15);
+    add_file("crlf", "G0X1Y2Z3F100000\r\nG1X2\r\nG1X3Y4Z5A6B7\r\n", 37);
+
+    for(blocks = 1; blocks <= 3; blocks++) {
+
+        // Files ending just before, at and just after a buffer boundary, with and without a terminated last line
+        for(offset = -1; offset <= 1; offset++) {
+
+            sprintf(description, "%d bytes", (int)(blocks * SDCARD_READ_BUFFER_SIZE) + offset);
+            file = add_lines(description, blocks * SDCARD_READ_BUFFER_SIZE + offset);
+            file->data[file->size - 1] = '\n';
+
+            sprintf(description, "%d bytes, unterminated", (int)(blocks * SDCARD_READ_BUFFER_SIZE) + offset);
+            file = add_lines(description, blocks * SDCARD_READ_BUFFER_SIZE + offset);
+            file->data[file->size - 1] = '5';
+        }
+
+        // CRLF split across the buffer boundary
+        sprintf(description, "crlf split at %d", (int)(blocks * SDCARD_READ_BUFFER_SIZE));
+        file = add_lines(description, blocks * SDCARD_READ_BUFFER_SIZE + 8);
+        file->data[blocks * SDCARD_READ_BUFFER_SIZE - 1] = '\r';
+        file->data[blocks * SDCARD_READ_BUFFER_SIZE] = '\n';
+        file->data[file->size - 1] = '\n';
+
+        // CR line ends, the last one ending the file at the buffer boundary
+        sprintf(description, "cr ending at %d", (int)(blocks * SDCARD_READ_BUFFER_SIZE));
+        file = add_lines(description, blocks * SDCARD_READ_BUFFER_SIZE);
+        for(idx = 0; idx < file->size; idx++) {
+            if(file->data[idx] == '\n')
+                file->data[idx] = '\r';
+        }
+        file->data[file->size - 1] = '\r';
+
+        // Program end as last line, ending at the buffer boundary and after it
+        for(offset = 0; offset <= 2; offset += 2) {
+            sprintf(description, "M2 ending at %d", (int)(blocks * SDCARD_READ_BUFFER_SIZE) + offset);
+            file = add_lines(description, blocks * SDCARD_READ_BUFFER_SIZE + offset);
+            memcpy(&file->data[file->size - 4], "\nM2\n", 4);
+        }
+    }
+
+#if SDCARD_PRESCAN
+    static const char program[] = "G21 G90 G54\nM3 S1000 (start)\nG0 X0 Y0 Z5\nG1 Z-1 F100\nG1 X10 Y5\n"
+                                  "G0 Z10\nG0 X20\nG1 Z-2\nG1 X30 Y10\nM5\nM2\n";
+
+    program_file = add_file("program", program, sizeof(program) - 1);
+#endif
+}
+
+// Content the reader is expected to return: the file with a newline added if the last line is not terminated.
+static size_t expected (const test_file_t *file, char *data, uint32_t *lines)
+{
+    size_t idx, size = file->size;
+    uint_fast8_t eol = 0;
+
+    memcpy(data, file->data, size);
+    if(size && data[size - 1] != '\r' && data[size - 1] != '\n')
+        data[size++] = '\n';
+
+    // Lines are counted when the character following the end of line is read, a CRLF pair ends one line.
+    for(idx = 0, *lines = 0; idx < size; idx++) {
+        if(eol == 1)
+            (*lines)++;
+        eol = data[idx] == '\r' || data[idx] == '\n' ? eol + 1 : 0;
+    }
+
+    return size;
+}
+
+// Executes a line, a program end with the file set to rewind waits for a cycle start and runs the file again.
+static void execute (const char *line, size_t length)
+{
+    if(length == 2 && !memcmp(line, "M2", 2) && rewinds) {
+        rewinds--;
+        grbl.on_program_completed(ProgramFlow_CompletedM2);
+        cycle_start = true;
+    }
+}
+
+// Runs the job until the stream is handed back, returns the number of characters read.
+static size_t run_job (char *out, size_t size, read_mode_t mode, bool read_ahead)
+{
+    char line[MAX_SIZE], *span;
+    size_t length = 0, line_length = 0;
+    uint_fast16_t n, consumed, polls = 0;
+    int16_t c;
+    bool eol;
+
+    while(hal.stream.type == StreamType_SDCard && ++polls < 10000) {
+
+        if(read_ahead)
+            grbl.on_execute_realtime(STATE_IDLE);
+
+        if(cycle_start) {
+            cycle_start = false;
+            grbl.on_state_change(STATE_CYCLE);
+        }
+
+        if(hal.stream.read_span && mode != Read_Chars) {
+
+            consumed = 0;
+
+            while(hal.stream.read_span && (n = hal.stream.read_span(&span, consumed))) {
+
+                if(mode == Read_Spans) {
+                    if(length + n <= size)
+                        memcpy(&out[length], span, n);
+                    length += consumed = n;
+                    continue;
+                }
+
+                consumed = 0;
+                do {
+                    c = span[consumed++];
+                    if(length < size)
+                        out[length] = c;
+                    length++;
+                    if(!(eol = c == '\r' || c == '\n'))
+                        line[line_length++] = c;
+                } while(!eol && consumed < n);
+
+                if(eol) {
+                    hal.stream.read_span(&span, consumed);
+                    consumed = 0;
+                    execute(line, line_length);
+                    line_length = 0;
+                }
+
+                if(read_ahead)
+                    grbl.on_execute_realtime(STATE_IDLE);
+            }
+
+        } else while((c = hal.stream.read()) != SERIAL_NO_DATA) {
+
+            if(length < size)
+                out[length] = c;
+            length++;
+
+            if(c == '\r' || c == '\n') {
+                execute(line, line_length);
+                line_length = 0;
+            } else
+                line[line_length++] = c;
+
+            if(read_ahead)
+                grbl.on_execute_realtime(STATE_IDLE);
+        }
+    }
+
+    return length;
+}
+
+static void test_job (const test_file_t *test, read_mode_t mode, bool read_ahead, bool rewind)
+{
+    static const char *modes[] = { "lines", "spans", "chars" };
+    char command[24], expect[MAX_OUTPUT], out[MAX_OUTPUT];
+    size_t length, size;
+    uint32_t lines;
+    bool ok;
+
+    size = expected(test, expect, &lines);
+
+    rewinds = rewind ? 1 : 0;
+    cycle_start = false;
+
+    if(rewind) {
+        CHECK(sys_command("$FR") == Status_OK);
+        memcpy(&expect[size], expect, size);
+        size *= 2;
+    }
+
+    sprintf(command, "$F=%s", test->name);
+    CHECK(sys_command(command) == Status_OK);
+
+    length = run_job(out, sizeof(out), mode, read_ahead);
+
+    ok = length == size && !memcmp(out, expect, size) && file.line == lines && file.pos == test->size;
+    ok = ok && file.handle == NULL && hal.stream.type == StreamType_Serial && hal.stream.read == stream_read && rewinds == 0;
+
+    if(!ok) {
+        failures++;
+        printf("FAIL %s (%s), %s%s%s: %u of %u characters %s, line %u of %u, position %u of %u\n",
+                test->name, test->description, modes[mode], read_ahead ? ", read ahead" : "", rewind ? ", rewind" : "",
+                 (unsigned int)length, (unsigned int)size, length == size && !memcmp(out, expect, size) ? "ok" : "differ",
+                  (unsigned int)file.line, (unsigned int)lines, (unsigned int)file.pos, (unsigned int)test->size);
+    }
+}
+
+// $F< outputs the file as is.
+static void test_dump (const test_file_t *test)
+{
+    char command[24];
+
+    sprintf(command, "$F<%s", test->name);
+    output_length = 0;
+    *output = '\0';
+
+    CHECK(sys_command(command) == Status_OK);
+    CHECK(output_length == test->size && !memcmp(output, test->data, test->size));
+    CHECK(file.handle == NULL);
+}
+
+#if SDCARD_PRESCAN
+
+// $FL moves to the position programmed before the line through the highest Z of the program, or the current
+// Z if higher, and starts the spindle before Z is lowered. The line resumed from and the position are reported.
+static void test_resume (void)
+{
+    char command[32], out[MAX_OUTPUT];
+
+    sprintf(command, "$FL=8,%s", program_file->name);
+    output_length = *executed = 0;
+
+    CHECK(sys_command(command) == Status_OK);
+    CHECK(!strcmp(executed, "G21G90G94G54|G0Z10.000|G0X20.000Y5.000|M3S1000.000|G1F100.000Z-2.000|G1G21G90G54M3F100.000S1000.000|"));
+    CHECK(strstr(output, "|L:9+|BB:0.000,0.000,-2.000:20.000,5.000,10.000|TC:0|RL:8:20.000,5.000,-2.000]") != NULL);
+    CHECK(run_job(out, sizeof(out), Read_Lines, false) == 17 && !memcmp(out, "G1 X30 Y10\nM5\nM2\n", 17));
+
+    // Current Z above the program
+    gc_state.position[Z_AXIS] = 30.0f;
+    work_offset_z = -20.0f;
+    output_length = *executed = 0;
+
+    CHECK(sys_command(command) == Status_OK);
+    CHECK(!strcmp(executed, "G21G90G94G54|G0Z50.000|G0X20.000Y5.000|M3S1000.000|G1F100.000Z-2.000|G1G21G90G54M3F100.000S1000.000|"));
+    run_job(out, sizeof(out), Read_Lines, false);
+
+    // Nothing programmed before the line, modal state only
+    sprintf(command, "$FL=2,%s", program_file->name);
+    output_length = *executed = 0;
+
+    CHECK(sys_command(command) == Status_OK);
+    CHECK(!strcmp(executed, "G21G90G94G54|G21G90G54M3S1000.000|"));
+    CHECK(strstr(output, "|RL:2:0.000,0.000,0.000]") != NULL);
+    run_job(out, sizeof(out), Read_Lines, false);
+}
+
+#endif
+
+static void setup (void)
+{
+    memset(&hal, 0, sizeof(grbl_hal_t));
+    memset(&grbl, 0, sizeof(grbl_t));
+
+    hal.stream.type = StreamType_Serial;
+    hal.stream.write = stream_write;
+    hal.stream.read = stream_read;
+    hal.stream.reset_read_buffer = stream_reset_read_buffer;
+    hal.stream.enqueue_realtime_command = stream_enqueue_realtime_command;
+    hal.driver_reset = stream_reset_read_buffer;
+
+    grbl.on_execute_realtime = execute_realtime;
+    grbl.on_state_change = state_change;
+    grbl.on_program_completed = program_completed;
+    report_init_fns();
+
+    sys.state = STATE_IDLE;
+
+    sdcard_init();
+}
+
+int main (void)
+{
+    uint_fast8_t idx, mode;
+
+    setup();
+    add_files();
+
+    if(!fat_image_create(IMAGE_FILE, image_files, n_files)) {
+        printf("FAIL: could not write %s\n", IMAGE_FILE);
+        return 1;
+    }
+
+    CHECK(sys_command("$FM") == Status_OK);
+    CHECK(sys_command("$F=NOFILE.NC") == Status_SDReadError);
+
+    for(idx = 0; idx < n_files; idx++) {
+
+        for(mode = Read_Lines; mode <= Read_Chars; mode++) {
+            test_job(&files[idx], (read_mode_t)mode, false, false);
+            test_job(&files[idx], (read_mode_t)mode, true, false);
+        }
+
+        if(strncmp(files[idx].description, "M2", 2) == 0) {
+            test_job(&files[idx], Read_Lines, false, true);
+            test_job(&files[idx], Read_Lines, true, true);
+            test_job(&files[idx], Read_Chars, true, true);
+        }
+
+        test_dump(&files[idx]);
+    }
+
+#if SDCARD_PRESCAN
+    test_resume();
+#endif
+
+    remove(IMAGE_FILE);
+
+    if(failures) {
+        printf("%u checks failed with SDCARD_READ_BUFFER_SIZE %u\n", (unsigned int)failures, (unsigned int)SDCARD_READ_BUFFER_SIZE);
+        return 1;
+    }
+
+    printf("OK, %u files read with SDCARD_READ_BUFFER_SIZE %u\n", (unsigned int)n_files, (unsigned int)SDCARD_READ_BUFFER_SIZE);
+
+    return 0;
+}